@@ -0,0 +1,148 @@
+// Sweep-and-prune broad phase (src/SweepAndPrune.h) on debris-like bodies.
+//
+//    BroadPhaseBench [--bodies 1000,4000,...] [--steps n]
+//
+// Boxes of 0.2 to 2 units drift at up to 5 units/sec in a 200 x 40 x 200
+// region over a synthetic terrain, bouncing off its walls, stepped at 60 Hz.
+// Reports per step: the mean and worst update() time, the overlapping pairs
+// and terrain contacts it found, and the cost of testing every pair instead.
+// Every 30 steps the pair list is checked against that brute force test.
+//
+// Built against the openFrameworks core library only, no window is opened.
+
+#include "ofMain.h"
+#include "Octree.h"
+#include "SweepAndPrune.h"
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const float kDt = 1.0 / 60;
+static const ofVec3f kLow(-100, 0, -100), kHigh(100, 40, 100);
+
+static double elapsedMs(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// deterministic noise in [0, 1)
+static float hashNoise(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// height field of side * side vertices over the region, up to ~10 high
+static void makeTerrain(int side, ofMesh &mesh) {
+	float spacing = (kHigh.x - kLow.x) / (side - 1);
+	for (int j = 0; j < side; j++) {
+		for (int i = 0; i < side; i++) {
+			float x = kLow.x + i * spacing, z = kLow.z + j * spacing;
+			mesh.addVertex(ofVec3f(x, 5 + 4 * sin(x * 0.05) * cos(z * 0.04) + hashNoise(j * side + i), z));
+		}
+	}
+}
+
+struct Debris {
+	ofVec3f position, velocity, half;
+};
+
+static vector<int> parseList(const string &s) {
+	vector<int> r;
+	for (const string &v : ofSplitString(s, ",", true, true)) r.push_back(atoi(v.c_str()));
+	return r;
+}
+
+static uint64_t pairKey(int a, int b) {
+	return (uint64_t) min(a, b) << 32 | max(a, b);
+}
+
+static vector<uint64_t> bruteForce(const vector<Debris> &debris, const vector<int> &ids) {
+	vector<uint64_t> found;
+	for (int i = 0; i < debris.size(); i++) {
+		const Debris &p = debris[i];
+		for (int k = i + 1; k < debris.size(); k++) {
+			const Debris &q = debris[k];
+			if (fabs(p.position.x - q.position.x) <= p.half.x + q.half.x &&
+				fabs(p.position.y - q.position.y) <= p.half.y + q.half.y &&
+				fabs(p.position.z - q.position.z) <= p.half.z + q.half.z)
+				found.push_back(pairKey(ids[i], ids[k]));
+		}
+	}
+	return found;
+}
+
+static void bench(int n, int steps, const Octree &terrain) {
+	vector<Debris> debris(n);
+	vector<int> ids(n);
+	SweepAndPrune sap;
+	sap.setTerrain(&terrain);
+	for (int i = 0; i < n; i++) {
+		Debris &d = debris[i];
+		d.position = kLow + (kHigh - kLow) * ofVec3f(hashNoise(6 * i), hashNoise(6 * i + 1), hashNoise(6 * i + 2));
+		d.velocity = ofVec3f(hashNoise(6 * i + 3) - 0.5, hashNoise(6 * i + 4) - 0.5, hashNoise(6 * i + 5) - 0.5) * 10;
+		d.half = ofVec3f(0.1, 0.1, 0.1) + ofVec3f(hashNoise(7 * i), hashNoise(11 * i), hashNoise(13 * i)) * 0.9;
+		ids[i] = sap.add(d.position - d.half, d.position + d.half);
+	}
+	sap.update();
+
+	double total = 0, worst = 0, brute = 0;
+	long pairs = 0, contacts = 0;
+	int checks = 0, mismatches = 0;
+	for (int s = 0; s < steps; s++) {
+		for (int i = 0; i < n; i++) {
+			Debris &d = debris[i];
+			d.position += d.velocity * kDt;
+			for (int k = 0; k < 3; k++) {
+				if (d.position[k] < kLow[k] || d.position[k] > kHigh[k]) d.velocity[k] = -d.velocity[k];
+			}
+			sap.setBounds(ids[i], d.position - d.half, d.position + d.half);
+		}
+		Clock::time_point start = Clock::now();
+		sap.update();
+		double ms = elapsedMs(start);
+		total += ms;
+		worst = max(worst, ms);
+		pairs += sap.pairs.size();
+		contacts += sap.terrainContacts.size();
+
+		if (s % 30 == 0) {
+			start = Clock::now();
+			vector<uint64_t> expected = bruteForce(debris, ids);
+			brute += elapsedMs(start);
+			vector<uint64_t> found;
+			for (const BodyPair &p : sap.pairs) found.push_back(pairKey(p.a, p.b));
+			sort(expected.begin(), expected.end());
+			sort(found.begin(), found.end());
+			checks++;
+			if (found != expected) mismatches++;
+		}
+	}
+	printf("%8d %10.4f %10.4f %8.1f %9.1f %12.3f %8s\n", n, total / steps, worst, (double) pairs / steps,
+		(double) contacts / steps, brute / checks, mismatches ? "FAIL" : "ok");
+}
+
+int main(int argc, char **argv) {
+	vector<int> counts = { 1000, 2000, 4000, 8000, 16000 };
+	int steps = 300;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		string arg = argv[i];
+		if (arg == "--bodies") counts = parseList(argv[i + 1]);
+		else if (arg == "--steps") steps = max(1, atoi(argv[i + 1]));
+		else {
+			cerr << "unknown option " << arg << endl;
+			return 1;
+		}
+	}
+
+	ofMesh mesh;
+	makeTerrain(256, mesh);
+	Octree terrain;
+	terrain.create(mesh, 20);
+
+	printf("%8s %10s %10s %8s %9s %12s %8s\n", "bodies", "mean ms", "worst ms", "pairs", "terrain", "all pairs ms", "check");
+	for (int n : counts) bench(n, steps, terrain);
+	return 0;
+}
@@ -0,0 +1,84 @@
+
+// Accuracy versus cost of the particle integrators on a reference descent.
+//
+// The lander starts 10 units above the ground at rest, falls under the
+// default gravity, fires the vertical thruster for a while and coasts.
+// Each integrator is run at a range of step sizes against an RK4 run with
+// a very small step; the largest step that stays within tolerance is the
+// one to pick for that integrator.
+//
+// Built against the openFrameworks core library only, no window is opened.
+
+#include "ofMain.h"
+#include "ParticleSystem.h"
+#include <chrono>
+
+static const float kGravity = 0.2;          // ofApp slider default
+static const float kThrust = 0.5;           // one press of the spacebar
+static const float kDuration = 12.0;        // sec
+static const float kTolerance = 0.01;       // max final position error
+static const int   kLanders = 1000;         // bodies per run, for timing
+
+// thrust profile: free fall, burn between 4 and 7 sec, coast
+static float thrustAt(float t) {
+	return (t >= 4.0 && t < 7.0) ? kThrust : 0.0;
+}
+
+struct DescentResult {
+	ofVec3f position;
+	ofVec3f velocity;
+	double nsPerStep;    // per body
+};
+
+static DescentResult runDescent(IntegratorType type, float dt, int landers) {
+	ParticleSystem sys;
+	ThrusterForce thruster;
+	GravityForce gravity(ofVec3f(0, -kGravity, 0));
+	sys.addForce(&thruster);
+	sys.addForce(&gravity);
+	sys.setIntegrator(type);
+
+	Particle lander;
+	lander.lifespan = -1;
+	lander.position.set(0, 10, 0);
+	for (int i = 0; i < landers; i++)
+		sys.add(lander);
+
+	int steps = (int) (kDuration / dt + 0.5);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++) {
+		thruster.set(ofVec3f(0, thrustAt(i * dt), 0));
+		sys.update(dt);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	DescentResult r;
+	r.position = sys.particles[0].position;
+	r.velocity = sys.particles[0].velocity;
+	r.nsPerStep = std::chrono::duration<double, std::nano>(end - start).count() / ((double) steps * landers);
+	return r;
+}
+
+int main(int argc, char **argv) {
+	DescentResult reference = runDescent(RK4Integrator, 1.0 / 10000, 1);
+	cout << "reference: position " << reference.position << "  velocity " << reference.velocity << endl << endl;
+
+	const char *names[] = { "euler", "semi-implicit", "verlet", "rk4" };
+	const float steps[] = { 1.0 / 240, 1.0 / 120, 1.0 / 60, 1.0 / 30, 1.0 / 15, 1.0 / 10, 1.0 / 5, 1.0 / 4, 1.0 / 2 };
+	const int nsteps = sizeof(steps) / sizeof(steps[0]);
+
+	printf("%-14s %8s %12s %12s %10s\n", "integrator", "dt", "pos error", "vel error", "ns/step");
+	for (int type = EulerIntegrator; type <= RK4Integrator; type++) {
+		float largest = 0;
+		for (int i = 0; i < nsteps; i++) {
+			DescentResult r = runDescent((IntegratorType) type, steps[i], kLanders);
+			float perr = r.position.distance(reference.position);
+			float verr = r.velocity.distance(reference.velocity);
+			if (perr < kTolerance) largest = steps[i];
+			printf("%-14s %8.4f %12.6f %12.6f %10.1f\n", names[type], steps[i], perr, verr, r.nsPerStep);
+		}
+		printf("%-14s largest step within %.3f: %s\n\n", names[type], kTolerance,
+			largest > 0 ? ofToString(largest).c_str() : "none");
+	}
+	return 0;
+}
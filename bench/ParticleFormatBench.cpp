@@ -0,0 +1,151 @@
+// Compressed particle store (src/CompactParticles.h) against the full layout.
+//
+//    ParticleFormatBench [--particles 10000,100000,...] [--repeat n]
+//
+// Bandwidth: the same exhaust-like cloud (gravity, damping, semi-implicit
+// Euler, no terrain) is stepped in a ParticleSystem and in a
+// CompactParticleSystem, reporting the bytes stored per particle and the
+// update cost per particle, the fastest of --repeat steps.  Accuracy: both
+// start from the same particles and the compact positions and velocities
+// are compared with the full ones after each number of steps, with the
+// origin fixed at the emitter and with it following an emitter that
+// descends like the lander.
+//
+// Built against the openFrameworks core library only, no window is opened.
+
+#include "ofMain.h"
+#include "ParticleSystem.h"
+#include "CompactParticles.h"
+#include <chrono>
+
+static const ofVec3f kEmitter(0, 10, 0);
+static const float kDt = 1.0 / 60;
+
+// deterministic noise in [-1, 1)
+static float noise(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return (x >> 8) / 8388608.0f - 1;
+}
+
+// exhaust: out of a disc under the emitter, downwards with some spread
+static Particle exhaustParticle(int i) {
+	Particle p;
+	p.lifespan = -1;
+	p.mass = 10;
+	p.damping = .99;
+	p.position = kEmitter + ofVec3f(noise(3 * i) * 0.4, 0, noise(3 * i + 1) * 0.4);
+	p.velocity = ofVec3f(noise(3 * i + 2), -5 + noise(7 * i), noise(11 * i));
+	return p;
+}
+
+static ParticleParams exhaustParams() {
+	Particle p = exhaustParticle(0);
+	ParticleParams params = { p.mass, p.damping, p.radius, p.lifespan };
+	return params;
+}
+
+static vector<int> parseList(const string &s) {
+	vector<int> r;
+	for (const string &v : ofSplitString(s, ",", true, true)) r.push_back(atoi(v.c_str()));
+	return r;
+}
+
+// fastest of "repeat" single steps, ns
+template <class System>
+static double timeStep(System &sys, int repeat) {
+	double best = 1e30;
+	for (int r = 0; r < repeat; r++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		sys.update(kDt);
+		best = min(best, std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+	return best;
+}
+
+static void benchBandwidth(int n, int repeat) {
+	GravityForce gravity(ofVec3f(0, -0.2, 0));
+	ParticleSystem full;
+	full.addForce(&gravity);
+	full.setIntegrator(SemiImplicitEulerIntegrator);
+	for (int i = 0; i < n; i++) full.add(exhaustParticle(i));
+
+	ParticleSystem spawned = full;
+	CompactParticleSystem compact;
+	compact.params = exhaustParams();
+	compact.setOrigin(kEmitter);
+	compact.update(kDt);            // empty, takes the origin
+	compact.absorb(spawned);
+
+	// one untimed step each to settle the caches
+	full.update(kDt);
+	compact.update(kDt);
+	double fullNs = timeStep(full, repeat) / n;
+	double compactNs = timeStep(compact, repeat) / n;
+	printf("%10d %10d %10d %12.2f %12.2f %8.2fx\n", n, (int) sizeof(Particle), (int) compact.bytesPerParticle(),
+		fullNs, compactNs, fullNs / compactNs);
+}
+
+static void benchAccuracy(int n, bool moving) {
+	GravityForce gravity(ofVec3f(0, -0.2, 0));
+	ParticleSystem full;
+	full.addForce(&gravity);
+	full.setIntegrator(SemiImplicitEulerIntegrator);
+	for (int i = 0; i < n; i++) full.add(exhaustParticle(i));
+
+	ParticleSystem spawned = full;
+	CompactParticleSystem compact;
+	compact.params = exhaustParams();
+	compact.setOrigin(kEmitter);
+	compact.update(kDt);
+	compact.absorb(spawned);
+
+	const int checkpoints[] = { 1, 30, 60, 120, 240 };
+	int step = 0;
+	for (int c : checkpoints) {
+		for (; step < c; step++) {
+			// lander coming down at 1 unit/sec, the origin follows it
+			if (moving) compact.setOrigin(kEmitter - ofVec3f(0, step * kDt, 0));
+			full.update(kDt);
+			compact.update(kDt);
+		}
+		double sum = 0, worst = 0, worstV = 0, reach = 0;
+		Particle p;
+		for (int i = 0; i < n; i++) {
+			compact.decode(i, p);
+			double e = p.position.distance(full.particles[i].position);
+			sum += e * e;
+			worst = max(worst, e);
+			worstV = max(worstV, (double) p.velocity.distance(full.particles[i].velocity));
+			reach = max(reach, (double) full.particles[i].position.distance(compact.getOrigin()));
+		}
+		printf("%-8s %6d %6.2f %10.2f %12.6f %12.6f %12.6f\n", moving ? "moving" : "fixed", c, c * kDt, reach,
+			sqrt(sum / n), worst, worstV);
+	}
+}
+
+int main(int argc, char **argv) {
+	vector<int> counts = { 10000, 100000, 1000000, 4000000 };
+	int repeat = 10;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		string arg = argv[i];
+		if (arg == "--particles") counts = parseList(argv[i + 1]);
+		else if (arg == "--repeat") repeat = max(1, atoi(argv[i + 1]));
+		else {
+			cerr << "unknown option " << arg << endl;
+			return 1;
+		}
+	}
+
+	printf("%10s %10s %10s %12s %12s %9s\n", "particles", "full B", "compact B", "full ns", "compact ns", "speedup");
+	for (int n : counts) benchBandwidth(n, repeat);
+
+	// error of the compact store, in world units, against the full layout
+	printf("\n%-8s %6s %6s %10s %12s %12s %12s\n", "origin", "steps", "sec", "reach", "rms pos", "max pos", "max vel");
+	benchAccuracy(10000, false);
+	benchAccuracy(10000, true);
+	return 0;
+}
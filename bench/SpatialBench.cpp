@@ -0,0 +1,337 @@
+
+// Microbenchmarks for the spatial index, the particle system and render prep.
+//
+//    SpatialBench [--vertices 10000,100000,...] [--particles 1000,...]
+//                 [--queries n] [--repeat n] [--out file.json]
+//
+// Terrains are synthetic height fields (rolling hills plus hashed noise) on
+// a square grid, so no assets and no GL context are needed.  Every case is
+// run --repeat times and the min and median are reported per operation.
+//
+// Cases:
+//    octree_build       Octree::create over the terrain
+//    octree_collision   getCollision with points on or near the surface
+//    octree_ray         getIntersectingVertices with rays straight down
+//    lander_agl         LanderSim::altitude (displayAGL in the app)
+//    octree_surface     surfaceAt, the thread-safe column query
+//    octree_descent     collision and ray down from lander-like descents,
+//                       each query from the root or through an OctreeCursor
+//    lander_predict     TrajectoryPredictor::predict, per prediction of four
+//                       thrust settings from up to 20 units above the surface
+//    particle_update    ParticleSystem::update per particle, by force set
+//                       (cyclic: CyclicForce, field: the same baked into a
+//                       VectorFieldForce)
+//    grid_build         ParticleGrid::build (the spatial hash behind
+//                       removeNear and forEachNeighbor) per particle, from
+//                       a ParticleList and from a positions-only array
+//    grid_query         ParticleGrid::queryRadius of radius 1 around
+//                       particles, per query
+//    emitter_spawn      ParticleEmitter::spawnBatch per particle
+//    vertex_pack        packParticleVertices (loadVbo) per particle
+//
+// Output is one JSON document, for tracking regressions between commits.
+// The default sizes go up to 10M terrain vertices, which needs around a GB
+// for the octree alone; cap them with --vertices on small machines.
+
+#include "ofMain.h"
+#include "Octree.h"
+#include "LanderSim.h"
+#include "ParticleSystem.h"
+#include "ParticleEmitter.h"
+#include "ParticleStream.h"
+#include "VectorFieldForce.h"
+#include "TrajectoryPredictor.h"
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double elapsedNs(Clock::time_point start) {
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// deterministic noise in [0, 1)
+static float hashNoise(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// square grid of about n vertices over 200 x 200 units, heights up to ~15
+static void makeTerrain(int n, ofMesh &mesh) {
+	int side = max(2, (int) sqrt((double) n));
+	float spacing = 200.0 / (side - 1);
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	for (int j = 0; j < side; j++) {
+		for (int i = 0; i < side; i++) {
+			float x = i * spacing - 100, z = j * spacing - 100;
+			float y = 6 * sin(x * 0.05) * cos(z * 0.04) + 3 * sin(x * 0.21 + z * 0.17)
+				+ hashNoise(j * side + i);
+			mesh.addVertex(ofVec3f(x, y, z));
+			mesh.addNormal(ofVec3f(0, 1, 0));
+		}
+	}
+	for (int j = 0; j + 1 < side; j++) {
+		for (int i = 0; i + 1 < side; i++) {
+			ofIndexType a = j * side + i, b = a + 1, c = a + side, d = c + 1;
+			mesh.addTriangle(a, c, b);
+			mesh.addTriangle(b, c, d);
+		}
+	}
+}
+
+struct BenchResult {
+	string name;
+	vector<pair<string, string> > params;
+	long ops;                // operations per run
+	vector<double> runs;     // ns per operation
+};
+
+static vector<BenchResult> results;
+static int repeat = 5;
+
+// time "fn" (which performs "ops" operations) repeat times
+template <typename Fn>
+static void bench(const string &name, const vector<pair<string, string> > &params, long ops, Fn fn, int runs = 0) {
+	BenchResult r;
+	r.name = name;
+	r.params = params;
+	r.ops = ops;
+	for (int i = 0; i < (runs > 0 ? runs : repeat); i++) {
+		Clock::time_point start = Clock::now();
+		fn();
+		r.runs.push_back(elapsedNs(start) / max(ops, 1L));
+	}
+	sort(r.runs.begin(), r.runs.end());
+	cerr << name;
+	for (auto &p : params) cerr << " " << p.first << "=" << p.second;
+	cerr << ": " << r.runs[0] << " ns/op" << endl;
+	results.push_back(r);
+}
+
+static vector<int> parseList(const string &s) {
+	vector<int> v;
+	for (string item : ofSplitString(s, ",", true, true)) v.push_back(ofToInt(item));
+	return v;
+}
+
+// random points on the terrain surface, optionally lifted by up to "lift"
+static void surfacePoints(const ofMesh &mesh, int n, float lift, vector<ofVec3f> &points) {
+	points.resize(n);
+	for (int i = 0; i < n; i++) {
+		ofVec3f v = mesh.getVertex((int) (hashNoise(i * 2 + 1) * mesh.getNumVertices()));
+		points[i] = v + ofVec3f(0, lift * hashNoise(i * 2 + 2), 0);
+	}
+}
+
+static void benchTerrain(int vertices, int queries) {
+	LanderSim sim;
+	makeTerrain(vertices, sim.terrain);
+	vector<pair<string, string> > params = { { "vertices", ofToString(sim.terrain.getNumVertices()) } };
+
+	// large builds take seconds, run them fewer times
+	int buildRuns = vertices >= 1000000 ? 1 : repeat;
+	bench("octree_build", params, sim.terrain.getNumVertices(),
+		[&]() { sim.octree.create(sim.terrain, sim.octreeMaxDepth); }, buildRuns);
+	params.push_back({ "depth", ofToString(sim.octree.highestDepth) });
+
+	vector<ofVec3f> points;
+	surfacePoints(sim.terrain, queries, 0.5, points);
+	long hits = 0;
+	bench("octree_collision", params, queries, [&]() {
+		for (const ofVec3f &p : points) hits += sim.octree.getCollision(sim.octree.root, p).size();
+	});
+
+	surfacePoints(sim.terrain, queries, 20, points);
+	bench("octree_ray", params, queries, [&]() {
+		for (const ofVec3f &p : points) {
+			Ray ray(p, Vector3(0, -1, 0));
+			hits += sim.octree.getIntersectingVertices(sim.octree.root, ray).size();
+		}
+	});
+	bench("lander_agl", params, queries, [&]() {
+		for (const ofVec3f &p : points) {
+			sim.ship().position = p;
+			hits += sim.altitude() > 0;
+		}
+	});
+	bench("octree_surface", params, queries, [&]() {
+		float h;
+		ofVec3f normal;
+		for (const ofVec3f &p : points) hits += sim.octree.surfaceAt(p.x, p.z, h, normal) != NULL;
+	});
+
+	// descents from 30 units up to the surface, drifting sideways, with the
+	// steps of a 60 Hz frame; the cursors follow one descent after another
+	vector<ofVec3f> descent;
+	for (int d = 0; descent.size() < queries; d++) {
+		ofVec3f p(180 * hashNoise(d * 4 + 1) - 90, 30, 180 * hashNoise(d * 4 + 2) - 90);
+		ofVec3f drift(hashNoise(d * 4 + 3) - 0.5f, -4, hashNoise(d * 4 + 4) - 0.5f);
+		float ground;
+		ofVec3f normal;
+		for (; descent.size() < queries; p += drift / 60) {
+			if (!sim.octree.surfaceAt(p.x, p.z, ground, normal) || p.y < ground) break;
+			descent.push_back(p);
+		}
+	}
+	for (bool coherent : { false, true }) {
+		vector<pair<string, string> > descentParams = params;
+		descentParams.push_back({ "from", coherent ? "cursor" : "root" });
+		OctreeCursor collision, column;
+		bench("octree_descent", descentParams, queries, [&]() {
+			for (const ofVec3f &p : descent) {
+				Ray ray(Vector3(p.x, p.y, p.z), Vector3(0, -1, 0));
+				if (coherent) {
+					hits += collision.getCollision(sim.octree, p).size();
+					hits += column.getIntersectingVertices(sim.octree, ray).size();
+				} else {
+					hits += sim.octree.getCollision(sim.octree.root, p).size();
+					hits += sim.octree.getIntersectingVertices(sim.octree.root, ray).size();
+				}
+			}
+		});
+	}
+
+	// coming down at 2 units/sec, drifting
+	TrajectoryPredictor predictor;
+	int predictions = min(queries, 500);
+	bench("lander_predict", params, predictions, [&]() {
+		for (int i = 0; i < predictions; i++) {
+			sim.ship().position = points[i];
+			sim.ship().velocity = ofVec3f(0.3, -2, 0.2);
+			predictor.predict(sim);
+			hits += predictor.paths[0].touchdown;
+		}
+	});
+	if (hits == 0) cerr << "no query hit the terrain" << endl;
+}
+
+static void benchParticles(int count, int queries, const Octree &terrain) {
+	// cyclic and field are the same swirl, computed per particle and baked
+	// into a 64 x 16 x 64 grid; neither has gravity, so the cloud stays in it
+	const char *forceSets[] = { "none", "gravity", "turbulence", "collision", "cyclic", "field" };
+	CyclicForce cyclic(1.0);
+	VectorFieldForce field;
+	field.setup(ofVec3f(-150, -20, -150), ofVec3f(150, 40, 150), 64, 16, 64);
+	field.bake(cyclic);
+	for (int f = 0; f < 6; f++) {
+		ParticleSystem sys;
+		GravityForce gravity(ofVec3f(0, -10, 0));
+		TurbulenceForce turbulence(ofVec3f(-1, -1, -1), ofVec3f(1, 1, 1));
+		if (f >= 1 && f <= 3) sys.addForce(&gravity);
+		if (f == 2) sys.addForce(&turbulence);
+		if (f == 3) {
+			sys.setTerrain(&terrain);
+			sys.setCollisionResponse(BounceCollision, 0.3, 0.4);
+		}
+		if (f == 4) sys.addForce(&cyclic);
+		if (f == 5) sys.addForce(&field);
+		sys.setIntegrator(SemiImplicitEulerIntegrator);
+
+		Particle p;
+		p.lifespan = -1;
+		sys.particles.reserve(count);
+		for (int i = 0; i < count; i++) {
+			p.position.set(hashNoise(i * 3) * 200 - 100, 20 * hashNoise(i * 3 + 1), hashNoise(i * 3 + 2) * 200 - 100);
+			sys.particles.push_back(p);
+		}
+		bench("particle_update", { { "particles", ofToString(count) }, { "forces", forceSets[f] } }, count,
+			[&]() { sys.update(1.0 / 60); });
+	}
+
+	// the same cloud, 1 unit cells
+	ParticleList cloud(count);
+	for (int i = 0; i < count; i++)
+		cloud[i].position.set(hashNoise(i * 3) * 200 - 100, 20 * hashNoise(i * 3 + 1), hashNoise(i * 3 + 2) * 200 - 100);
+	ParticleGrid grid;
+	grid.setCellSize(1);
+	bench("grid_build", { { "particles", ofToString(count) }, { "input", "particles" } }, count,
+		[&]() { grid.build(cloud); });
+	vector<ofVec3f> positions(count);
+	for (int i = 0; i < count; i++) positions[i] = cloud[i].position;
+	bench("grid_build", { { "particles", ofToString(count) }, { "input", "positions" } }, count,
+		[&]() { grid.build(positions.data(), count); });
+	vector<int> near;
+	long found = 0;
+	bench("grid_query", { { "particles", ofToString(count) } }, queries, [&]() {
+		for (int i = 0; i < queries; i++) {
+			near.clear();
+			grid.queryRadius(cloud[(int) (hashNoise(i + 7) * count)].position, 1, near);
+			found += near.size();
+		}
+	});
+	if (found == 0) cerr << "no grid query found a particle" << endl;
+
+	ParticleSystem sys;
+	ParticleEmitter emitter(&sys);
+	emitter.setEmitterType(DiscEmitter);
+	emitter.setVelocity(ofVec3f(0, -5, 0));
+	emitter.setLifespan(0.5);
+	emitter.setSeed(1);
+	sys.particles.reserve(count);
+	bench("emitter_spawn", { { "particles", ofToString(count) } }, count, [&]() {
+		sys.particles.clear();
+		emitter.spawnBatch(count, 0);
+	});
+
+	vector<ParticleVertex> vertices(count);
+	bench("vertex_pack", { { "particles", ofToString(count) } }, count,
+		[&]() { packParticleVertices(sys.particles, vertices.data(), count); });
+}
+
+static void writeJson(ostream &out) {
+	out << "{\n  \"benchmarks\": [\n";
+	for (int i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		out << "    {\"name\": \"" << r.name << "\", \"params\": {";
+		for (int k = 0; k < r.params.size(); k++) {
+			bool number = r.params[k].second.find_first_not_of("0123456789") == string::npos;
+			out << (k ? ", " : "") << "\"" << r.params[k].first << "\": ";
+			if (number) out << r.params[k].second;
+			else out << "\"" << r.params[k].second << "\"";
+		}
+		out << "}, \"ops\": " << r.ops << ", \"runs\": " << r.runs.size()
+			<< ", \"ns_per_op_min\": " << r.runs.front()
+			<< ", \"ns_per_op_median\": " << r.runs[r.runs.size() / 2] << "}"
+			<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+	vector<int> vertexCounts = { 10000, 100000, 1000000, 10000000 };
+	vector<int> particleCounts = { 1000, 10000, 100000, 1000000 };
+	int queries = 10000;
+	string outPath;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		string arg = argv[i];
+		if (arg == "--vertices") vertexCounts = parseList(argv[i + 1]);
+		else if (arg == "--particles") particleCounts = parseList(argv[i + 1]);
+		else if (arg == "--queries") queries = max(1, atoi(argv[i + 1]));
+		else if (arg == "--repeat") repeat = max(1, atoi(argv[i + 1]));
+		else if (arg == "--out") outPath = argv[i + 1];
+		else {
+			cerr << "unknown option " << arg << endl;
+			return 1;
+		}
+	}
+
+	for (int n : vertexCounts) benchTerrain(n, queries);
+
+	// particles collide with a mid-sized terrain
+	ofMesh mesh;
+	makeTerrain(100000, mesh);
+	Octree terrain;
+	terrain.create(mesh, 40);
+	for (int n : particleCounts) benchParticles(n, queries, terrain);
+
+	if (outPath == "") writeJson(cout);
+	else {
+		ofstream out(outPath.c_str());
+		writeJson(out);
+	}
+	return 0;
+}
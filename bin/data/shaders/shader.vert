@@ -1,8 +1,20 @@
+// particle vertex: xyz is the position, w the birth time (sec)
+uniform float time;        // current time (sec)
+uniform float pointSize;
+
+vec3 hsb2rgb(vec3 c) {
+    vec3 rgb = clamp(abs(mod(c.x * 6.0 + vec3(0.0, 4.0, 2.0), 6.0) - 3.0) - 1.0, 0.0, 1.0);
+    return c.z * mix(vec3(1.0), rgb, c.y);
+}
+
 void main() {
 
-    gl_Position   = gl_ModelViewProjectionMatrix * gl_Vertex;
-	float size    = gl_Normal.x;
-    gl_PointSize  = size;
-    gl_FrontColor = gl_Color;
+    gl_Position   = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xyz, 1.0);
+    gl_PointSize  = pointSize;
+
+    // over the first second: red -> orange, fading to black and transparent
+    float age     = time - gl_Vertex.w;
+    vec3 hsb      = clamp(vec3(0.098 * age, 1.0 - age, 0.5 - 0.5 * age), 0.0, 1.0);
+    gl_FrontColor = vec4(hsb2rgb(hsb), clamp(0.196 - 0.196 * age, 0.0, 1.0));
 
-}
\ No newline at end of file
+}
@@ -5,8 +5,10 @@ precision highp float;
 
 uniform sampler2D tex;
 
+varying vec4 colorVarying;
+
 void main (void) {
     
-    gl_FragColor = texture2D(tex, gl_TexCoord[0].st) * gl_Color;
+    gl_FragColor = texture2D(tex, gl_PointCoord) * colorVarying;
     
-}
\ No newline at end of file
+}
@@ -0,0 +1,46 @@
+// Writes a terrain tile pyramid for TerrainTiles.
+//
+//    lander_tiles <terrain.obj | procedural:...> <outdir> [tile size]
+//
+// A procedural spec is generated tile by tile, so worlds far larger than
+// memory can be built; tile size is the level 0 tile edge in grid cells
+// (default 128).  An OBJ mesh is loaded whole and cut into tiles of about
+// "tile size" vertices (default 16384).  The result is flown with
+// "tiles:<outdir>" in place of the terrain, in the app or lander_headless.
+
+#include "ofMain.h"
+#include "MeshCache.h"
+#include "TerrainGenerator.h"
+#include "TerrainTiles.h"
+#include <chrono>
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		cerr << "usage: " << argv[0] << " <terrain.obj | procedural:...> <outdir> [tile size]" << endl;
+		return 1;
+	}
+	string source = argv[1], dir = argv[2];
+	int tileSize = argc > 3 ? atoi(argv[3]) : 0;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	bool ok;
+	if (TerrainGenerator::isSpec(source)) {
+		TerrainGenerator generator;
+		if (!TerrainGenerator::parseSpec(source, generator.params)) return 1;
+		ok = TerrainTiles::build(dir, generator, tileSize > 0 ? tileSize : 128);
+	}
+	else {
+		ofMesh mesh;
+		if (!loadCachedObjMesh(source, mesh)) return 1;
+		ok = TerrainTiles::build(dir, mesh, tileSize > 0 ? tileSize : 16384);
+	}
+	if (!ok) return 1;
+
+	TerrainTiles tiles;
+	if (!tiles.open(dir, 1)) return 1;
+	cerr << dir << ": " << tiles.levels << " levels, " << tiles.nx << " x " << tiles.nz << " level 0 tiles of "
+		<< tiles.tileW << " x " << tiles.tileD << ", built in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+		<< " ms" << endl;
+	return 0;
+}
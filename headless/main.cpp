@@ -0,0 +1,267 @@
+
+// Headless lander simulator: no window, sound or GL.
+//
+//    lander_headless [-n landers] [-j threads] [-m tile MB] [-p profile.json|.csv]
+//                    <terrain.obj> <script> [<script> ...]
+//    lander_headless -r <checkpoint> <terrain.obj> <session.llog> [...]
+//
+// The terrain is an OBJ file, a "procedural:..." spec (see TerrainGenerator)
+// or "tiles:<dir>", a tile pyramid written by lander_tiles that is paged in
+// around the ship as it flies (see TerrainTiles; not with -n).
+// Loads the terrain, builds the octree once and flies every script against
+// it as fast as the CPU allows.  With -n each script is flown as a Monte
+// Carlo batch of that many landers with dispersed start state and thrust
+// (see LanderBatch), and touchdown statistics are printed instead.
+// With -r the arguments are session logs recorded in the app ('o' key),
+// replayed from the given checkpoint (0 = where recording began, then one
+// every 5 sec) and checked against every later checkpoint.
+// A script is a text file:
+//
+//    # comment
+//    start    x y z          ship start position
+//    gravity  g              (default 0.2)
+//    dt       sec            fixed physics step (default 1/60)
+//    maxtime  sec            give up after this much flight (default 300)
+//    crash    speed          touchdown speed that counts as a crash (default 1)
+//    at t thrust x y z       from time t on the thruster pushes with x y z
+//    disperse p v g d        Monte Carlo sigmas: start position, start velocity,
+//                            thrust gain and start delay (default .5 .05 .05 .1)
+//    seed     n              Monte Carlo random seed (default 1)
+//
+// One CSV line per script goes to stdout; load and timing stats to stderr.
+
+#include "ofMain.h"
+#include "LanderSim.h"
+#include "LanderBatch.h"
+#include "InputLog.h"
+#include "MeshCache.h"
+#include "TerrainGenerator.h"
+#include "TerrainTiles.h"
+#include "Profiler.h"
+#include "MemoryTags.h"
+#include <chrono>
+
+struct Script {
+	string name;
+	ofVec3f start;
+	float gravity = 0.2;
+	float dt = 1.0 / 60;
+	float maxTime = 300;
+	float crashSpeed = 1.0;
+	vector<ThrustKey> events;
+	Dispersion dispersion;
+	uint32_t seed = 1;
+};
+
+static bool loadScript(const string &path, Script &script) {
+	ifstream in(path.c_str());
+	if (!in) {
+		cerr << "can't open script " << path << endl;
+		return false;
+	}
+	script.name = path;
+	string line;
+	int lineNo = 0;
+	while (getline(in, line)) {
+		lineNo++;
+		istringstream words(line);
+		string cmd;
+		if (!(words >> cmd) || cmd[0] == '#') continue;
+
+		bool ok = true;
+		if (cmd == "start") ok = (bool) (words >> script.start.x >> script.start.y >> script.start.z);
+		else if (cmd == "gravity") ok = (bool) (words >> script.gravity);
+		else if (cmd == "dt") ok = (bool) (words >> script.dt) && script.dt > 0;
+		else if (cmd == "maxtime") ok = (bool) (words >> script.maxTime);
+		else if (cmd == "crash") ok = (bool) (words >> script.crashSpeed);
+		else if (cmd == "disperse") {
+			Dispersion &d = script.dispersion;
+			ok = (bool) (words >> d.position >> d.velocity >> d.thrustGain >> d.delay);
+		}
+		else if (cmd == "seed") ok = (bool) (words >> script.seed);
+		else if (cmd == "at") {
+			ThrustKey e;
+			string what;
+			ok = (bool) (words >> e.time >> what >> e.thrust.x >> e.thrust.y >> e.thrust.z) && what == "thrust";
+			if (ok) script.events.push_back(e);
+		}
+		else ok = false;
+
+		if (!ok) {
+			cerr << path << ":" << lineNo << ": can't parse \"" << line << "\"" << endl;
+			return false;
+		}
+	}
+	stable_sort(script.events.begin(), script.events.end(),
+		[](const ThrustKey &a, const ThrustKey &b) { return a.time < b.time; });
+	return true;
+}
+
+// Fly one script as a batch of dispersed landers and print the statistics.
+static void runMonteCarlo(LanderSim &sim, const Script &script, int landers, int threads) {
+	LanderBatch batch;
+	batch.gravity = script.gravity;
+	batch.crashSpeed = script.crashSpeed;
+	batch.damping = sim.ship().damping;
+	batch.mass = sim.ship().mass;
+	batch.setup(landers, script.start, script.events, script.dispersion, script.seed);
+	TouchdownStats s = batch.run(sim.octree, script.dt, script.maxTime, threads);
+
+	printf("%s,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%.0f\n",
+		script.name.c_str(), s.total, s.landed, s.crashed, s.timedOut,
+		s.meanPosition.x, s.meanPosition.z, s.sdPosition.x, s.sdPosition.z,
+		s.meanVelocity.x, s.meanVelocity.y, s.meanVelocity.z,
+		s.sdVelocity.x, s.sdVelocity.y, s.sdVelocity.z,
+		s.meanSpeed, s.maxSpeed, s.wallMs, s.landerStepsPerMs);
+}
+
+// Replay a recorded session as fast as possible, in the same order as
+// ofApp::simTick: verify, inputs, step.
+static bool runReplay(LanderSim &sim, const string &path, int checkpoint) {
+	InputReplay replay;
+	if (!replay.load(path)) return false;
+	const Checkpoint &c = replay.seek(checkpoint);
+	sim.loadState(c.state);
+
+	long diverged = -1;
+	uint32_t tick = c.tick;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	while (!replay.finished(tick)) {
+		if (!replay.verify(tick, sim.saveState()) && diverged < 0) diverged = tick;
+		InputEvent e;
+		while (replay.next(tick, e)) {
+			if (e.tag == LogGravity) sim.gravity = e.value;
+			else sim.control(e.key, e.tag == LogKeyDown);
+		}
+		sim.step(replay.header.dt);
+		if (sim.tiles) sim.tiles->update({ sim.ship().position });
+		if (++tick % 4096 == 0 && Profiler::enabled) Profiler::collect();
+	}
+	double wall = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const char *outcome = !sim.landed ? "flying" : (sim.crashed ? "crashed" : "landed");
+	ofVec3f p = sim.ship().position;
+	ofVec3f v = sim.landed ? sim.touchdownVelocity : sim.ship().velocity;
+	float simulated = (tick - c.tick) * replay.header.dt;
+	printf("%s,%s,%u,%ld,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%.1f\n",
+		path.c_str(), outcome, tick, diverged, p.x, p.y, p.z, v.x, v.y, v.z,
+		wall, wall > 0 ? simulated * 1000.0 / wall : 0.0);
+	return diverged < 0;
+}
+
+// Chrome trace JSON, or CSV for a .csv path, plus the memory report
+static void writeProfile(const string &path) {
+	if (path == "") return;
+	cerr << MemoryTags::report();
+	bool ok = ofToLower(ofFilePath::getFileExt(path)) == "csv" ? Profiler::writeCsv(path) : Profiler::writeChromeTrace(path);
+	if (!ok) cerr << "can't write " << path << endl;
+}
+
+static void printTileStats(const TerrainTiles &tiles) {
+	cerr << "tiles: " << tiles.residentCount() << " resident, " << (tiles.residentBytes >> 10) << " KB of "
+		<< (tiles.budget >> 10) << " KB, " << tiles.loads << " loads, " << tiles.evictions << " evictions" << endl;
+}
+
+int main(int argc, char **argv) {
+	int landers = 0, threads = 0, replayFrom = -1, tileBudget = 0;
+	string profilePath;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+		if (string(argv[arg]) == "-n") landers = atoi(argv[arg + 1]);
+		else if (string(argv[arg]) == "-j") threads = atoi(argv[arg + 1]);
+		else if (string(argv[arg]) == "-r") replayFrom = atoi(argv[arg + 1]);
+		else if (string(argv[arg]) == "-m") tileBudget = atoi(argv[arg + 1]);
+		else if (string(argv[arg]) == "-p") profilePath = argv[arg + 1];
+		else break;
+	}
+	if (argc - arg < 2) {
+		cerr << "usage: " << argv[0] << " [-n landers] [-j threads] [-m tile MB] [-p profile.json|.csv]\n"
+			<< "           <terrain.obj> <script> [<script> ...]\n"
+			<< "       " << argv[0] << " -r <checkpoint> <terrain.obj> <session.llog> [...]" << endl;
+		return 1;
+	}
+	typedef std::chrono::high_resolution_clock Clock;
+	Profiler::enabled = profilePath != "";
+
+	LanderSim sim;
+	TerrainTiles tiles;
+	Clock::time_point t0 = Clock::now();
+	ofMesh &mesh = sim.terrain;
+	TerrainGenerator generator;
+	if (string(argv[arg]).compare(0, 6, "tiles:") == 0) {
+		if (landers > 0) {
+			cerr << "-n needs a single terrain mesh, not tiles" << endl;
+			return 1;
+		}
+		if (tileBudget > 0) tiles.budget = (size_t) tileBudget << 20;
+		if (!tiles.open(string(argv[arg]).substr(6))) return 1;
+		sim.tiles = &tiles;
+	}
+	else if (TerrainGenerator::isSpec(argv[arg])) {
+		if (!TerrainGenerator::parseSpec(argv[arg], generator.params)) return 1;
+		generator.generate(mesh);
+	}
+	else if (!loadCachedObjMesh(argv[arg], mesh)) return 1;
+	sim.terrainMemory.setMesh(mesh);
+	Clock::time_point t1 = Clock::now();
+	if (!sim.tiles) sim.octree.create(sim.terrain, sim.octreeMaxDepth);
+	Clock::time_point t2 = Clock::now();
+	cerr << "terrain: " << sim.terrain.getNumVertices() << " vertices, load "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, octree "
+		<< std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms, depth "
+		<< sim.octree.highestDepth << endl;
+
+	if (replayFrom >= 0) {
+		cout << "log,outcome,ticks,diverged_at,x,y,z,vx,vy,vz,wall_ms,realtime_x" << endl;
+		int failures = 0;
+		for (int i = arg + 1; i < argc; i++)
+			if (!runReplay(sim, argv[i], replayFrom)) failures++;
+		if (sim.tiles) printTileStats(tiles);
+		writeProfile(profilePath);
+		return failures > 0 ? 1 : 0;
+	}
+
+	if (landers > 0)
+		cout << "script,landers,landed,crashed,timeout,mean_x,mean_z,sd_x,sd_z,"
+			"mean_vx,mean_vy,mean_vz,sd_vx,sd_vy,sd_vz,mean_speed,max_speed,wall_ms,lander_steps_per_ms" << endl;
+	else
+		cout << "script,outcome,time,x,y,z,vx,vy,vz,steps,wall_ms,realtime_x" << endl;
+	int failures = 0;
+	for (int i = arg + 1; i < argc; i++) {
+		Script script;
+		if (!loadScript(argv[i], script)) {
+			failures++;
+			continue;
+		}
+		if (landers > 0) {
+			runMonteCarlo(sim, script, landers, threads);
+			continue;
+		}
+
+		sim.gravity = script.gravity;
+		sim.crashSpeed = script.crashSpeed;
+		sim.reset(script.start);
+
+		int next = 0;
+		long steps = 0;
+		Clock::time_point start = Clock::now();
+		while (!sim.landed && sim.time < script.maxTime) {
+			while (next < script.events.size() && script.events[next].time <= sim.time)
+				sim.thruster.set(script.events[next++].thrust);
+			sim.step(script.dt);
+			if (sim.tiles) tiles.update({ sim.ship().position });
+			if (++steps % 4096 == 0 && Profiler::enabled) Profiler::collect();
+		}
+		double wall = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		const char *outcome = !sim.landed ? "timeout" : (sim.crashed ? "crashed" : "landed");
+		ofVec3f p = sim.ship().position;
+		ofVec3f v = sim.landed ? sim.touchdownVelocity : sim.ship().velocity;
+		printf("%s,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%ld,%.3f,%.1f\n",
+			script.name.c_str(), outcome, sim.time, p.x, p.y, p.z, v.x, v.y, v.z,
+			steps, wall, wall > 0 ? sim.time * 1000.0 / wall : 0.0);
+		if (sim.tiles) printTileStats(tiles);
+	}
+	writeProfile(profilePath);
+	return failures > 0 ? 1 : 0;
+}
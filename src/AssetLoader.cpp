@@ -0,0 +1,186 @@
+
+#include "AssetLoader.h"
+#include "Profiler.h"
+
+AssetLoader::AssetLoader() {
+	remaining = 0;
+	quit = false;
+	startTime = endTime = 0;
+}
+
+AssetLoader::~AssetLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread &t : workers) t.join();
+}
+
+int AssetLoader::add(const string &name, Job work, Job upload, const vector<int> &after, float weight) {
+	Stage s;
+	s.name = name;
+	s.work = work;
+	s.upload = upload;
+	s.waitingOn = 0;
+	s.weight = weight;
+	s.state = StageWaiting;
+	s.workMs = s.uploadMs = 0;
+	int id = stages.size();
+	for (int a : after) {
+		if (a < 0 || a >= id) continue;
+		stages[a].dependents.push_back(id);
+		s.waitingOn++;
+	}
+	stages.push_back(s);
+	remaining++;
+	return id;
+}
+
+void AssetLoader::start(int threads) {
+	if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+	startTime = ofGetElapsedTimeMillis();
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int s = 0; s < stages.size(); s++) {
+		if (stages[s].waitingOn > 0) continue;
+		if (stages[s].work) {
+			stages[s].state = StageReady;
+			ready.push_back(s);
+		}
+		else {
+			stages[s].state = StageUploadDue;
+			uploads.push_back(s);
+		}
+	}
+	for (int t = 0; t < threads; t++) workers.push_back(std::thread(&AssetLoader::workerLoop, this));
+}
+
+// Heaviest ready stage first: the long poles start as early as possible.
+void AssetLoader::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [&]() { return quit || !ready.empty(); });
+		if (quit) return;
+		int best = 0;
+		for (int r = 1; r < ready.size(); r++)
+			if (stages[ready[r]].weight > stages[ready[best]].weight) best = r;
+		int s = ready[best];
+		ready.erase(ready.begin() + best);
+		stages[s].state = StageWorking;
+
+		lock.unlock();
+		uint64_t t0 = ofGetElapsedTimeMicros();
+		bool ok;
+		{
+			PROFILE_SCOPE(stages[s].name.c_str());
+			ok = stages[s].work();
+		}
+		double ms = (ofGetElapsedTimeMicros() - t0) / 1000.0;
+		lock.lock();
+
+		stages[s].workMs = ms;
+		if (!ok) fail(s);
+		else if (stages[s].upload) {
+			stages[s].state = StageUploadDue;
+			uploads.push_back(s);
+		}
+		else release(s);
+	}
+}
+
+void AssetLoader::release(int s) {
+	stages[s].state = StageDone;
+	remaining--;
+	for (int d : stages[s].dependents) {
+		if (--stages[d].waitingOn > 0 || stages[d].state != StageWaiting) continue;
+		if (stages[d].work) {
+			stages[d].state = StageReady;
+			ready.push_back(d);
+		}
+		else {
+			stages[d].state = StageUploadDue;
+			uploads.push_back(d);
+		}
+	}
+	if (remaining == 0) endTime = ofGetElapsedTimeMillis();
+	wake.notify_all();
+}
+
+// skip everything that depends on s
+void AssetLoader::fail(int s) {
+	stages[s].state = StageFailed;
+	remaining--;
+	ofLogError("AssetLoader") << stages[s].name << " failed";
+	for (int d : stages[s].dependents)
+		if (stages[d].state == StageWaiting) fail(d);
+	if (remaining == 0) endTime = ofGetElapsedTimeMillis();
+}
+
+bool AssetLoader::update(float budgetMs) {
+	uint64_t t0 = ofGetElapsedTimeMicros();
+	while (true) {
+		int s;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (uploads.empty()) break;
+			s = uploads.front();
+			uploads.erase(uploads.begin());
+		}
+		uint64_t u0 = ofGetElapsedTimeMicros();
+		bool ok = stages[s].upload ? stages[s].upload() : true;
+		uint64_t u1 = ofGetElapsedTimeMicros();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stages[s].uploadMs = (u1 - u0) / 1000.0;
+		if (ok) release(s);
+		else fail(s);
+		if ((u1 - t0) / 1000.0 >= budgetMs) break;
+	}
+	return finished();
+}
+
+bool AssetLoader::finished() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return remaining == 0;
+}
+
+bool AssetLoader::failed() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const Stage &s : stages)
+		if (s.state == StageFailed) return true;
+	return false;
+}
+
+float AssetLoader::progress() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	float total = 0, done = 0;
+	for (const Stage &s : stages) {
+		total += s.weight;
+		if (s.state == StageDone || s.state == StageFailed) done += s.weight;
+		else if (s.state == StageUploadDue) done += s.weight * 0.9;
+	}
+	return total > 0 ? done / total : 1;
+}
+
+string AssetLoader::status() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	string working;
+	for (const Stage &s : stages) {
+		if (s.state == StageFailed) return s.name + " failed";
+		if (s.state == StageWorking || s.state == StageUploadDue)
+			working += (working == "" ? "" : ", ") + s.name;
+	}
+	return working;
+}
+
+string AssetLoader::report() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	ostringstream out;
+	out << "loaded in " << (endTime >= startTime ? endTime - startTime : 0) << " ms:";
+	for (const Stage &s : stages)
+		out << " " << s.name << " " << (int) s.workMs << "+" << (int) s.uploadMs << " ms"
+			<< (s.state == StageFailed ? " (failed)" : "") << ",";
+	string r = out.str();
+	r.pop_back();
+	return r;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "ofMain.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//  Staged startup: a small graph of loading stages run on worker threads.
+//
+//  Each stage has an optional "work" part (file I/O, decoding, parsing,
+//  index builds: anything without GL) that runs on a worker, and an optional
+//  "upload" part that runs on the main thread from update(), for GL calls.
+//  A stage starts once every stage it is added after has finished both parts,
+//  so independent assets load in parallel and startup takes about as long as
+//  the slowest chain of stages.  Workers pick the heaviest ready stage first.
+//
+//  A stage fails if either part returns false; stages after it are skipped.
+//
+
+typedef enum { StageWaiting, StageReady, StageWorking, StageUploadDue, StageDone, StageFailed } StageState;
+
+class AssetLoader {
+public:
+	typedef std::function<bool()> Job;
+
+	AssetLoader();
+	~AssetLoader();
+
+	// returns the stage id to pass in "after" of later stages.  "weight" is
+	// the stage's rough share of the loading time, for the progress bar.
+	int add(const string &name, Job work, Job upload = nullptr, const vector<int> &after = {}, float weight = 1);
+
+	void start(int threads = 0);    // 0: one per core
+
+	// main thread, once a frame: run due uploads for up to budgetMs (at
+	// least one).  Returns true once everything is loaded.
+	bool update(float budgetMs = 8);
+
+	bool finished() const;          // all stages done or skipped
+	bool failed() const;
+	float progress() const;         // 0..1 by weight
+	string status() const;          // stages in progress, or the failed one
+	string report() const;          // per stage timing, once finished
+
+private:
+	struct Stage {
+		string name;
+		Job work, upload;
+		vector<int> dependents;
+		int waitingOn;
+		float weight;
+		StageState state;
+		double workMs, uploadMs;
+	};
+
+	void workerLoop();
+	void release(int s);            // stage s is done, with the mutex held
+	void fail(int s);
+
+	vector<Stage> stages;
+	vector<int> ready;              // for the workers
+	vector<int> uploads;            // for the main thread, in completion order
+	int remaining;
+	bool quit;
+	uint64_t startTime, endTime;
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	vector<std::thread> workers;
+};
@@ -0,0 +1,416 @@
+
+#include "CompactParticles.h"
+#include "Profiler.h"
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HALF_SSE 1
+#endif
+
+// float <-> half with the bit tricks from F. Giesen, "float->half
+// variants" and "half_to_float".  The special cases are selects rather
+// than branches so the batch forms can do four at a time with SSE2 when
+// F16C is not available.
+static inline uint32_t floatBits(float f) {
+	uint32_t u;
+	memcpy(&u, &f, 4);
+	return u;
+}
+
+static inline float bitsFloat(uint32_t u) {
+	float f;
+	memcpy(&f, &u, 4);
+	return f;
+}
+
+uint16_t halfFromFloat(float value) {
+	const uint32_t infinity = 255u << 23;
+	const uint32_t halfMax = (127u + 16) << 23;           // 65536, rounds to infinity
+	const uint32_t denormMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+	uint32_t f = floatBits(value);
+	uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+
+	// normal: rebias the exponent, round half up, then to even
+	uint32_t normal = (f + ((uint32_t) (15 - 127) << 23) + 0xfff + ((f >> 13) & 1)) >> 13;
+	// subnormal: the FPU rounds when a magic number is added
+	uint32_t subnormal = floatBits(bitsFloat(f) + bitsFloat(denormMagic)) - denormMagic;
+	uint32_t h = f < (113u << 23) ? subnormal : normal;
+	h = f >= halfMax ? (f > infinity ? 0x7e00 : 0x7c00) : h;   // NaN stays NaN
+	return h | (sign >> 16);
+}
+
+float floatFromHalf(uint16_t h) {
+	const uint32_t exponentMask = 0x7c00u << 13;
+	const uint32_t rebias = (127u - 15) << 23;
+	uint32_t f = (h & 0x7fff) << 13;
+	uint32_t exponent = f & exponentMask;
+	uint32_t normal = f + rebias;
+	uint32_t special = normal + ((128u - 16) << 23);     // infinity, NaN
+	// subnormal: renormalize through the FPU
+	uint32_t subnormal = floatBits(bitsFloat(normal + (1 << 23)) - bitsFloat(113u << 23));
+	f = exponent == exponentMask ? special : (exponent == 0 ? subnormal : normal);
+	return bitsFloat(f | (uint32_t) (h & 0x8000) << 16);
+}
+
+#ifdef HALF_SSE
+static inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// halfFromFloat() four at a time
+static inline void halfFromFloat4(const float *in, uint16_t *out) {
+	__m128i f = _mm_castps_si128(_mm_loadu_ps(in));
+	__m128i sign = _mm_and_si128(f, _mm_set1_epi32(0x80000000u));
+	f = _mm_xor_si128(f, sign);
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(f, 13), _mm_set1_epi32(1));
+	__m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(f, _mm_set1_epi32(0xc8000fff)), odd), 13);
+	__m128 magic = _mm_castsi128_ps(_mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23));
+	__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(f), magic)), _mm_castps_si128(magic));
+	// f has no sign bit, so signed compares do
+	__m128i h = select(_mm_cmplt_epi32(f, _mm_set1_epi32(113 << 23)), subnormal, normal);
+	__m128i special = select(_mm_cmpgt_epi32(f, _mm_set1_epi32(255 << 23)), _mm_set1_epi32(0x7e00), _mm_set1_epi32(0x7c00));
+	h = select(_mm_cmpgt_epi32(f, _mm_set1_epi32(((127 + 16) << 23) - 1)), special, h);
+	h = _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+	// sign extend so the saturating pack keeps all 16 bits
+	h = _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+	_mm_storel_epi64((__m128i *) out, _mm_packs_epi32(h, h));
+}
+
+// floatFromHalf() four at a time
+static inline void floatFromHalf4(const uint16_t *in, float *out) {
+	__m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) in), _mm_setzero_si128());
+	__m128i exponentMask = _mm_set1_epi32(0x7c00 << 13);
+	__m128i f = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+	__m128i exponent = _mm_and_si128(f, exponentMask);
+	__m128i normal = _mm_add_epi32(f, _mm_set1_epi32((127 - 15) << 23));
+	__m128i special = _mm_add_epi32(normal, _mm_set1_epi32((128 - 16) << 23));
+	__m128 renormalized = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(normal, _mm_set1_epi32(1 << 23))),
+		_mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+	f = select(_mm_cmpeq_epi32(exponent, _mm_setzero_si128()), _mm_castps_si128(renormalized), normal);
+	f = select(_mm_cmpeq_epi32(exponent, exponentMask), special, f);
+	f = _mm_or_si128(f, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+	_mm_storeu_ps(out, _mm_castsi128_ps(f));
+}
+#endif
+
+void halfFromFloat(const float *in, uint16_t *out, int n) {
+	int i = 0;
+#ifdef __F16C__
+	for (; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *) (out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+#ifdef HALF_SSE
+	for (; i + 4 <= n; i += 4) halfFromFloat4(in + i, out + i);
+#endif
+	for (; i < n; i++) out[i] = halfFromFloat(in[i]);
+}
+
+void floatFromHalf(const uint16_t *in, float *out, int n) {
+	int i = 0;
+#ifdef __F16C__
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (in + i))));
+#endif
+#ifdef HALF_SSE
+	for (; i + 4 <= n; i += 4) floatFromHalf4(in + i, out + i);
+#endif
+	for (; i < n; i++) out[i] = floatFromHalf(in[i]);
+}
+
+//--------------------------------------------------------------
+
+// particles are decoded this many at a time, into floats on the stack
+static const int block = 256;
+
+struct CompactParticleSystem::Block {
+	float x[block], y[block], z[block];         // world position
+	float vx[block], vy[block], vz[block];
+	float ax[block], ay[block], az[block];      // from the forces
+	float birth[block];
+};
+
+CompactParticleSystem::CompactParticleSystem() {
+	Particle defaults;
+	params.mass = defaults.mass;
+	params.damping = defaults.damping;
+	params.radius = defaults.radius;
+	params.lifespan = defaults.lifespan;
+	integrator = EulerIntegrator;
+	origin.set(0, 0, 0);
+	nextOrigin = origin;
+}
+
+Particle CompactParticleSystem::prototype() const {
+	Particle p;
+	p.mass = params.mass;
+	p.damping = params.damping;
+	p.radius = params.radius;
+	p.lifespan = params.lifespan;
+	return p;
+}
+
+void CompactParticleSystem::absorb(ParticleSystem &from) {
+	forces = from.forces;
+	integrator = from.integrator;
+	stage.setTerrain(from.terrain);
+	stage.setCollisionResponse(from.collision, from.restitution, from.friction);
+
+	// new particles are stored relative to the current origin, like the rest
+	Block b;
+	const ParticleList &particles = from.particles;
+	for (int first = 0; first < particles.size(); first += block) {
+		int m = min(block, (int) particles.size() - first);
+		for (int j = 0; j < m; j++) {
+			const Particle &p = particles[first + j];
+			b.x[j] = p.position.x;
+			b.y[j] = p.position.y;
+			b.z[j] = p.position.z;
+			b.vx[j] = p.velocity.x;
+			b.vy[j] = p.velocity.y;
+			b.vz[j] = p.velocity.z;
+			b.birth[j] = p.birthtime;
+		}
+		ofVec3f target = nextOrigin;
+		nextOrigin = origin;
+		encodeBlock(b, m, size());
+		nextOrigin = target;
+	}
+	from.particles.clear();
+	from.grid.clear();
+}
+
+void CompactParticleSystem::add(const Particle &p) {
+	ofVec3f x = p.position - origin;
+	px.push_back(halfFromFloat(x.x));
+	py.push_back(halfFromFloat(x.y));
+	pz.push_back(halfFromFloat(x.z));
+	vx.push_back(halfFromFloat(p.velocity.x));
+	vy.push_back(halfFromFloat(p.velocity.y));
+	vz.push_back(halfFromFloat(p.velocity.z));
+	birth.push_back(p.birthtime);
+}
+
+void CompactParticleSystem::clear() {
+	px.clear();
+	py.clear();
+	pz.clear();
+	vx.clear();
+	vy.clear();
+	vz.clear();
+	birth.clear();
+}
+
+// advance one frame at the current frame rate
+void CompactParticleSystem::update() {
+	float framerate = ofGetFrameRate();
+	if (framerate < 1.0) return;
+	update(1.0 / framerate);
+}
+
+// One pass over the store: decode a block, drop the expired particles,
+// apply the forces, integrate, collide and encode the survivors.  A block
+// never has more survivors than particles read so far, so they are written
+// back in place.  Same steps as ParticleSystem::update().
+void CompactParticleSystem::update(float dt) {
+	PROFILE_SCOPE("compact particle update");
+	int n = size();
+	if (n == 0) {
+		origin = nextOrigin;
+		return;
+	}
+
+	active.clear();
+	for (ParticleForce *f : forces)
+		if (!f->applied) active.push_back(f);
+
+	float now = ofGetElapsedTimeMillis();
+	float lifespan = params.lifespan;
+	float damping = Particle::dampingFactor(params.damping, dt);
+	float invMass = 1.0 / params.mass;
+	bool collide = stage.terrain != NULL && stage.collision != NoCollision;
+	Particle probe = prototype();
+
+	Block b;
+	int kept = 0;
+	for (int first = 0; first < n; first += block) {
+		int m = min(block, n - first);
+		decodeBlock(first, m, b);
+
+		int live = m;
+		if (lifespan != -1) {
+			live = 0;
+			for (int j = 0; j < m; j++) {
+				if ((now - b.birth[j]) / 1000.0 > lifespan) continue;
+				if (j != live) {
+					b.x[live] = b.x[j];
+					b.y[live] = b.y[j];
+					b.z[live] = b.z[j];
+					b.vx[live] = b.vx[j];
+					b.vy[live] = b.vy[j];
+					b.vz[live] = b.vz[j];
+					b.birth[live] = b.birth[j];
+				}
+				live++;
+			}
+		}
+
+		// forces see a full Particle, one probe reused for the block
+		if (active.empty()) {
+			memset(b.ax, 0, sizeof(b.ax));
+			memset(b.ay, 0, sizeof(b.ay));
+			memset(b.az, 0, sizeof(b.az));
+		}
+		else for (int j = 0; j < live; j++) {
+			probe.position.set(b.x[j], b.y[j], b.z[j]);
+			probe.velocity.set(b.vx[j], b.vy[j], b.vz[j]);
+			probe.forces.set(0, 0, 0);
+			for (ParticleForce *f : active) f->updateForce(&probe);
+			b.ax[j] = probe.forces.x * invMass;
+			b.ay[j] = probe.forces.y * invMass;
+			b.az[j] = probe.forces.z * invMass;
+		}
+
+		if (integrator == EulerIntegrator) {
+			for (int j = 0; j < live; j++) {
+				b.x[j] += b.vx[j] * dt;
+				b.y[j] += b.vy[j] * dt;
+				b.z[j] += b.vz[j] * dt;
+				b.vx[j] = (b.vx[j] + b.ax[j] * dt) * damping;
+				b.vy[j] = (b.vy[j] + b.ay[j] * dt) * damping;
+				b.vz[j] = (b.vz[j] + b.az[j] * dt) * damping;
+			}
+		}
+		else {
+			for (int j = 0; j < live; j++) {
+				b.vx[j] += b.ax[j] * dt;
+				b.vy[j] += b.ay[j] * dt;
+				b.vz[j] += b.az[j] * dt;
+				b.x[j] += b.vx[j] * dt;
+				b.y[j] += b.vy[j] * dt;
+				b.z[j] += b.vz[j] * dt;
+				b.vx[j] *= damping;
+				b.vy[j] *= damping;
+				b.vz[j] *= damping;
+			}
+		}
+
+		if (collide && live > 0) {
+			ParticleList &particles = stage.particles;
+			particles.resize(live, probe);
+			for (int j = 0; j < live; j++) {
+				particles[j].position.set(b.x[j], b.y[j], b.z[j]);
+				particles[j].velocity.set(b.vx[j], b.vy[j], b.vz[j]);
+				particles[j].birthtime = b.birth[j];
+			}
+			stage.collideTerrain();
+			live = particles.size();     // KillCollision removes some
+			for (int j = 0; j < live; j++) {
+				b.x[j] = particles[j].position.x;
+				b.y[j] = particles[j].position.y;
+				b.z[j] = particles[j].position.z;
+				b.vx[j] = particles[j].velocity.x;
+				b.vy[j] = particles[j].velocity.y;
+				b.vz[j] = particles[j].velocity.z;
+				b.birth[j] = particles[j].birthtime;
+			}
+		}
+
+		encodeBlock(b, live, kept);
+		kept += live;
+	}
+
+	px.resize(kept);
+	py.resize(kept);
+	pz.resize(kept);
+	vx.resize(kept);
+	vy.resize(kept);
+	vz.resize(kept);
+	birth.resize(kept);
+	origin = nextOrigin;
+
+	for (ParticleForce *f : forces)
+		if (f->applyOnce) f->applied = true;
+}
+
+// particles first .. first + n - 1 into b, in world coordinates
+void CompactParticleSystem::decodeBlock(int first, int n, Block &b) const {
+	floatFromHalf(&px[first], b.x, n);
+	floatFromHalf(&py[first], b.y, n);
+	floatFromHalf(&pz[first], b.z, n);
+	floatFromHalf(&vx[first], b.vx, n);
+	floatFromHalf(&vy[first], b.vy, n);
+	floatFromHalf(&vz[first], b.vz, n);
+	for (int j = 0; j < n; j++) {
+		b.x[j] += origin.x;
+		b.y[j] += origin.y;
+		b.z[j] += origin.z;
+		b.birth[j] = birth[first + j];
+	}
+}
+
+// the first n particles of b to at .. at + n - 1, relative to the next
+// origin; the store grows if they go past the end
+void CompactParticleSystem::encodeBlock(const Block &b, int n, int at) {
+	if (at + n > size()) {
+		px.resize(at + n);
+		py.resize(at + n);
+		pz.resize(at + n);
+		vx.resize(at + n);
+		vy.resize(at + n);
+		vz.resize(at + n);
+		birth.resize(at + n);
+	}
+	float rel[block];
+	for (int j = 0; j < n; j++) rel[j] = b.x[j] - nextOrigin.x;
+	halfFromFloat(rel, &px[at], n);
+	for (int j = 0; j < n; j++) rel[j] = b.y[j] - nextOrigin.y;
+	halfFromFloat(rel, &py[at], n);
+	for (int j = 0; j < n; j++) rel[j] = b.z[j] - nextOrigin.z;
+	halfFromFloat(rel, &pz[at], n);
+	halfFromFloat(b.vx, &vx[at], n);
+	halfFromFloat(b.vy, &vy[at], n);
+	halfFromFloat(b.vz, &vz[at], n);
+	for (int j = 0; j < n; j++) birth[at + j] = b.birth[j];
+}
+
+void CompactParticleSystem::decode(int i, Particle &p) const {
+	p = prototype();
+	p.position.set(floatFromHalf(px[i]) + origin.x, floatFromHalf(py[i]) + origin.y, floatFromHalf(pz[i]) + origin.z);
+	p.velocity.set(floatFromHalf(vx[i]), floatFromHalf(vy[i]), floatFromHalf(vz[i]));
+	p.birthtime = birth[i];
+}
+
+void CompactParticleSystem::decodeAll(ParticleList &out) const {
+	Particle proto = prototype();
+	Block b;
+	for (int first = 0; first < size(); first += block) {
+		int m = min(block, size() - first);
+		decodeBlock(first, m, b);
+		for (int j = 0; j < m; j++) {
+			out.push_back(proto);
+			out.back().position.set(b.x[j], b.y[j], b.z[j]);
+			out.back().velocity.set(b.vx[j], b.vy[j], b.vz[j]);
+			out.back().birthtime = b.birth[j];
+		}
+	}
+}
+
+void CompactParticleSystem::pack(ParticleVertex *out, int count) const {
+	float x[block], y[block], z[block];
+	for (int first = 0; first < count; first += block) {
+		int m = min(block, count - first);
+		floatFromHalf(&px[first], x, m);
+		floatFromHalf(&py[first], y, m);
+		floatFromHalf(&pz[first], z, m);
+		ParticleVertex *v = out + first;
+		for (int j = 0; j < m; j++) {
+			v[j].position[0] = x[j] + origin.x;
+			v[j].position[1] = y[j] + origin.y;
+			v[j].position[2] = z[j] + origin.z;
+			v[j].birth = birth[first + j] / 1000.0;
+		}
+	}
+}
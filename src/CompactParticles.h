@@ -0,0 +1,96 @@
+#pragma once
+#include "ofMain.h"
+#include "ParticleSystem.h"
+#include "ParticleStream.h"
+
+//  Compressed particle store for large particle clouds.
+//
+//  A Particle is 80 bytes, most of which never changes after spawn, and the
+//  update makes several passes over all of them, so with a lot of particles
+//  it is limited by memory bandwidth rather than arithmetic.  Here the
+//  attributes every particle of an emitter shares (mass, damping, radius,
+//  lifespan) are kept once, in params, and each particle is 16 bytes:
+//  position relative to "origin" and velocity as half floats, and birth time.
+//
+//  update() decodes a block of particles at a time into floats on the
+//  stack, applies the forces, integrates and packs the survivors back, so
+//  the store is read and written once per step.  Sharing the parameters
+//  also means the damping factor and the lifespan test are worked out once
+//  per step instead of once per particle.  Terrain collision is the
+//  ParticleSystem stage, run on each block.
+//
+//  Half floats have 11 significant bits.  Positions are relative to the
+//  origin to keep that precision near the emitter (2^-11 of the distance
+//  from it); see bench/ParticleFormatBench.cpp for the error this gives
+//  against the full layout.  Not kept per particle: random lifespans (all
+//  take params.lifespan), the acceleration field, and the state Verlet and
+//  RK4 carry between stages; both integrate as semi-implicit Euler here.
+//
+
+// attributes shared by all particles in a compact store
+struct ParticleParams {
+	float mass;
+	float damping;
+	float radius;
+	float lifespan;     // sec, -1 lives forever
+};
+
+// IEEE half float conversion, round to nearest even.  The batch forms use
+// F16C when the compiler targets it, SSE2 otherwise.
+uint16_t halfFromFloat(float f);
+float floatFromHalf(uint16_t h);
+void halfFromFloat(const float *in, uint16_t *out, int n);
+void floatFromHalf(const uint16_t *in, float *out, int n);
+
+typedef TaggedVector<uint16_t, MemParticles> HalfList;
+
+class CompactParticleSystem {
+public:
+	CompactParticleSystem();
+
+	// takes the particles out of "from", leaving it empty, and adopts its
+	// forces, integrator and terrain collision settings
+	void absorb(ParticleSystem &from);
+	void add(const Particle &);
+	void addForce(ParticleForce *f) { forces.push_back(f); }
+	void setIntegrator(IntegratorType t) { integrator = t; }
+	void setTerrain(const Octree *t) { stage.setTerrain(t); }
+	void setCollisionResponse(CollisionResponse r, float e = 0.3, float f = 0.2) {
+		stage.setCollisionResponse(r, e, f);
+	}
+	void update();
+	void update(float dt);
+	void clear();
+
+	int size() const { return birth.size(); }
+	size_t bytesPerParticle() const { return 6 * sizeof(uint16_t) + sizeof(float); }
+
+	// expand particle i, or append all of them to "out"
+	void decode(int i, Particle &p) const;
+	void decodeAll(ParticleList &out) const;
+	// fill "out" with the first "count" particles for the particle stream
+	void pack(ParticleVertex *out, int count) const;
+
+	// stored positions are relative to the origin; a new one takes effect
+	// as the particles are repacked by the next update()
+	void setOrigin(const ofVec3f &o) { nextOrigin = o; }
+	ofVec3f getOrigin() const { return origin; }
+
+	ParticleParams params;
+	vector<ParticleForce *> forces;
+	IntegratorType integrator;
+
+private:
+	struct Block;
+	Particle prototype() const;
+	void decodeBlock(int first, int n, Block &b) const;
+	void encodeBlock(const Block &b, int n, int at);
+
+	ofVec3f origin, nextOrigin;
+	HalfList px, py, pz, vx, vy, vz;
+	TaggedVector<float, MemParticles> birth;    // ms, as Particle::birthtime
+
+	// holds the terrain settings and runs the collision stage on a block
+	ParticleSystem stage;
+	vector<ParticleForce *> active;             // forces not yet applied
+};
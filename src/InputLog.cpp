@@ -0,0 +1,253 @@
+
+#include "InputLog.h"
+
+static const char logMagic[4] = { 'L', 'L', 'O', 'G' };
+static const uint8_t logVersion = 1;
+
+static void putVarint(vector<uint8_t> &buf, uint32_t v) {
+	while (v >= 0x80) {
+		buf.push_back((uint8_t) (v | 0x80));
+		v >>= 7;
+	}
+	buf.push_back((uint8_t) v);
+}
+
+static void putU32(vector<uint8_t> &buf, uint32_t v) {
+	for (int i = 0; i < 4; i++) buf.push_back((uint8_t) (v >> (8 * i)));
+}
+
+static void putFloat(vector<uint8_t> &buf, float f) {
+	uint32_t v;
+	memcpy(&v, &f, 4);
+	putU32(buf, v);
+}
+
+static void putVec(vector<uint8_t> &buf, const ofVec3f &p) {
+	putFloat(buf, p.x);
+	putFloat(buf, p.y);
+	putFloat(buf, p.z);
+}
+
+// bounds-checked reader over the whole file
+struct LogReader {
+	const uint8_t *p, *end;
+	bool ok;
+
+	uint8_t u8() {
+		if (p >= end) { ok = false; return 0; }
+		return *p++;
+	}
+	uint32_t varint() {
+		uint32_t v = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			uint8_t b = u8();
+			v |= (uint32_t) (b & 0x7f) << shift;
+			if (!(b & 0x80)) return v;
+		}
+		ok = false;
+		return 0;
+	}
+	uint32_t u32() {
+		uint32_t v = 0;
+		for (int i = 0; i < 4; i++) v |= (uint32_t) u8() << (8 * i);
+		return v;
+	}
+	float f32() {
+		uint32_t v = u32();
+		float f;
+		memcpy(&f, &v, 4);
+		return f;
+	}
+	ofVec3f vec() {
+		float x = f32(), y = f32();
+		return ofVec3f(x, y, f32());
+	}
+};
+
+//--------------------------------------------------------------
+InputRecorder::InputRecorder() {
+	recording = false;
+	checkpointInterval = 300;     // 5 sec at 60 ticks/sec
+	file = NULL;
+	lastTick = 0;
+	lastCheckpoint = 0;
+}
+
+bool InputRecorder::begin(const string &p, const SessionHeader &h) {
+	end(lastTick);
+	path = p;
+	file = fopen(ofToDataPath(path).c_str(), "wb");
+	if (file == NULL) {
+		ofLogError("InputRecorder") << "can't write " << path;
+		return false;
+	}
+	buf.clear();
+	for (int i = 0; i < 4; i++) buf.push_back(logMagic[i]);
+	buf.push_back(logVersion);
+	putFloat(buf, h.dt);
+	putVec(buf, h.start);
+	putU32(buf, h.seed);
+	recording = true;
+	lastTick = 0;
+	lastCheckpoint = 0;
+	return true;
+}
+
+void InputRecorder::record(uint8_t tag, uint32_t tick) {
+	buf.push_back(tag);
+	putVarint(buf, tick - lastTick);
+	lastTick = tick;
+}
+
+void InputRecorder::key(uint32_t tick, int key, bool pressed) {
+	if (!recording) return;
+	record(pressed ? LogKeyDown : LogKeyUp, tick);
+	putVarint(buf, (uint32_t) key);
+}
+
+void InputRecorder::gravity(uint32_t tick, float g) {
+	if (!recording) return;
+	record(LogGravity, tick);
+	putFloat(buf, g);
+}
+
+void InputRecorder::checkpoint(uint32_t tick, const LanderState &s, uint32_t seed) {
+	if (!recording) return;
+	record(LogCheckpoint, tick);
+	putVec(buf, s.position);
+	putVec(buf, s.velocity);
+	putVec(buf, s.forces);
+	putVec(buf, s.thrust);
+	putVec(buf, s.touchdownPoint);
+	putVec(buf, s.touchdownVelocity);
+	putFloat(buf, s.time);
+	putFloat(buf, s.gravity);
+	buf.push_back((s.landed ? 1 : 0) | (s.crashed ? 2 : 0));
+	putU32(buf, seed);
+	lastCheckpoint = tick;
+
+	// checkpoints are a natural point to write out, a crash loses < 1 interval
+	flush();
+}
+
+void InputRecorder::flush() {
+	if (file == NULL || buf.empty()) return;
+	fwrite(buf.data(), 1, buf.size(), file);
+	fflush(file);
+	buf.clear();
+}
+
+void InputRecorder::end(uint32_t tick) {
+	if (!recording) return;
+	record(LogEnd, max(tick, lastTick));
+	flush();
+	fclose(file);
+	file = NULL;
+	recording = false;
+}
+
+//--------------------------------------------------------------
+InputReplay::InputReplay() {
+	endTick = 0;
+	cursor = 0;
+	nextCheck = 0;
+}
+
+bool InputReplay::load(const string &path) {
+	events.clear();
+	checkpoints.clear();
+	endTick = 0;
+
+	ofBuffer file = ofBufferFromFile(path, true);
+	const uint8_t *data = (const uint8_t *) file.getData();
+	LogReader in = { data, data + file.size(), true };
+
+	char magic[4];
+	for (int i = 0; i < 4; i++) magic[i] = in.u8();
+	uint8_t version = in.u8();
+	if (!in.ok || memcmp(magic, logMagic, 4) != 0 || version != logVersion) {
+		ofLogError("InputReplay") << path << " is not a session log";
+		return false;
+	}
+	header.dt = in.f32();
+	header.start = in.vec();
+	header.seed = in.u32();
+
+	uint32_t tick = 0;
+	bool ended = false;
+	while (in.ok && in.p < in.end && !ended) {
+		uint8_t tag = in.u8();
+		tick += in.varint();
+		// each record is parsed whole and kept only if none of it ran past
+		// the end of the file
+		if (tag == LogKeyDown || tag == LogKeyUp) {
+			InputEvent e = { tick, tag, (int) in.varint(), 0 };
+			if (in.ok) events.push_back(e);
+		}
+		else if (tag == LogGravity) {
+			InputEvent e = { tick, tag, 0, in.f32() };
+			if (in.ok) events.push_back(e);
+		}
+		else if (tag == LogCheckpoint) {
+			Checkpoint c;
+			c.tick = tick;
+			c.state.position = in.vec();
+			c.state.velocity = in.vec();
+			c.state.forces = in.vec();
+			c.state.thrust = in.vec();
+			c.state.touchdownPoint = in.vec();
+			c.state.touchdownVelocity = in.vec();
+			c.state.time = in.f32();
+			c.state.gravity = in.f32();
+			uint8_t flags = in.u8();
+			c.state.landed = (flags & 1) != 0;
+			c.state.crashed = (flags & 2) != 0;
+			c.seed = in.u32();
+			c.event = events.size();
+			if (in.ok) checkpoints.push_back(c);
+		}
+		else if (tag == LogEnd) ended = in.ok;
+		else in.ok = false;
+		if (in.ok) endTick = tick;
+	}
+
+	// a log cut short by a crash still replays up to its last good record
+	if (!in.ok || !ended)
+		ofLogWarning("InputReplay") << path << " is truncated, replaying to tick " << endTick;
+	if (checkpoints.empty()) {
+		ofLogError("InputReplay") << path << " has no checkpoint to start from";
+		return false;
+	}
+	seek(0);
+	return true;
+}
+
+const Checkpoint &InputReplay::seek(int i) {
+	i = ofClamp(i, 0, (int) checkpoints.size() - 1);
+	cursor = checkpoints[i].event;
+	nextCheck = i + 1;
+	return checkpoints[i];
+}
+
+int InputReplay::checkpointBefore(uint32_t tick) const {
+	int i = 0;
+	while (i + 1 < checkpoints.size() && checkpoints[i + 1].tick <= tick) i++;
+	return i;
+}
+
+bool InputReplay::next(uint32_t tick, InputEvent &e) {
+	if (cursor >= events.size() || events[cursor].tick > tick) return false;
+	e = events[cursor++];
+	return true;
+}
+
+bool InputReplay::verify(uint32_t tick, const LanderState &live) {
+	while (nextCheck < checkpoints.size() && checkpoints[nextCheck].tick < tick) nextCheck++;
+	if (nextCheck >= checkpoints.size() || checkpoints[nextCheck].tick != tick) return true;
+	const LanderState &s = checkpoints[nextCheck++].state;
+
+	// the replay runs the same float operations in the same order, so the
+	// state must match bit for bit
+	return s.position == live.position && s.velocity == live.velocity &&
+		s.thrust == live.thrust && s.time == live.time && s.landed == live.landed;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "ofMain.h"
+#include "LanderSim.h"
+
+//  Session recording for deterministic replay.  The simulation runs in
+//  fixed ticks; a log holds the control inputs by tick plus periodic
+//  checkpoints of the full lander state, so a replay can start (or seek)
+//  at any checkpoint and check itself against the later ones.
+//
+//  File layout, little endian:
+//    "LLOG" version:u8 dt:f32 start:3*f32 seed:u32
+//    records: tag:u8 tickDelta:varint payload
+//      KeyDown/KeyUp  key:varint
+//      Gravity        g:f32
+//      Checkpoint     LanderState fields as f32, flags:u8, emitter seed:u32
+//      End            (none)
+//  tickDelta is relative to the previous record, so an input costs 3-4 bytes.
+//
+
+typedef enum { LogEnd, LogKeyDown, LogKeyUp, LogGravity, LogCheckpoint } LogTag;
+
+struct InputEvent {
+	uint32_t tick;
+	uint8_t tag;        // LogKeyDown, LogKeyUp or LogGravity
+	int key;
+	float value;        // gravity
+};
+
+struct Checkpoint {
+	uint32_t tick;
+	LanderState state;
+	uint32_t seed;      // thruster emitter random stream
+	int event;          // first event at or after tick
+};
+
+struct SessionHeader {
+	float dt;           // fixed tick length, sec
+	ofVec3f start;      // ship position when recording began
+	uint32_t seed;
+};
+
+class InputRecorder {
+public:
+	InputRecorder();
+	~InputRecorder() { end(lastTick); }
+	bool begin(const string &path, const SessionHeader &h);
+	void key(uint32_t tick, int key, bool pressed);
+	void gravity(uint32_t tick, float g);
+	void checkpoint(uint32_t tick, const LanderState &s, uint32_t seed);
+	void end(uint32_t tick);    // tick the session ran to
+	bool due(uint32_t tick) const { return recording && tick >= lastCheckpoint + checkpointInterval; }
+
+	bool recording;
+	uint32_t checkpointInterval;   // ticks
+	string path;
+
+private:
+	void record(uint8_t tag, uint32_t tick);
+	void flush();
+	vector<uint8_t> buf;
+	FILE *file;
+	uint32_t lastTick;
+	uint32_t lastCheckpoint;
+};
+
+class InputReplay {
+public:
+	InputReplay();
+	bool load(const string &path);
+
+	// restart at checkpoint "i": returns its state, events resume from there
+	const Checkpoint &seek(int i);
+	int checkpointBefore(uint32_t tick) const;
+
+	// the events due at "tick", one per call, in recorded order
+	bool next(uint32_t tick, InputEvent &e);
+	bool finished(uint32_t tick) const { return tick >= endTick; }
+
+	// compare a live state with the checkpoint recorded at "tick", if any.
+	// returns false on divergence.
+	bool verify(uint32_t tick, const LanderState &live);
+
+	SessionHeader header;
+	vector<InputEvent> events;
+	vector<Checkpoint> checkpoints;
+	uint32_t endTick;
+
+private:
+	int cursor;         // next event
+	int nextCheck;      // next checkpoint to verify against
+};
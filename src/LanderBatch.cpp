@@ -0,0 +1,245 @@
+
+#include "LanderBatch.h"
+#include "Particle.h"
+#include "LanderSim.h"
+#include "Util.h"
+#include <random>
+#include <chrono>
+#include <thread>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+// Running mean and sum of squared deviations (Welford), in double: float
+// sums of 100k+ landers lose the spread entirely.
+struct RunningStat {
+	long n = 0;
+	double mean = 0, m2 = 0;
+
+	void add(double x) {
+		n++;
+		double d = x - mean;
+		mean += d / n;
+		m2 += d * (x - mean);
+	}
+	// Chan et al.'s pairwise combination
+	void merge(const RunningStat &o) {
+		if (o.n == 0) return;
+		long total = n + o.n;
+		double d = o.mean - mean;
+		mean += d * o.n / total;
+		m2 += o.m2 + d * d * ((double) n * o.n / total);
+		n = total;
+	}
+	double sd() const { return n > 0 ? sqrt(m2 / n) : 0; }
+};
+
+// one thread's share of the touchdown statistics
+struct LanderBatch::RangeStats {
+	int landed = 0, crashed = 0, timedOut = 0;
+	double steps = 0;
+	RunningStat position[3], velocity[3], speed, time;
+	float maxSpeed = 0;
+
+	void merge(const RangeStats &o) {
+		landed += o.landed;
+		crashed += o.crashed;
+		timedOut += o.timedOut;
+		steps += o.steps;
+		for (int k = 0; k < 3; k++) {
+			position[k].merge(o.position[k]);
+			velocity[k].merge(o.velocity[k]);
+		}
+		speed.merge(o.speed);
+		time.merge(o.time);
+		maxSpeed = max(maxSpeed, o.maxSpeed);
+	}
+};
+
+LanderBatch::LanderBatch() {
+	gravity = 0.2;
+	damping = .99;
+	mass = 1;
+	crashSpeed = 1.0;
+}
+
+void LanderBatch::setup(int n, const ofVec3f &start, const vector<ThrustKey> &prof,
+	const Dispersion &d, uint32_t seed) {
+	profile = prof;
+	stable_sort(profile.begin(), profile.end(),
+		[](const ThrustKey &a, const ThrustKey &b) { return a.time < b.time; });
+
+	px.resize(n); py.resize(n); pz.resize(n);
+	vx.resize(n); vy.resize(n); vz.resize(n);
+	gain.resize(n); delay.resize(n);
+	touchdownTime.assign(n, 0);
+	status.assign(n, Flying);
+
+	mt19937 rng(seed);
+	normal_distribution<float> unit(0, 1);
+	for (int i = 0; i < n; i++) {
+		px[i] = start.x + d.position * unit(rng);
+		py[i] = start.y + d.position * unit(rng);
+		pz[i] = start.z + d.position * unit(rng);
+		vx[i] = d.velocity * unit(rng);
+		vy[i] = d.velocity * unit(rng);
+		vz[i] = d.velocity * unit(rng);
+		gain[i] = 1 + d.thrustGain * unit(rng);
+		delay[i] = fabsf(d.delay * unit(rng));
+	}
+}
+
+// Fly landers [begin, end) to touchdown or maxTime.
+void LanderBatch::runRange(const Octree &terrain, int begin, int end, float dt, float maxTime, RangeStats *stats) {
+#if defined(__SSE__) || defined(_M_X64)
+	// velocities decaying under drag alone reach denormals after a few
+	// minutes of flight, which are very slow on x86; flush them to zero
+	_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+#endif
+	int n = end - begin;
+	float *x = &px[begin], *y = &py[begin], *z = &pz[begin];
+	float *u = &vx[begin], *v = &vy[begin], *w = &vz[begin];
+	uint8_t *st = &status[begin];
+
+	// constant-force-with-drag step coefficients, shared by all landers
+	float k = Particle::dragCoefficient(damping);
+	float e = expf(-k * dt);
+	float cv = (k > 0) ? (1 - e) / k : dt;                     // v0 -> dx
+	float ca = (k > 0) ? (dt - cv) / k : 0.5f * dt * dt;       // a  -> dx
+
+	// terrain footprint quantization, to sort the queries into z-order
+	const Box &root = terrain.root;
+	float minx = root.parameters[0].x(), minz = root.parameters[0].z();
+	float low = min(root.parameters[1].y(), LanderSim::touchdownCeiling);
+	float sx = 65535.0 / max(root.parameters[1].x() - minx, 1e-6f);
+	float sz = 65535.0 / max(root.parameters[1].z() - minz, 1e-6f);
+
+	// the deepest node each lander was last found in, with nothing to hit.
+	// While it still holds the lander the search starts there, and a
+	// childless one needs no search at all.
+	vector<const Box *> last(n, NULL);
+	vector<uint32_t> keys, keyScratch;
+	vector<int> pending, pendingScratch;
+	vector<float> ax(n), ay(n), az(n);
+	vector<int> cursor(n, 0);
+
+	// time from the step count; summing dt drifts off the profile's times
+	int flying = n;
+	for (int step = 0; flying > 0 && step * dt < maxTime; step++) {
+		float t = step * dt;
+
+		// advance each lander's cursor into the shared profile; the
+		// acceleration only changes when the cursor moves
+		for (int i = 0; i < n; i++) {
+			float lt = t - delay[begin + i];
+			int c = cursor[i];
+			while (c < profile.size() && profile[c].time <= lt) c++;
+			if (c == cursor[i] && t > 0) continue;
+			cursor[i] = c;
+			ofVec3f thrust = c > 0 ? profile[c - 1].thrust : ofVec3f(0, 0, 0);
+			float g = gain[begin + i] / mass;
+			ax[i] = thrust.x * g;
+			ay[i] = thrust.y * g - gravity;
+			az[i] = thrust.z * g;
+		}
+
+		// exact step for constant acceleration with linear drag
+		for (int i = 0; i < n; i++) {
+			if (st[i] != Flying) continue;
+			x[i] += u[i] * cv + ax[i] * ca;
+			y[i] += v[i] * cv + ay[i] * ca;
+			z[i] += w[i] * cv + az[i] * ca;
+			u[i] = u[i] * e + ax[i] * cv;
+			v[i] = v[i] * e + ay[i] * cv;
+			w[i] = w[i] * e + az[i] * cv;
+		}
+
+		// landers low enough to touch down, in the tree and not still in a
+		// childless node without a vertex
+		keys.clear();
+		pending.clear();
+		for (int i = 0; i < n; i++) {
+			if (st[i] != Flying || y[i] > low) continue;
+			ofVec3f p(x[i], y[i], z[i]);
+			if (last[i] == NULL || !last[i]->contains(p)) last[i] = root.contains(p) ? &root : NULL;
+			if (last[i] == NULL || (last[i]->children.empty() && last[i]->vertexIndices.size() != 1)) continue;
+			float qx = ofClamp((x[i] - minx) * sx, 0, 65535), qz = ofClamp((z[i] - minz) * sz, 0, 65535);
+			keys.push_back(mortonKey2D((uint32_t) qx, (uint32_t) qz));
+			pending.push_back(i);
+		}
+
+		// touchdown, by LanderSim's rule
+		radixSortByKey(keys, pending, keyScratch, pendingScratch);
+		for (int k = 0; k < pending.size(); k++) {
+			int i = pending[k];
+			const Box *node = terrain.collisionNode(*last[i], ofVec3f(x[i], y[i], z[i]));
+			if (node->vertexIndices.size() != 1) {
+				last[i] = node;
+				continue;
+			}
+			float speed = sqrtf(u[i] * u[i] + v[i] * v[i] + w[i] * w[i]);
+			st[i] = (speed > crashSpeed) ? Crashed : Landed;
+			touchdownTime[begin + i] = (step + 1) * dt;
+			flying--;
+		}
+	}
+	for (int i = 0; i < n; i++)
+		if (st[i] == Flying) st[i] = TimedOut;
+	summarize(begin, end, dt, maxTime, *stats);
+}
+
+// statistics over landers [begin, end), everything that touched down
+void LanderBatch::summarize(int begin, int end, float dt, float maxTime, RangeStats &s) const {
+	for (int i = begin; i < end; i++) {
+		s.steps += (status[i] == TimedOut ? maxTime : touchdownTime[i]) / dt;
+		if (status[i] == TimedOut) {
+			s.timedOut++;
+			continue;
+		}
+		if (status[i] == Crashed) s.crashed++;
+		else s.landed++;
+		double p[3] = { px[i], py[i], pz[i] }, v[3] = { vx[i], vy[i], vz[i] };
+		for (int k = 0; k < 3; k++) {
+			s.position[k].add(p[k]);
+			s.velocity[k].add(v[k]);
+		}
+		float speed = sqrtf(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+		s.speed.add(speed);
+		s.maxSpeed = max(s.maxSpeed, speed);
+		s.time.add(touchdownTime[i]);
+	}
+}
+
+TouchdownStats LanderBatch::run(const Octree &terrain, float dt, float maxTime, int threads) {
+	int n = px.size();
+	if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+	threads = max(1, min(threads, n));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	vector<std::thread> workers;
+	vector<RangeStats> partial(threads);
+	for (int k = 0; k < threads; k++) {
+		int b = (long) n * k / threads, e = (long) n * (k + 1) / threads;
+		workers.push_back(std::thread(&LanderBatch::runRange, this, std::cref(terrain), b, e, dt, maxTime, &partial[k]));
+	}
+	for (std::thread &t : workers) t.join();
+
+	TouchdownStats s;
+	s.wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	s.total = n;
+
+	RangeStats all;
+	for (const RangeStats &r : partial) all.merge(r);
+	s.landed = all.landed;
+	s.crashed = all.crashed;
+	s.timedOut = all.timedOut;
+	s.meanPosition.set(all.position[0].mean, all.position[1].mean, all.position[2].mean);
+	s.sdPosition.set(all.position[0].sd(), all.position[1].sd(), all.position[2].sd());
+	s.meanVelocity.set(all.velocity[0].mean, all.velocity[1].mean, all.velocity[2].mean);
+	s.sdVelocity.set(all.velocity[0].sd(), all.velocity[1].sd(), all.velocity[2].sd());
+	s.meanSpeed = all.speed.mean;
+	s.maxSpeed = all.maxSpeed;
+	s.meanTime = all.time.mean;
+	s.landerStepsPerMs = s.wallMs > 0 ? all.steps / s.wallMs : 0;
+	return s;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "ofMain.h"
+#include "Octree.h"
+
+//  Many landers flown at once against one shared, read-only terrain index,
+//  for landing dispersion studies.  State is kept as structure-of-arrays and
+//  the batch is split across threads, each thread owning a contiguous range
+//  of landers for the whole flight.
+//
+//  Touchdown is LanderSim's test: the lander is in the octree node of a
+//  terrain vertex, no higher than LanderSim::touchdownCeiling.  So a lander
+//  fast enough to pass through the bottom of the tree falls through, as
+//  the single lander does.  The queries are only made for landers below
+//  the top of the terrain, batched per step and sorted into z-order; each
+//  lander remembers the empty leaf it was last found in and skips the
+//  query while it stays inside.
+//
+//  Thrust is a shared piecewise-constant profile that every lander follows
+//  with its own gain and start delay.  Between profile changes the forces
+//  are constant, so each step uses the exact solution for constant force
+//  with linear drag (the same damping model as the RK4 lander in LanderSim).
+//  Unlike LanderSim, a lander meeting the terrain above the ceiling keeps
+//  its thrust.
+//
+
+struct ThrustKey {
+	float time;        // sec
+	ofVec3f thrust;
+};
+
+struct Dispersion {
+	float position = 0.5;    // sigma of the start position, per axis
+	float velocity = 0.05;   // sigma of the start velocity, per axis
+	float thrustGain = 0.05; // sigma of the thrust multiplier (mean 1)
+	float delay = 0.1;       // sigma of the profile start delay, sec (>= 0)
+};
+
+struct TouchdownStats {
+	int total = 0, landed = 0, crashed = 0, timedOut = 0;
+	ofVec3f meanPosition, sdPosition;
+	ofVec3f meanVelocity, sdVelocity;
+	float meanSpeed = 0, maxSpeed = 0;
+	float meanTime = 0;
+	double wallMs = 0;
+	double landerStepsPerMs = 0;
+};
+
+class LanderBatch {
+public:
+	enum Status { Flying, Landed, Crashed, TimedOut };
+
+	LanderBatch();
+	void setup(int n, const ofVec3f &start, const vector<ThrustKey> &profile,
+		const Dispersion &d, uint32_t seed);
+	TouchdownStats run(const Octree &terrain, float dt, float maxTime, int threads = 0);
+
+	float gravity;
+	float damping;       // per 1/60 sec, as Particle::damping
+	float mass;
+	float crashSpeed;
+
+	// lander state, one entry per lander
+	vector<float> px, py, pz, vx, vy, vz;
+	vector<float> gain, delay, touchdownTime;
+	vector<uint8_t> status;
+
+private:
+	struct RangeStats;
+	void runRange(const Octree &terrain, int begin, int end, float dt, float maxTime, RangeStats *stats);
+	void summarize(int begin, int end, float dt, float maxTime, RangeStats &stats) const;
+	vector<ThrustKey> profile;
+};
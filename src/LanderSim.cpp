@@ -0,0 +1,172 @@
+
+#include "LanderSim.h"
+#include "MeshCache.h"
+#include "TerrainGenerator.h"
+#include "TerrainTiles.h"
+#include "Profiler.h"
+
+LanderSim::LanderSim() : terrainMemory(MemMeshes), gravityForce(ofVec3f(0, 0, 0)) {
+	octreeMaxDepth = 40;
+	tiles = NULL;
+	gravity = 0.2;
+	crashSpeed = 1.0;
+
+	// "Ship" is the particle that the lander is mapped to
+	Particle ship;
+	ship.color = ofColor::green;
+	ship.lifespan = -1;
+	sys.add(ship);
+	sys.setIntegrator(RK4Integrator);
+
+	sys.addForce(&thruster);
+	sys.addForce(&impulseForce);
+	sys.addForce(&gravityForce);
+	reset(ofVec3f(0, 0, 0));
+}
+
+bool LanderSim::loadTerrain(const string &path) {
+	if (TerrainGenerator::isSpec(path)) {
+		TerrainGenerator generator;
+		if (!TerrainGenerator::parseSpec(path, generator.params)) return false;
+		generator.generate(terrain);
+		terrainMemory.setMesh(terrain);
+		octree.create(terrain, octreeMaxDepth);
+		return true;
+	}
+	ofMesh mesh;
+	if (!loadCachedObjMesh(path, mesh)) return false;
+	setTerrain(mesh);
+	return true;
+}
+
+void LanderSim::setTerrain(const ofMesh &mesh) {
+	terrain = mesh;
+	terrainMemory.setMesh(terrain);
+	octree.create(terrain, octreeMaxDepth);
+}
+
+void LanderSim::reset(const ofVec3f &start) {
+	Particle &s = ship();
+	s.position = start;
+	s.velocity.set(0, 0, 0);
+	s.forces.set(0, 0, 0);
+	thruster.set(ofVec3f(0, 0, 0));
+	landed = false;
+	crashed = false;
+	time = 0;
+	touchdownPoint.set(0, 0, 0);
+	touchdownVelocity.set(0, 0, 0);
+}
+
+// one step of the thrust/gravity/collision model
+void LanderSim::step(float dt) {
+	if (landed) return;
+
+	gravityForce.set(ofVec3f(0, -gravity, 0));
+	sys.update(dt);
+	time += dt;
+
+	// check if rover point intersects with terrain mesh
+	ofVec3f hit;
+	if (terrainHit(ship().position, hit)) {
+		if (ship().position.y <= touchdownCeiling) {
+			landed = true;
+			touchdownPoint = hit;
+			touchdownVelocity = ship().velocity;
+			crashed = touchdownVelocity.length() > crashSpeed;
+		}
+		ship().forces = ofVec3f(0, 0, 0);
+	}
+}
+
+// first terrain vertex in the octree leaf holding p
+bool LanderSim::terrainHit(const ofVec3f &p, ofVec3f &vertex) {
+	PROFILE_SCOPE("terrain collision");
+	if (tiles) {
+		tiles->require(p.x, p.z);   // the tile under the ship can't wait for the loaders
+		return tiles->collide(p, vertex);
+	}
+	vector<int> selectedPoint = collisionCursor.getCollision(octree, p);
+	if (selectedPoint.empty()) return false;
+	vertex = terrain.getVertex(selectedPoint[0]);
+	return true;
+}
+
+bool LanderSim::isControlKey(int key) {
+	return key == ' ' || key == OF_KEY_UP || key == OF_KEY_DOWN ||
+		key == OF_KEY_LEFT || key == OF_KEY_RIGHT;
+}
+
+// Every press adds to the thrust (key repeat included), any release cuts it.
+void LanderSim::control(int key, bool pressed) {
+	if (!pressed) {
+		if (isControlKey(key)) thruster.set(ofVec3f(0, 0, 0));
+		return;
+	}
+	if (landed) return;
+	switch (key) {
+	case ' ':          thruster.add(ofVec3f(0, .5, 0)); break;
+	case OF_KEY_DOWN:  thruster.add(ofVec3f(0, 0, 0.5)); break;
+	case OF_KEY_UP:    thruster.add(ofVec3f(0, 0, -0.5)); break;
+	case OF_KEY_LEFT:  thruster.add(ofVec3f(-.5, 0, 0)); break;
+	case OF_KEY_RIGHT: thruster.add(ofVec3f(.5, 0, 0)); break;
+	default: break;
+	}
+}
+
+LanderState LanderSim::saveState() {
+	LanderState s;
+	s.position = ship().position;
+	s.velocity = ship().velocity;
+	s.forces = ship().forces;
+	s.thrust = thruster.get();
+	s.time = time;
+	s.gravity = gravity;
+	s.landed = landed;
+	s.crashed = crashed;
+	s.touchdownPoint = touchdownPoint;
+	s.touchdownVelocity = touchdownVelocity;
+	return s;
+}
+
+void LanderSim::loadState(const LanderState &s) {
+	ship().position = s.position;
+	ship().velocity = s.velocity;
+	ship().forces = s.forces;
+	thruster.set(s.thrust);
+	time = s.time;
+	gravity = s.gravity;
+	landed = s.landed;
+	crashed = s.crashed;
+	touchdownPoint = s.touchdownPoint;
+	touchdownVelocity = s.touchdownVelocity;
+}
+
+// AGL: ray straight down from the ship against the octree
+float LanderSim::altitude() {
+	PROFILE_SCOPE("AGL");
+	ofVec3f selected = ofVec3f(0, 0, 0);
+	ofVec3f p = ship().position;
+
+	if (tiles) {
+		float agl;
+		return tiles->altitude(p, agl) ? agl : p.y;
+	}
+
+	Ray ray = Ray(p, Vector3(0, -1, 0));
+	vector<int> selectedVertices = aglCursor.getIntersectingVertices(octree, ray);
+
+	if (selectedVertices.size() != 0) {
+		// Find the closest vertex
+		int closestVertex = selectedVertices[0];
+		for (int i : selectedVertices) {
+			if (terrain.getVertex(i).y > terrain.getVertex(closestVertex).y
+				&& terrain.getVertex(closestVertex).y > 20)
+				closestVertex = i;
+
+		}
+		selected = terrain.getVertex(closestVertex);
+	}
+
+	return p.y - selected.y;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "ofMain.h"
+#include "Octree.h"
+#include "ParticleSystem.h"
+
+class TerrainTiles;
+
+//  Lander physics without any window, sound or GL: the terrain and its
+//  octree, the ship particle with its thrust/gravity forces, and the
+//  touchdown test.  ofApp drives one of these once per frame; the headless
+//  simulator drives it as fast as the CPU allows.
+//
+
+// everything needed to resume a flight exactly, for checkpoints
+struct LanderState {
+	ofVec3f position, velocity, forces, thrust;
+	float time;
+	float gravity;
+	bool landed, crashed;
+	ofVec3f touchdownPoint, touchdownVelocity;
+};
+
+class LanderSim {
+public:
+	LanderSim();
+
+	// terrain: parsed from an OBJ file, generated from a "procedural:..."
+	// spec (see TerrainGenerator) or copied from a loaded mesh
+	bool loadTerrain(const string &path);
+	void setTerrain(const ofMesh &mesh);
+
+	// put the ship at "start", at rest, and clear the landing state
+	void reset(const ofVec3f &start);
+	void step(float dt);
+	float altitude();    // above ground level, straight down from the ship
+
+	// flight controls: space and the arrow keys, as pressed/released
+	static bool isControlKey(int key);
+	void control(int key, bool pressed);
+
+	LanderState saveState();
+	void loadState(const LanderState &s);
+
+	Particle &ship() { return sys.particles[0]; }
+
+	ofMesh terrain;
+	MemoryCharge terrainMemory;    // set with setMesh(terrain) whenever terrain changes
+	Octree octree;
+	int octreeMaxDepth;
+	OctreeCursor collisionCursor;  // the ship's collision and AGL queries from frame to frame
+	OctreeCursor aglCursor;
+	TerrainTiles *tiles;           // when set, collide with these instead of terrain/octree
+
+	ParticleSystem sys;            // particles[0] is the ship
+	ThrusterForce thruster;
+	ImpulseForce impulseForce;
+	GravityForce gravityForce;
+	float gravity;
+
+	bool landed;
+	bool crashed;                  // touched down faster than crashSpeed
+	float crashSpeed;
+	float time;                    // sec of simulated flight
+
+	// Touchdown, here and in LanderBatch: the ship is in the octree node of
+	// a terrain vertex (Octree::getCollision) and no higher than this
+	static constexpr float touchdownCeiling = 20;
+	ofVec3f touchdownPoint;        // terrain vertex hit
+	ofVec3f touchdownVelocity;
+
+private:
+	bool terrainHit(const ofVec3f &p, ofVec3f &vertex);
+};
@@ -0,0 +1,83 @@
+
+#include "MemoryTags.h"
+
+MemTagStats MemoryTags::stats[MemTagCount];
+uint64_t MemoryTags::lastAllocs[MemTagCount];
+uint64_t MemoryTags::lastBytes[MemTagCount];
+float MemoryTags::allocsPerFrame[MemTagCount];
+float MemoryTags::bytesPerFrame[MemTagCount];
+float MemoryTags::allocsPerSec[MemTagCount];
+uint64_t MemoryTags::lastFrameTime = 0;
+uint64_t MemoryTags::frames = 0;
+
+const char *MemoryTags::name(MemTag tag) {
+	switch (tag) {
+	case MemOctree:    return "octree";
+	case MemParticles: return "particles";
+	case MemMeshes:    return "meshes";
+	case MemTiles:     return "terrain tiles";
+	case MemStaging:   return "gpu staging";
+	default:           return "?";
+	}
+}
+
+void MemoryCharge::setMesh(const ofMesh &mesh) {
+	set(mesh.getNumVertices() * sizeof(ofVec3f) + mesh.getNumNormals() * sizeof(ofVec3f) +
+		mesh.getNumTexCoords() * sizeof(ofVec2f) + mesh.getNumIndices() * sizeof(ofIndexType));
+}
+
+// Allocations per frame are smoothed over about half a second, so a spike
+// stays readable on the HUD.
+void MemoryTags::nextFrame() {
+	uint64_t now = ofGetElapsedTimeMicros();
+	float dt = lastFrameTime ? (now - lastFrameTime) / 1e6 : 0;
+	lastFrameTime = now;
+	for (int t = 0; t < MemTagCount; t++) {
+		uint64_t allocs = stats[t].allocs.load(std::memory_order_relaxed);
+		uint64_t bytes = stats[t].bytesAllocated.load(std::memory_order_relaxed);
+		float a = allocs - lastAllocs[t], b = bytes - lastBytes[t];
+		lastAllocs[t] = allocs;
+		lastBytes[t] = bytes;
+		if (frames == 0) continue;
+		allocsPerFrame[t] += (a - allocsPerFrame[t]) * 0.03;
+		bytesPerFrame[t] += (b - bytesPerFrame[t]) * 0.03;
+		if (dt > 0) allocsPerSec[t] += (a / dt - allocsPerSec[t]) * 0.03;
+	}
+	frames++;
+}
+
+static string megabytes(int64_t bytes) {
+	return ofToString(bytes / 1048576.0, 2) + " MB";
+}
+
+void MemoryTags::drawHud(float x, float y) {
+	ofPushStyle();
+	ofFill();
+	ofSetColor(0, 0, 0, 160);
+	ofDrawRectangle(x, y, 550, 16 + 12 * MemTagCount);
+	ofSetColor(ofColor::white);
+	ofDrawBitmapString("memory          live        peak     allocs/frame  KB/frame  allocs/s", x + 4, y + 12);
+	for (int t = 0; t < MemTagCount; t++) {
+		char line[128];
+		snprintf(line, sizeof(line), "%-13s %9.2f MB %9.2f MB %10.1f %10.1f %9.0f", name((MemTag) t),
+			stats[t].live.load() / 1048576.0, stats[t].peak.load() / 1048576.0, allocsPerFrame[t],
+			bytesPerFrame[t] / 1024, allocsPerSec[t]);
+		ofDrawBitmapString(line, x + 4, y + 24 + 12 * t);
+	}
+	ofPopStyle();
+}
+
+string MemoryTags::report() {
+	ostringstream out;
+	out << "memory by subsystem";
+	if (frames > 0) out << " over " << frames << " frames";
+	out << ":" << endl;
+	for (int t = 0; t < MemTagCount; t++) {
+		const MemTagStats &s = stats[t];
+		out << "  " << name((MemTag) t) << ": live " << megabytes(s.live) << ", peak " << megabytes(s.peak)
+			<< ", " << s.allocs << " allocations (" << megabytes(s.bytesAllocated) << "), " << s.frees << " frees";
+		if (frames > 0) out << ", " << (double) s.allocs / frames << " per frame";
+		out << endl;
+	}
+	return out.str();
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+
+//  Per subsystem memory accounting.
+//
+//  Containers that matter use TaggedAllocator (see TaggedVector), which
+//  counts every allocation against a tag.  Memory the allocator can't see,
+//  such as ofMesh arrays and GL buffers, is charged with a MemoryCharge set
+//  to its current size.  Counters are relaxed atomics, safe from any thread.
+//
+//  MemoryTags::nextFrame() (once a frame, main thread) turns the counters
+//  into per frame allocation counts; drawHud() and report() show live and
+//  peak bytes and allocations per frame and per second for every tag.
+//
+
+typedef enum { MemOctree, MemParticles, MemMeshes, MemTiles, MemStaging, MemTagCount } MemTag;
+
+struct MemTagStats {
+	std::atomic<int64_t> live, peak;
+	std::atomic<uint64_t> allocs, frees, bytesAllocated;
+};
+
+class MemoryTags {
+public:
+	static const char *name(MemTag tag);
+
+	static void allocated(MemTag tag, size_t bytes) {
+		MemTagStats &s = stats[tag];
+		int64_t live = s.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		int64_t peak = s.peak.load(std::memory_order_relaxed);
+		while (live > peak && !s.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+		s.allocs.fetch_add(1, std::memory_order_relaxed);
+		s.bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+	}
+	static void freed(MemTag tag, size_t bytes) {
+		stats[tag].live.fetch_sub(bytes, std::memory_order_relaxed);
+		stats[tag].frees.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void nextFrame();
+	static void drawHud(float x, float y);
+	static string report();
+
+	static MemTagStats stats[MemTagCount];
+
+private:
+	static uint64_t lastAllocs[MemTagCount], lastBytes[MemTagCount];
+	static float allocsPerFrame[MemTagCount], bytesPerFrame[MemTagCount];
+	static float allocsPerSec[MemTagCount];
+	static uint64_t lastFrameTime;
+	static uint64_t frames;
+};
+
+template <class T, MemTag Tag>
+class TaggedAllocator {
+public:
+	typedef T value_type;
+
+	TaggedAllocator() {}
+	template <class U> TaggedAllocator(const TaggedAllocator<U, Tag> &) {}
+	template <class U> struct rebind { typedef TaggedAllocator<U, Tag> other; };
+
+	T *allocate(size_t n) {
+		MemoryTags::allocated(Tag, n * sizeof(T));
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+	void deallocate(T *p, size_t n) {
+		MemoryTags::freed(Tag, n * sizeof(T));
+		::operator delete(p);
+	}
+};
+
+template <class T, class U, MemTag Tag>
+bool operator==(const TaggedAllocator<T, Tag> &, const TaggedAllocator<U, Tag> &) { return true; }
+template <class T, class U, MemTag Tag>
+bool operator!=(const TaggedAllocator<T, Tag> &, const TaggedAllocator<U, Tag> &) { return false; }
+
+template <class T, MemTag Tag>
+using TaggedVector = std::vector<T, TaggedAllocator<T, Tag> >;
+
+// bytes held outside a tagged container, e.g. a mesh or a GL buffer
+class MemoryCharge {
+public:
+	MemoryCharge(MemTag tag) : tag(tag), bytes(0) {}
+	MemoryCharge(const MemoryCharge &o) : tag(o.tag), bytes(0) { set(o.bytes); }
+	MemoryCharge &operator=(const MemoryCharge &o) {
+		set(0);
+		tag = o.tag;
+		set(o.bytes);
+		return *this;
+	}
+	~MemoryCharge() { set(0); }
+
+	void set(size_t now) {
+		if (bytes) MemoryTags::freed(tag, bytes);
+		bytes = now;
+		if (bytes) MemoryTags::allocated(tag, bytes);
+	}
+	void setMesh(const ofMesh &mesh);     // vertex, normal, texcoord and index arrays
+
+private:
+	MemTag tag;
+	size_t bytes;
+};
@@ -0,0 +1,263 @@
+
+#include "MeshCache.h"
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t cacheVersion = 1;
+static const uint32_t byteOrderMark = 0x01020304;
+static const size_t sectionAlign = 64;
+
+static size_t alignUp(size_t n) {
+	return (n + sectionAlign - 1) & ~(sectionAlign - 1);
+}
+
+// size and modification time of a file
+static bool fileStamp(const string &path, uint64_t &size, int64_t &time) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+	size = st.st_size;
+	time = st.st_mtime;
+	return true;
+}
+
+// FNV-1a over the whole file
+static bool hashFile(const string &path, uint64_t &hash) {
+	ifstream in(path.c_str(), ios::binary);
+	if (!in) return false;
+	hash = 0xcbf29ce484222325ULL;
+	vector<char> chunk(1 << 20);
+	while (in) {
+		in.read(chunk.data(), chunk.size());
+		streamsize n = in.gcount();
+		for (streamsize i = 0; i < n; i++) {
+			hash ^= (unsigned char) chunk[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+MeshCacheFile::MeshCacheFile() {
+	memset(&header, 0, sizeof(header));
+	positions = normals = texcoords = NULL;
+	indices = NULL;
+	data = NULL;
+	size = 0;
+}
+
+MeshCacheFile::~MeshCacheFile() {
+	close();
+}
+
+void MeshCacheFile::close() {
+#ifdef _WIN32
+	buffer.clear();
+	buffer.shrink_to_fit();
+#else
+	if (data) munmap((void *) data, size);
+#endif
+	data = NULL;
+	size = 0;
+	positions = normals = texcoords = NULL;
+	indices = NULL;
+}
+
+bool MeshCacheFile::open(const string &path) {
+	close();
+#ifdef _WIN32
+	ifstream in(path.c_str(), ios::binary | ios::ate);
+	if (!in) return false;
+	buffer.resize((size_t) in.tellg());
+	in.seekg(0);
+	if (!in.read(buffer.data(), buffer.size())) return false;
+	data = buffer.data();
+	size = buffer.size();
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(MeshCacheHeader)) {
+		::close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) return false;
+	data = (const char *) map;
+	size = st.st_size;
+#endif
+	if (size < sizeof(MeshCacheHeader)) {
+		close();
+		return false;
+	}
+
+	// layout checks: every section inside the file, aligned and the right size
+	memcpy(&header, data, sizeof(header));
+	const MeshCacheHeader &h = header;
+	uint64_t n = h.numVertices;
+	auto inside = [&](uint64_t offset, uint64_t bytes) {
+		return offset % sectionAlign == 0 && offset >= sizeof(MeshCacheHeader) && offset <= size && bytes <= size - offset;
+	};
+	bool ok = memcmp(h.magic, "LMSH", 4) == 0 && h.version == cacheVersion && h.byteOrder == byteOrderMark &&
+		h.numIndices % 3 == 0 && inside(h.positions, n * 12) && inside(h.indices, (uint64_t) h.numIndices * 4) &&
+		(!(h.flags & MeshCacheNormals) || inside(h.normals, n * 12)) &&
+		(!(h.flags & MeshCacheTexcoords) || inside(h.texcoords, n * 8)) && inside(h.material, h.materialSize);
+	if (ok) {
+		positions = (const float *) (data + h.positions);
+		normals = (h.flags & MeshCacheNormals) ? (const float *) (data + h.normals) : NULL;
+		texcoords = (h.flags & MeshCacheTexcoords) ? (const float *) (data + h.texcoords) : NULL;
+		indices = (const uint32_t *) (data + h.indices);
+		for (uint32_t i = 0; i < h.numIndices && ok; i++) ok = indices[i] < n;
+	}
+	if (!ok) {
+		ofLogWarning("MeshCache") << path << " is damaged or from another version";
+		close();
+		return false;
+	}
+
+	vector<string> names = ofSplitString(string(data + h.material, h.materialSize), "\n");
+	material.library = names.size() > 0 ? names[0] : "";
+	material.name = names.size() > 1 ? names[1] : "";
+	return true;
+}
+
+void MeshCacheFile::toMesh(ofMesh &mesh) const {
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	if (!data) return;
+	int n = header.numVertices;
+	mesh.getVertices().assign((const ofVec3f *) positions, (const ofVec3f *) positions + n);
+	if (normals) mesh.getNormals().assign((const ofVec3f *) normals, (const ofVec3f *) normals + n);
+	if (texcoords) mesh.getTexCoords().assign((const ofVec2f *) texcoords, (const ofVec2f *) texcoords + n);
+	mesh.getIndices().assign(indices, indices + header.numIndices);
+}
+
+// straight from the mapping, no ofMesh in between
+void MeshCacheFile::upload(ofVbo &vbo, int usage) const {
+	if (!data) return;
+	int n = header.numVertices;
+	vbo.setVertexData(positions, 3, n, usage, 3 * sizeof(float));
+	if (normals) vbo.setNormalData(normals, n, usage, 3 * sizeof(float));
+	if (texcoords) vbo.setTexCoordData(texcoords, n, usage, 2 * sizeof(float));
+	if (sizeof(ofIndexType) == sizeof(uint32_t)) {
+		vbo.setIndexData((const ofIndexType *) indices, header.numIndices, usage);
+	}
+	else {
+		vector<ofIndexType> narrow(indices, indices + header.numIndices);
+		vbo.setIndexData(narrow.data(), narrow.size(), usage);
+	}
+}
+
+// Written to a temporary file and renamed, so a reader never maps half a cache.
+bool MeshCacheFile::write(const string &path, const ofMesh &mesh, const ObjMaterialRef &material,
+	uint64_t sourceSize, int64_t sourceTime, uint64_t sourceHash) {
+	MeshCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "LMSH", 4);
+	h.version = cacheVersion;
+	h.byteOrder = byteOrderMark;
+	h.sourceSize = sourceSize;
+	h.sourceTime = sourceTime;
+	h.sourceHash = sourceHash;
+	h.numVertices = mesh.getNumVertices();
+	h.numIndices = mesh.getNumIndices();
+	bool hasNormals = mesh.getNumNormals() == h.numVertices;
+	bool hasTexcoords = mesh.getNumTexCoords() == h.numVertices;
+	h.flags = (hasNormals ? MeshCacheNormals : 0) | (hasTexcoords ? MeshCacheTexcoords : 0);
+	string names = material.library + "\n" + material.name;
+	h.materialSize = names.size();
+
+	size_t end = alignUp(sizeof(h));
+	h.positions = end;
+	end = alignUp(end + h.numVertices * 12);
+	if (hasNormals) {
+		h.normals = end;
+		end = alignUp(end + h.numVertices * 12);
+	}
+	if (hasTexcoords) {
+		h.texcoords = end;
+		end = alignUp(end + h.numVertices * 8);
+	}
+	h.indices = end;
+	end = alignUp(end + (size_t) h.numIndices * 4);
+	h.material = end;
+
+	string tmp = path + ".tmp";
+	{
+		ofstream out(tmp.c_str(), ios::binary);
+		if (!out) return false;
+		auto section = [&](uint64_t offset, const void *bytes, size_t n) {
+			while ((uint64_t) out.tellp() < offset) out.put(0);
+			out.write((const char *) bytes, n);
+		};
+		out.write((const char *) &h, sizeof(h));
+		section(h.positions, mesh.getVertices().data(), h.numVertices * 12);
+		if (hasNormals) section(h.normals, mesh.getNormals().data(), h.numVertices * 12);
+		if (hasTexcoords) section(h.texcoords, mesh.getTexCoords().data(), h.numVertices * 8);
+		vector<uint32_t> wide(mesh.getIndices().begin(), mesh.getIndices().end());
+		section(h.indices, wide.data(), wide.size() * 4);
+		section(h.material, names.data(), names.size());
+		if (!out) {
+			remove(tmp.c_str());
+			return false;
+		}
+	}
+	remove(path.c_str());     // rename doesn't replace on Windows
+	return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+//--------------------------------------------------------------
+bool openCachedObj(const string &objPath, MeshCacheFile &file) {
+	string source = ofToDataPath(objPath);
+	string cache = source + ".lmsh";
+	uint64_t sourceSize, hash;
+	int64_t sourceTime;
+	bool haveSource = fileStamp(source, sourceSize, sourceTime);
+
+	if (file.open(cache)) {
+		// a cache shipped without its OBJ is used as is
+		if (!haveSource) return true;
+		MeshCacheHeader &h = file.header;
+		if (h.sourceSize == sourceSize && h.sourceTime == sourceTime) return true;
+
+		// touched but maybe not changed: compare contents, keep the cache
+		// and its new time stamp if they're the same
+		if (h.sourceSize == sourceSize && hashFile(source, hash) && hash == h.sourceHash) {
+			h.sourceTime = sourceTime;
+			fstream out(cache.c_str(), ios::binary | ios::in | ios::out);
+			out.write((const char *) &h, sizeof(h));
+			return true;
+		}
+		file.close();
+	}
+	if (!haveSource) {
+		ofLogError("MeshCache") << "can't open " << objPath;
+		return false;
+	}
+
+	ofMesh mesh;
+	ObjMaterialRef material;
+	uint64_t t0 = ofGetElapsedTimeMillis();
+	if (!loadObjMesh(objPath, mesh, &material) || !hashFile(source, hash)) return false;
+	if (!MeshCacheFile::write(cache, mesh, material, sourceSize, sourceTime, hash)) {
+		ofLogWarning("MeshCache") << "can't write " << cache;
+		return false;
+	}
+	ofLogNotice("MeshCache") << "cached " << objPath << " (" << mesh.getNumVertices() << " vertices) in "
+		<< ofGetElapsedTimeMillis() - t0 << " ms";
+	return file.open(cache);
+}
+
+bool loadCachedObjMesh(const string &objPath, ofMesh &mesh) {
+	MeshCacheFile file;
+	if (openCachedObj(objPath, file)) {
+		file.toMesh(mesh);
+		return true;
+	}
+	return loadObjMesh(objPath, mesh);
+}
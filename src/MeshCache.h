@@ -0,0 +1,68 @@
+#pragma once
+#include "ofMain.h"
+#include "ObjMesh.h"
+
+//  Binary mesh cache, so OBJ text is parsed once and not on every run.
+//
+//  "<file>.obj" gets a "<file>.obj.lmsh" next to it: a 128 byte header, then
+//  positions, normals, texcoords (float x, y[, z] per vertex), uint32
+//  triangle indices and the material reference, each section 64 byte
+//  aligned.  The file is mapped read only and the arrays are used in place,
+//  copied into an ofMesh for the simulation or uploaded straight to a vbo.
+//
+//  The header records the size, modification time and FNV-1a hash of the
+//  OBJ it came from.  If size and time still match the cache is used; if
+//  only the time changed (a fresh checkout) the hash decides; otherwise, or
+//  if the cache is damaged, it is rebuilt from the OBJ.
+//
+
+struct MeshCacheHeader {
+	char magic[4];                  // "LMSH"
+	uint32_t version;
+	uint32_t byteOrder;             // 0x01020304 as written
+	uint32_t flags;                 // MeshCacheNormals | MeshCacheTexcoords
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint32_t numVertices, numIndices;
+	uint64_t positions, normals, texcoords, indices, material;   // section offsets
+	uint32_t materialSize;          // "library\nname"
+	uint32_t reserved[9];
+};
+
+typedef enum { MeshCacheNormals = 1, MeshCacheTexcoords = 2 } MeshCacheFlags;
+
+class MeshCacheFile {
+public:
+	MeshCacheFile();
+	~MeshCacheFile();
+
+	// map an existing cache, checking its layout (not the source)
+	bool open(const string &path);
+	void close();
+	bool isOpen() const { return data != NULL; }
+
+	void toMesh(ofMesh &mesh) const;
+	void upload(ofVbo &vbo, int usage = GL_STATIC_DRAW) const;
+
+	static bool write(const string &path, const ofMesh &mesh, const ObjMaterialRef &material,
+		uint64_t sourceSize, int64_t sourceTime, uint64_t sourceHash);
+
+	MeshCacheHeader header;
+	const float *positions, *normals, *texcoords;   // NULL if absent
+	const uint32_t *indices;
+	ObjMaterialRef material;
+
+private:
+	const char *data;
+	size_t size;
+#ifdef _WIN32
+	vector<char> buffer;            // no mmap, read into memory
+#endif
+};
+
+// Map the cache of an OBJ, building or refreshing it first if need be.
+bool openCachedObj(const string &objPath, MeshCacheFile &file);
+
+// loadObjMesh through the cache
+bool loadCachedObjMesh(const string &objPath, ofMesh &mesh);
@@ -0,0 +1,100 @@
+
+#include "ObjMesh.h"
+#include <unordered_map>
+
+// parse one "v/vt/vn" face corner, resolving negative (relative) indices.
+// returns false if the position index is missing or out of range.
+static bool parseCorner(const char *s, int nv, int nt, int nn, int &v, int &t, int &n) {
+	char *end;
+	v = strtol(s, &end, 10);
+	t = n = 0;
+	if (*end == '/') {
+		s = end + 1;
+		if (*s != '/') t = strtol(s, &end, 10);
+		else end = (char *) s;
+		if (*end == '/') n = strtol(end + 1, &end, 10);
+	}
+	if (v < 0) v += nv + 1;
+	if (t < 0) t += nt + 1;
+	if (n < 0) n += nn + 1;
+	if (t > nt) t = 0;
+	if (n > nn) n = 0;
+	return v >= 1 && v <= nv;
+}
+
+bool loadObjMesh(const string &path, ofMesh &mesh, ObjMaterialRef *material) {
+	ifstream in(ofToDataPath(path).c_str());
+	if (!in) {
+		ofLogError("loadObjMesh") << "can't open " << path;
+		return false;
+	}
+
+	vector<ofVec3f> positions, normals;
+	vector<ofVec2f> texcoords;
+	unordered_map<uint64_t, ofIndexType> corners;   // packed v/vt/vn -> vertex
+	vector<ofIndexType> face;
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	if (material) *material = ObjMaterialRef();
+
+	string line;
+	while (getline(in, line)) {
+		const char *s = line.c_str();
+		while (*s == ' ' || *s == '\t') s++;
+
+		if (s[0] == 'v' && s[1] == ' ') {
+			ofVec3f p;
+			sscanf(s + 2, "%f %f %f", &p.x, &p.y, &p.z);
+			positions.push_back(p);
+		}
+		else if (s[0] == 'v' && s[1] == 'n') {
+			ofVec3f n;
+			sscanf(s + 3, "%f %f %f", &n.x, &n.y, &n.z);
+			normals.push_back(n);
+		}
+		else if (s[0] == 'v' && s[1] == 't') {
+			ofVec2f t;
+			sscanf(s + 3, "%f %f", &t.x, &t.y);
+			texcoords.push_back(t);
+		}
+		else if (s[0] == 'f' && s[1] == ' ') {
+			face.clear();
+			istringstream corner(s + 2);
+			string tok;
+			while (corner >> tok) {
+				int v, t, n;
+				if (!parseCorner(tok.c_str(), positions.size(), texcoords.size(), normals.size(), v, t, n)) {
+					ofLogError("loadObjMesh") << path << ": bad face \"" << line << "\"";
+					return false;
+				}
+				uint64_t key = ((uint64_t) v << 42) | ((uint64_t) t << 21) | (uint64_t) n;
+				auto found = corners.find(key);
+				if (found == corners.end()) {
+					found = corners.emplace(key, (ofIndexType) mesh.getNumVertices()).first;
+					mesh.addVertex(positions[v - 1]);
+					if (normals.size() > 0) mesh.addNormal(n ? normals[n - 1] : ofVec3f(0, 1, 0));
+					if (texcoords.size() > 0) mesh.addTexCoord(t ? texcoords[t - 1] : ofVec2f(0, 0));
+				}
+				face.push_back(found->second);
+			}
+			for (int i = 2; i < face.size(); i++) {
+				mesh.addIndex(face[0]);
+				mesh.addIndex(face[i - 1]);
+				mesh.addIndex(face[i]);
+			}
+		}
+		else if (material && strncmp(s, "mtllib ", 7) == 0 && material->library == "") {
+			material->library = ofTrim(s + 7);
+		}
+		else if (material && strncmp(s, "usemtl ", 7) == 0 && material->name == "") {
+			material->name = ofTrim(s + 7);
+		}
+	}
+
+	if (mesh.getNumVertices() == 0) {
+		ofLogError("loadObjMesh") << path << ": no faces";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "ofMain.h"
+
+// the material of an OBJ: its "mtllib" file and the first "usemtl" name
+struct ObjMaterialRef {
+	string library, name;
+};
+
+// Minimal Wavefront OBJ reader: positions, normals, texture coordinates and
+// faces (polygons are fanned into triangles).  Each distinct v/vt/vn
+// combination becomes one vertex, as with the Assimp loader.  Needs no GL
+// context, so it can be used off the main thread and in headless tools.
+//
+bool loadObjMesh(const string &path, ofMesh &mesh, ObjMaterialRef *material = NULL);
@@ -1,3 +1,404 @@
 
 
 #include "Octree.h"
+#include "Profiler.h"
+#include <atomic>
+
+int Octree::newGeneration() {
+	static std::atomic<int> next(0);
+	return ++next;
+}
+
+// Given a mesh, generate an octree of a specified depth over its bounding box
+void Octree::create(const ofMesh &mesh, int maxDepth) {
+	PROFILE_SCOPE("octree build");
+	this->mesh = &mesh;
+	highestDepth = 0;
+	generation = newGeneration();
+
+	// the root keeps no index list of its own, the children start from all vertices
+	vector<int> indices(mesh.getNumVertices());
+	for (int i = 0; i < indices.size(); i++) indices[i] = i;
+
+	root = meshBounds(mesh);
+
+	generateTreeNodes(root, indices.data(), indices.size(), 0, maxDepth);
+}
+
+// Recursive function for Octree::create(), generates an octree over the
+// vertices "indices" of the node.  They are gathered into x, y, z arrays once
+// and each child picks its own with a batch contains.
+void Octree::generateTreeNodes(Box &node, const int *indices, int count, int currentDepth, int maxDepth) {
+	// Set node level
+	node.level = currentDepth;
+	if (currentDepth > highestDepth)
+		highestDepth = currentDepth;
+
+	// divide current node into 8 leaves
+	subDivideBox8(node, node.children);
+
+	const vector<ofVec3f> &vertices = mesh->getVertices();
+	vector<float> x(count), y(count), z(count);
+	vector<uint8_t> inside(count);
+	for (int k = 0; k < count; k++) {
+		const ofVec3f &v = vertices[indices[k]];
+		x[k] = v.x;
+		y[k] = v.y;
+		z[k] = v.z;
+	}
+
+	for (int i = 0; i < node.children.size(); i++) {
+		Box &child = node.children[i];
+		child.level = currentDepth + 1;
+
+		int n = child.contains(x.data(), y.data(), z.data(), count, inside.data());
+		// delete any leaves with no vertices
+		if (n == 0) {
+			node.children.erase(node.children.begin() + i);
+			i--;
+			continue;
+		}
+		// if current leaf contains a vertex, add it to vertex index list
+		child.vertexIndices.reserve(n);
+		for (int k = 0; k < count; k++)
+			if (inside[k]) child.vertexIndices.push_back(indices[k]);
+
+		// recursively generate more leaves if more than one inner vertex
+		if (currentDepth < maxDepth && n > 1)
+			generateTreeNodes(child, child.vertexIndices.data(), n, child.level, maxDepth);
+	}
+}
+
+// Checks which vetices intersect with ray; returns vertex indices of intersection,
+// empty vector if no leaf found with vertices.
+vector<int> Octree::getIntersectingVertices(Box &box, const Ray &ray) {
+	vector<int> selectedVertices;
+	if (box.intersect(ray, 0, 100)) intersectingVertices(box, ray, selectedVertices);
+	else box.containsSelectedVertex = false;
+	return selectedVertices;
+}
+
+// "box" is hit by the ray; its children are tested four at a time
+void Octree::intersectingVertices(Box &box, const Ray &ray, vector<int> &selectedVertices) {
+	// if only one vertex in leaf, we've found the lowest depth
+	if (box.vertexIndices.size() == 1) {
+		selectedVertices.push_back(box.vertexIndices[0]);
+		return;
+	}
+	size_t found = selectedVertices.size();
+	unsigned hits = Box::intersect(box.children.data(), box.children.size(), ray, 0, 100);
+	for (int i = 0; i < box.children.size(); i++) {
+		if (hits & (1u << i)) intersectingVertices(box.children[i], ray, selectedVertices);
+		else box.children[i].containsSelectedVertex = false;
+	}
+	if (selectedVertices.size() > found) box.containsSelectedVertex = true;
+}
+
+// Checks if a point intersects with bounding box
+// return a list of points that the point collides with
+vector<int> Octree::getCollision(Box &box, const ofPoint &point) {
+	vector<int> selectedVertices;
+	collidingVertices(box, point, selectedVertices);
+	return selectedVertices;
+}
+
+void Octree::collidingVertices(Box &box, const ofVec3f &point, vector<int> &selectedVertices) {
+	if (!box.contains(point)) {
+		box.containsSelectedVertex = false;
+		return;
+	}
+	// if only one vertex in leaf, we've found the lowest depth
+	if (box.vertexIndices.size() == 1) {
+		selectedVertices.push_back(box.vertexIndices[0]);
+		return;
+	}
+	size_t found = selectedVertices.size();
+	for (Box &child : box.children) collidingVertices(child, point, selectedVertices);
+	if (selectedVertices.size() > found) box.containsSelectedVertex = true;
+}
+
+const Box *Octree::collisionNode(const Box &box, const ofVec3f &point) const {
+	if (!box.contains(point)) return NULL;
+	if (box.vertexIndices.size() == 1 || box.children.empty()) return &box;
+	// children only share faces, at most one holds the point
+	for (const Box &child : box.children) {
+		const Box *node = collisionNode(child, point);
+		if (node != NULL) return node;
+	}
+	return &box;
+}
+
+// squared distance from (x, z) to the footprint of a box, 0 if inside
+static float columnDistance(const Box &box, float x, float z) {
+	float dx = max(max(box.parameters[0].x() - x, x - box.parameters[1].x()), 0.0f);
+	float dz = max(max(box.parameters[0].z() - z, z - box.parameters[1].z()), 0.0f);
+	return dx * dx + dz * dz;
+}
+
+// Nearest vertex to (x, z) in the xz plane below "node", preferring the
+// higher vertex on ties.  Children are visited nearest first and skipped
+// once their footprint is further away than the best vertex so far.
+void Octree::nearestInColumn(const Box &node, float x, float z, int &best, float &bestDist, const Box *&bestLeaf) const {
+	if (node.children.size() == 0) {
+		for (int i : node.vertexIndices) {
+			const ofVec3f &v = mesh->getVertices()[i];
+			float d = (v.x - x) * (v.x - x) + (v.z - z) * (v.z - z);
+			if (best < 0 || d < bestDist || (d == bestDist && v.y > mesh->getVertices()[best].y)) {
+				best = i;
+				bestDist = d;
+				bestLeaf = &node;
+			}
+		}
+		return;
+	}
+
+	float dist[8];
+	int order[8];
+	int n = 0;
+	for (int i = 0; i < node.children.size(); i++) {
+		float d = columnDistance(node.children[i], x, z);
+		int k = n++;
+		while (k > 0 && dist[k - 1] > d) {
+			dist[k] = dist[k - 1];
+			order[k] = order[k - 1];
+			k--;
+		}
+		dist[k] = d;
+		order[k] = i;
+	}
+	for (int k = 0; k < n; k++) {
+		if (best >= 0 && dist[k] > bestDist) break;
+		nearestInColumn(node.children[order[k]], x, z, best, bestDist, bestLeaf);
+	}
+}
+
+// Terrain surface under (x, z).  Does not touch containsSelectedVertex so
+// it is safe to call from several threads.
+const Box *Octree::surfaceAt(float x, float z, float &height, ofVec3f &normal) const {
+	if (mesh == NULL || columnDistance(root, x, z) > 0) return NULL;
+
+	int nearest = -1;
+	float nearestDist = 0;
+	const Box *leaf = NULL;
+	nearestInColumn(root, x, z, nearest, nearestDist, leaf);
+	if (nearest < 0) return NULL;
+
+	height = mesh->getVertices()[nearest].y;
+	normal = ofVec3f(0, 1, 0);
+	if (nearest < mesh->getNumNormals()) {
+		normal = mesh->getNormals()[nearest].getNormalized();
+		if (normal.y < 0) normal = -normal;
+	}
+	return leaf;
+}
+
+// Pre-order: bounds, level, vertex indices, child count, children.
+void Octree::writeNode(ostream &out, const Box &node) {
+	float bounds[6] = { node.parameters[0].x(), node.parameters[0].y(), node.parameters[0].z(),
+		node.parameters[1].x(), node.parameters[1].y(), node.parameters[1].z() };
+	int32_t header[3] = { node.level, (int32_t) node.vertexIndices.size(), (int32_t) node.children.size() };
+	out.write((const char *) bounds, sizeof(bounds));
+	out.write((const char *) header, sizeof(header));
+	if (!node.vertexIndices.empty())
+		out.write((const char *) node.vertexIndices.data(), node.vertexIndices.size() * sizeof(int));
+	for (const Box &child : node.children) writeNode(out, child);
+}
+
+bool Octree::readNode(istream &in, Box &node, int depth) {
+	float bounds[6];
+	int32_t header[3];
+	if (!in.read((char *) bounds, sizeof(bounds)) || !in.read((char *) header, sizeof(header))) return false;
+	if (header[1] < 0 || header[2] < 0 || header[2] > 8 || depth > 64) return false;
+	node.parameters[0] = Vector3(bounds[0], bounds[1], bounds[2]);
+	node.parameters[1] = Vector3(bounds[3], bounds[4], bounds[5]);
+	node.level = header[0];
+	node.containsSelectedVertex = false;
+	node.vertexIndices.resize(header[1]);
+	if (header[1] > 0 && !in.read((char *) node.vertexIndices.data(), header[1] * sizeof(int))) return false;
+	for (int i : node.vertexIndices)
+		if (i < 0 || i >= mesh->getNumVertices()) return false;
+	if (node.level > highestDepth) highestDepth = node.level;
+	node.children.resize(header[2]);
+	for (Box &child : node.children)
+		if (!readNode(in, child, depth + 1)) return false;
+	return true;
+}
+
+void Octree::write(ostream &out) const {
+	writeNode(out, root);
+}
+
+bool Octree::read(istream &in, const ofMesh &m) {
+	mesh = &m;
+	highestDepth = 0;
+	generation = newGeneration();
+	root = Box();
+	return readNode(in, root, 0);
+}
+
+void OctreeCursor::reset() {
+	path.clear();
+	column.clear();
+}
+
+// forget the last query if it was in another tree or before a rebuild
+void OctreeCursor::attach(Octree &t) {
+	if (tree == &t && generation == t.generation) return;
+	tree = &t;
+	generation = t.generation;
+	reset();
+}
+
+// Point queries keep the path to the deepest node that held the last point.
+// Boxes hold points strictly inside them and siblings only share faces, so
+// when a node holds the point no node outside it can: the search from the
+// deepest one still holding it finds what the search from the root would.
+vector<int> OctreeCursor::getCollision(Octree &t, const ofVec3f &point) {
+	attach(t);
+	if (path.empty()) path.push_back(&t.root);
+	while (path.size() > 1 && !path.back()->contains(point)) path.pop_back();
+
+	Box *start = path.back();
+	vector<int> selectedVertices;
+	t.collidingVertices(*start, point, selectedVertices);
+	if (!start->contains(point)) return selectedVertices;
+	if (!selectedVertices.empty())
+		for (size_t i = 0; i + 1 < path.size(); i++) path[i]->containsSelectedVertex = true;
+
+	// follow the point down for the next query
+	for (Box *node = start; node != NULL; ) {
+		Box *next = NULL;
+		for (Box &child : node->children) {
+			if (child.contains(point)) {
+				next = &child;
+				break;
+			}
+		}
+		if (next != NULL) path.push_back(next);
+		node = next;
+	}
+	return selectedVertices;
+}
+
+static bool footprintHolds(float x0, float z0, float x1, float z1, float x, float z) {
+	return x0 < x && x < x1 && z0 < z && z < z1;
+}
+
+// Adds the level below the last one of the column through (x, z).  Fails
+// once nothing below divides any further, or if (x, z) is on a face between
+// two children, where the ray test has to decide.
+bool OctreeCursor::extendColumn(float x, float z) {
+	ColumnLevel next;
+	bool divided = false;
+	for (Box *node : column.back().nodes) {
+		if (node->vertexIndices.size() == 1) {
+			next.nodes.push_back(node);
+			continue;
+		}
+		for (Box &child : node->children) {
+			float x0 = child.parameters[0].x(), z0 = child.parameters[0].z();
+			float x1 = child.parameters[1].x(), z1 = child.parameters[1].z();
+			if (x < x0 || x > x1 || z < z0 || z > z1) continue;
+			if (!footprintHolds(x0, z0, x1, z1, x, z)) return false;
+			if (divided && (x0 != next.x0 || z0 != next.z0 || x1 != next.x1 || z1 != next.z1)) return false;
+			next.x0 = x0;
+			next.z0 = z0;
+			next.x1 = x1;
+			next.z1 = z1;
+			next.nodes.push_back(&child);
+			divided = true;
+		}
+	}
+	if (!divided) return false;
+	column.push_back(next);
+	return true;
+}
+
+// Rays straight down keep the column of nodes over the footprint of the
+// last ray, level by level.  A ray whose (x, z) is inside the footprint of
+// a level can only hit nodes of that level's column and their ancestors,
+// and it hits the ancestors of any column node it hits, so the search
+// starts from the column nodes of the deepest level still holding (x, z).
+vector<int> OctreeCursor::getIntersectingVertices(Octree &t, const Ray &ray) {
+	attach(t);
+	if (ray.direction.x() != 0 || ray.direction.z() != 0) return t.getIntersectingVertices(t.root, ray);
+
+	float x = ray.origin.x(), z = ray.origin.z();
+	if (column.empty()) {
+		ColumnLevel top;
+		top.x0 = t.root.parameters[0].x();
+		top.z0 = t.root.parameters[0].z();
+		top.x1 = t.root.parameters[1].x();
+		top.z1 = t.root.parameters[1].z();
+		top.nodes.push_back(&t.root);
+		column.push_back(top);
+	}
+	while (!column.empty()) {
+		const ColumnLevel &level = column.back();
+		if (footprintHolds(level.x0, level.z0, level.x1, level.z1, x, z)) break;
+		column.pop_back();
+	}
+	// outside the tree or on its border
+	if (column.empty()) return t.getIntersectingVertices(t.root, ray);
+	while (extendColumn(x, z)) { }
+
+	vector<int> selectedVertices;
+	for (Box *node : column.back().nodes) {
+		if (node->intersect(ray, 0, 100)) t.intersectingVertices(*node, ray, selectedVertices);
+		else node->containsSelectedVertex = false;
+	}
+	return selectedVertices;
+}
+
+// return a Mesh Bounding Box for the entire Mesh
+Box Octree::meshBounds(const ofMesh & mesh) {
+	int n = mesh.getNumVertices();
+	ofVec3f v = mesh.getVertex(0);
+	ofVec3f max = v;
+	ofVec3f min = v;
+	for (int i = 1; i < n; i++) {
+		ofVec3f v = mesh.getVertex(i);
+
+		if (v.x > max.x) max.x = v.x;
+		else if (v.x < min.x) min.x = v.x;
+
+		if (v.y > max.y) max.y = v.y;
+		else if (v.y < min.y) min.y = v.y;
+
+		if (v.z > max.z) max.z = v.z;
+		else if (v.z < min.z) min.z = v.z;
+	}
+	// a flat patch (e.g. one terrain tile) still needs a box with volume
+	for (int k = 0; k < 3; k++)
+		if (max[k] <= min[k]) max[k] = min[k] + 1e-3;
+	return Box(min, max);
+}
+
+//  Subdivide a Box into eight(8) equal size boxes, return them in boxList;
+void Octree::subDivideBox8(const Box &box, BoxList & boxList) {
+	Vector3 min = box.parameters[0];
+	Vector3 max = box.parameters[1];
+	Vector3 size = max - min;
+	Vector3 center = size / 2 + min;
+	float xdist = (max.x() - min.x()) / 2;
+	float ydist = (max.y() - min.y()) / 2;
+	float zdist = (max.z() - min.z()) / 2;
+	Vector3 h = Vector3(0, ydist, 0);
+
+	//  generate ground floor
+	Box b[8];
+	b[0] = Box(min, center);
+	b[1] = Box(b[0].min() + Vector3(xdist, 0, 0), b[0].max() + Vector3(xdist, 0, 0));
+	b[2] = Box(b[1].min() + Vector3(0, 0, zdist), b[1].max() + Vector3(0, 0, zdist));
+	b[3] = Box(b[2].min() + Vector3(-xdist, 0, 0), b[2].max() + Vector3(-xdist, 0, 0));
+
+	boxList.clear();
+	for (int i = 0; i < 4; i++)
+		boxList.push_back(b[i]);
+
+	// generate second story
+	for (int i = 4; i < 8; i++) {
+		b[i] = Box(b[i - 4].min() + h, b[i - 4].max() + h);
+		boxList.push_back(b[i]);
+	}
+}
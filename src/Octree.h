@@ -7,12 +7,86 @@
 class Octree {
     int num_levels;
 public:
-    Octree() { }
+    Octree() { mesh = NULL; highestDepth = 0; generation = newGeneration(); }
     
     int getNumofLevels() { return num_levels; }
     void addLevel() { num_levels++; }
     
+    // build the tree over the vertices of "mesh"; the mesh must outlive the tree
+    void create(const ofMesh &mesh, int maxDepth);
+    
+    // queries, return vertex indices into the mesh
+    vector<int> getCollision(Box &box, const ofVec3f &point);
+    vector<int> getIntersectingVertices(Box &box, const Ray &ray);
+
+    // where getCollision(box, point) ends: the node holding the vertex it
+    // finds, else the deepest node holding point, NULL if box doesn't.
+    // Marks nothing, so several threads can share the tree.
+    const Box *collisionNode(const Box &box, const ofVec3f &point) const;
+    
+    // terrain surface under (x, z): height and normal of the vertex nearest to
+    // the column. returns the leaf holding it, NULL if outside the tree
+    const Box *surfaceAt(float x, float z, float &height, ofVec3f &normal) const;
+    
+    // binary dump of the tree, for the tiled terrain store.  read() attaches
+    // the tree to "mesh", which must be the mesh it was built over.
+    void write(ostream &out) const;
+    bool read(istream &in, const ofMesh &mesh);
+    
+    static Box meshBounds(const ofMesh &);
+    static void subDivideBox8(const Box &b, BoxList &boxList);
+    
     Box root;
+    const ofMesh *mesh;
+    int highestDepth;   // highest depth of leaves, updated within create()
+    int generation;     // new with every create() and read(), and unique across
+                        // trees, so (tree, generation) names one build even if
+                        // a freed tree's address is reused
+    
+private:
+    static int newGeneration();
+    friend class OctreeCursor;
+    void generateTreeNodes(Box &node, const int *indices, int count, int currentDepth, int maxDepth);
+    void intersectingVertices(Box &box, const Ray &ray, vector<int> &selectedVertices);
+    void collidingVertices(Box &box, const ofVec3f &point, vector<int> &selectedVertices);
+    static void writeNode(ostream &out, const Box &node);
+    bool readNode(istream &in, Box &node, int depth);
+    void nearestInColumn(const Box &node, float x, float z, int &best, float &bestDist, const Box *&bestLeaf) const;
+};
+
+// Temporally coherent queries.  A cursor remembers where the last query
+// ended in the tree and starts the next one from the nearest node that
+// still holds the query, so a point or a ray that moves a little per frame
+// touches a few nodes instead of a full root to leaf path.  Results are the
+// same as the queries from the root, in the same order.  Each cursor serves
+// one stream of queries; it notices when the tree is rebuilt and starts
+// over from the root.
+class OctreeCursor {
+public:
+    OctreeCursor() { tree = NULL; generation = -1; }
+
+    // as tree.getCollision(tree.root, point)
+    vector<int> getCollision(Octree &tree, const ofVec3f &point);
+    // as tree.getIntersectingVertices(tree.root, ray); rays straight down
+    // use the cursor, others go from the root
+    vector<int> getIntersectingVertices(Octree &tree, const Ray &ray);
+    void reset();
+
+private:
+    // the nodes at one level of the tree whose footprint holds the column
+    // of the last ray, in the order the search from the root meets them.
+    // Leaves above the level are carried down in their place.
+    struct ColumnLevel {
+        float x0, z0, x1, z1;   // footprint
+        vector<Box *> nodes;
+    };
+    void attach(Octree &tree);
+    bool extendColumn(float x, float z);
+
+    Octree *tree;
+    int generation;
+    vector<Box *> path;             // root to the deepest node holding the last point
+    vector<ColumnLevel> column;     // root level down
 };
 
 #endif 
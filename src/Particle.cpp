@@ -13,6 +13,7 @@ Particle::Particle() {
 	birthtime = 0;
 	radius = .1;
 	damping = .99;
+	verletDt = 0;
 	mass = 1;
     color = ofColor::red;
     colorLifetime = 1;
@@ -37,7 +38,7 @@ void Particle::draw() {
 	ofDrawSphere(position, radius);
 }
 
-// write your own integrator here.. (hint: it's only 3 lines of code)
+// integrate using the current frame interval
 //
 void Particle::integrate() {
 
@@ -48,22 +49,47 @@ void Particle::integrate() {
 
 	// interval for this step
 	//
-	float dt = 1.0 / framerate;
+	integrate(1.0 / framerate);
+}
 
-	// update position based on velocity
-	//
-	position += (velocity * dt);
+// advance the particle by dt seconds using the accumulated forces.
+// RK4 is handled by ParticleSystem since it has to re-evaluate forces;
+// called directly it falls back to semi-implicit Euler.
+//
+void Particle::integrate(float dt, IntegratorType type) {
 
 	// update acceleration with accumulated paritcles forces
 	// remember :  (f = ma) OR (a = 1/m * f)
 	//
 	ofVec3f accel = acceleration;    // start with any acceleration already on the particle
 	accel += (forces * (1.0 / mass));
-	velocity += accel * dt;
 
-	// add a little damping for good measure
+	switch (type) {
+	case EulerIntegrator:
+		// explicit Euler: position uses the old velocity
+		position += (velocity * dt);
+		velocity += accel * dt;
+		break;
+	case VerletIntegrator:
+		// velocity Verlet in kick-drift form.  The closing half kick of
+		// the previous step needs this step's acceleration, so it is
+		// applied here; between steps velocity is the half-step value.
+		velocity += accel * (0.5 * (verletDt + dt));
+		position += (velocity * dt);
+		verletDt = dt;
+		break;
+	case SemiImplicitEulerIntegrator:
+	case RK4Integrator:
+		// symplectic Euler: kick first, then drift with the new velocity
+		velocity += accel * dt;
+		position += (velocity * dt);
+		break;
+	}
+
+	// add a little damping for good measure (scaled so it does not
+	// depend on the step size)
 	//
-	velocity *= damping;
+	velocity *= dampingFactor(damping, dt);
 
 	// clear forces on particle (they get re-added each step)
 	//
@@ -1,9 +1,15 @@
 #pragma once
 
 #include "ofMain.h"
+#include "MemoryTags.h"
 
 class ParticleForceField;
 
+// Integration schemes selectable per ParticleSystem.  RK4 needs to
+// re-evaluate forces mid-step, so the ParticleSystem drives it.
+//
+typedef enum { EulerIntegrator, SemiImplicitEulerIntegrator, VerletIntegrator, RK4Integrator } IntegratorType;
+
 class Particle {
 public:
 	Particle();
@@ -17,11 +23,24 @@ public:
 	float   lifespan;
 	float   radius;
 	float   birthtime;
+	float   verletDt;     // previous step for velocity Verlet (0 = not started)
 	void    integrate();
+	void    integrate(float dt, IntegratorType type = EulerIntegrator);
 	void    draw();
 	float   age();        // sec
 	ofColor color;
     float   colorLifetime; // sec
-};
 
+	// damping is specified per 1/60 sec frame; this scales it to any step
+	static float dampingFactor(float damping, float dt) {
+		return powf(damping, dt * 60.0f);
+	}
+
+	// the same damping as a continuous drag, dv/dt = -k v
+	static float dragCoefficient(float damping) {
+		return -60.0f * logf(damping);
+	}
+};
 
+// particle storage, counted as particle memory
+typedef TaggedVector<Particle, MemParticles> ParticleList;
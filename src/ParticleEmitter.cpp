@@ -1,6 +1,7 @@
 
 
 #include "ParticleEmitter.h"
+#include "Profiler.h"
 
 ParticleEmitter::ParticleEmitter() {
 	sys = new ParticleSystem();
@@ -37,6 +38,9 @@ void ParticleEmitter::init() {
 	oneShot = false;
 	fired = false;
 	lastSpawned = 0;
+	budget = 0;
+	maxCatchUp = 8 * 1000.0 / 60;
+	seed = (uint32_t) ofRandom(0, 1 << 30);
 	radius = 1;
 	particleRadius = .1;
 	visible = true;
@@ -46,6 +50,7 @@ void ParticleEmitter::init() {
 	damping = .99;
 	particleColor = ofColor::red;
 	position = ofVec3f(0, 0, 0);
+	compact = NULL;
 }
 
 ofVec3f ParticleEmitter::getPosition() {
@@ -76,6 +81,7 @@ void ParticleEmitter::draw() {
 void ParticleEmitter::start() {
 	started = true;
 	lastSpawned = ofGetElapsedTimeMillis();
+	budget = 1;     // first group goes out on the next update
 }
 
 void ParticleEmitter::stop() {
@@ -83,6 +89,48 @@ void ParticleEmitter::stop() {
 	fired = false;
 }
 void ParticleEmitter::update() {
+	spawnDue();
+	if (compact) {
+		moveToCompact();
+		compact->update();
+	}
+	else sys->update();
+}
+
+// for callers with their own clock, such as the simulation thread
+void ParticleEmitter::update(float dt) {
+	spawnDue();
+	if (compact) {
+		moveToCompact();
+		compact->update(dt);
+	}
+	else sys->update(dt);
+}
+
+void ParticleEmitter::setCompact(CompactParticleSystem *c) {
+	if (c == compact) return;
+	if (compact) {
+		compact->decodeAll(sys->particles);
+		compact->clear();
+	}
+	compact = c;
+	if (compact) moveToCompact();
+}
+
+// hand what was spawned into sys to the compact store, with the attributes
+// the emitter gives all its particles.  Stored positions follow the emitter.
+void ParticleEmitter::moveToCompact() {
+	ParticleParams &params = compact->params;
+	params.mass = mass;
+	params.damping = damping;
+	params.radius = particleRadius;
+	params.lifespan = lifespan;
+	compact->setOrigin(position);
+	compact->absorb(*sys);
+}
+
+// spawn the groups owed since the last update
+void ParticleEmitter::spawnDue() {
 
 	float time = ofGetElapsedTimeMillis();
 
@@ -91,8 +139,7 @@ void ParticleEmitter::update() {
 
 			// spawn a new particle(s)
 			//
-			for (int i = 0; i < groupSize; i++)
-				spawn(time);
+			spawnBatch(groupSize, time);
 
 			lastSpawned = time;
 		}
@@ -100,50 +147,135 @@ void ParticleEmitter::update() {
 		stop();
 	}
 
-	else if (((time - lastSpawned) > (1000.0 / rate)) && started) {
+	else if (started) {
 
-		// spawn a new particle(s)
+		// spawn as many groups as the elapsed time pays for; the fraction
+		// left over carries to the next update so any rate comes out exact.
+		// Like ofApp::advance, a stall past maxCatchUp drops the rest
+		// instead of spawning it all in one frame.
 		//
-		for (int i = 0; i < groupSize; i++)
-			spawn(time);
+		budget += min(time - lastSpawned, maxCatchUp) / 1000.0 * rate;
+		int groups = (int) budget;
+		budget -= groups;
+		if (groups > 0)
+			spawnBatch(groups * groupSize, time);
 
 		lastSpawned = time;
 	}
-
-	sys->update();
 }
 
 // spawn a single particle.  time is current time of birth
 //
 void ParticleEmitter::spawn(float time) {
+	spawnBatch(1, time);
+}
+
+// Random numbers for spawnBatch: a stateless integer hash of (seed + i).
+// No lane depends on another so these loops vectorize, and the stream is
+// reproducible from the seed alone.
+//
+static inline uint32_t hashIndex(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+// n uniform floats in [lo, hi)
+static void fillUniform(float *out, int n, uint32_t seed, float lo, float hi) {
+	float scale = (hi - lo) / 16777216.0f;
+	for (int i = 0; i < n; i++)
+		out[i] = lo + (int32_t) (hashIndex(seed + i) >> 8) * scale;
+}
+
+// parabolic sine with one refinement step, x in [-PI, PI], error ~0.001.
+// Branch free so the batch loops vectorize (libm sin/cos do not).
+static inline float fastSin(float x) {
+	const float B = 4 / PI;
+	const float C = -4 / (PI * PI);
+	float y = B * x + C * x * fabsf(x);
+	return 0.225f * (y * fabsf(y) - y) + y;
+}
+
+static inline float fastCos(float x) {
+	const float pi = PI;
+	x += pi / 2;
+	x -= (x > pi) ? 2 * pi : 0;
+	return fastSin(x);
+}
+
+// spawn n particles straight into the particle system.  Attributes shared
+// by the whole batch are copied from one prototype; positions, velocities
+// and lifespans are generated in batches of random numbers.
+//
+void ParticleEmitter::spawnBatch(int n, float time) {
+	if (n <= 0) return;
+	PROFILE_SCOPE("emitter spawn");
+
+	Particle proto;
+	proto.lifespan = lifespan;
+	proto.birthtime = time;
+	proto.radius = particleRadius;
+	proto.mass = mass;
+	proto.damping = damping;
+	proto.color = particleColor;
+	proto.position = position;
+	proto.velocity = velocity;
+
+	ParticleList &store = sys->particles;
+	int first = store.size();
+	store.insert(store.end(), n, proto);
+	Particle *p = &store[first];
 
-	Particle particle;
+	rand0.resize(n);
+	rand1.resize(n);
+	rand2.resize(n);
+	float *r0 = &rand0[0], *r1 = &rand1[0], *r2 = &rand2[0];
 
 	// set initial velocity and position
 	// based on emitter type
 	//
 	switch (type) {
 	case RadialEmitter:
+	case SphereEmitter:
 	{
-		ofVec3f dir = ofVec3f(ofRandom(-1, 1), ofRandom(-1, 1), ofRandom(-1, 1));
+		// uniform directions: z uniform in [-1, 1], angle uniform around z
 		float speed = velocity.length();
-		particle.velocity = dir.getNormalized() * speed;
-		particle.position.set(position);
+		fillUniform(r0, n, seed, -1, 1);
+		fillUniform(r1, n, seed + n, -PI, PI);
+		seed += 2 * n;
+		for (int i = 0; i < n; i++) {
+			float s = sqrtf(max(1 - r0[i] * r0[i], 0.0f));
+			r2[i] = s * fastSin(r1[i]);
+			r1[i] = s * fastCos(r1[i]);
+		}
+		float offset = (type == SphereEmitter) ? radius : 0;
+		for (int i = 0; i < n; i++) {
+			ofVec3f dir(r1[i], r2[i], r0[i]);
+			p[i].velocity = dir * speed;
+			p[i].position = position + dir * offset;
+		}
 	}
 	break;
-	case SphereEmitter:
-		break;
 	case DirectionalEmitter:
-		particle.velocity = velocity;
-		particle.position.set(position);
 		break;
 	case DiscEmitter:
 	{
-		particle.velocity = velocity;
-		int angle = ofRandom(0, 360);
-		ofVec3f pos = ofVec3f(position.x, position.y, position.z);
-		ofVec3f mag = ofVec3f(sin(angle) * ofRandom(0, discradius), 0, cos(angle) * ofRandom(0, discradius));
-		particle.position.set(pos + mag);
+		// uniform over the disc: sqrt of a uniform radius, uniform angle
+		fillUniform(r0, n, seed, 0, 1);
+		fillUniform(r1, n, seed + n, -PI, PI);
+		seed += 2 * n;
+		for (int i = 0; i < n; i++) {
+			float r = discradius * sqrtf(r0[i]);
+			r0[i] = r * fastSin(r1[i]);
+			r1[i] = r * fastCos(r1[i]);
+		}
+		for (int i = 0; i < n; i++) {
+			p[i].position.x += r0[i];
+			p[i].position.z += r1[i];
+		}
 	}
 		break;
 	}
@@ -151,16 +283,9 @@ void ParticleEmitter::spawn(float time) {
 	// other particle attributes
 	//
 	if (randomLife) {
-		particle.lifespan = ofRandom(lifeMinMax.x, lifeMinMax.y);
+		fillUniform(r2, n, seed, lifeMinMax.x, lifeMinMax.y);
+		seed += n;
+		for (int i = 0; i < n; i++)
+			p[i].lifespan = r2[i];
 	}
-	else particle.lifespan = lifespan;
-	particle.birthtime = time;
-	particle.radius = particleRadius;
-	particle.mass = mass;
-	particle.damping = damping;
-	particle.color = particleColor;
-
-	// add to system
-	//
-	sys->add(particle);
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "TransformObject.h"
 #include "ParticleSystem.h"
+#include "CompactParticles.h"
 
 typedef enum { DirectionalEmitter, RadialEmitter, SphereEmitter, DiscEmitter } EmitterType;
 
@@ -30,10 +31,19 @@ public:
 	void setMass(float m) { mass = m; }
 	void setColor(ofColor c) { particleColor = c; }
 	void setDamping(float d) { damping = d; }
-	void update();
+	void setSeed(uint32_t s) { seed = s; }
+	void update();              // particles advance by one frame at the frame rate
+	void update(float dt);
+	// keep the particles in a compressed store instead of sys (NULL: back
+	// to sys).  The live ones move across; sys still holds the forces and
+	// collision settings, and new particles pass through it.
+	void setCompact(CompactParticleSystem *c);
+	int particleCount() const { return compact ? compact->size() : (int) sys->particles.size(); }
 	void spawn(float time);
+	void spawnBatch(int n, float time);
 	ParticleSystem *sys;
-	float rate;         // per sec
+	CompactParticleSystem *compact;
+	float rate;         // groups per sec
 	bool oneShot;
 	bool fired;
 	bool randomLife;
@@ -43,7 +53,9 @@ public:
 	float mass;
 	float damping;
 	bool started;
-	float lastSpawned;  // ms
+	float lastSpawned;  // ms, last time the spawn budget was charged
+	float budget;       // groups owed but not yet spawned (fractional)
+	float maxCatchUp;   // ms, most elapsed time one update pays for
 	float particleRadius;
 	ofColor particleColor;
 	float radius;
@@ -52,5 +64,12 @@ public:
 	int groupSize;      // number of particles to spawn in a group
 	bool createdSys;
 	EmitterType type;
+	uint32_t seed;      // random stream for spawnBatch, advanced per particle
 
+private:
+	void spawnDue();
+	void moveToCompact();
+
+	// per batch scratch, kept to avoid reallocating
+	vector<float> rand0, rand1, rand2;
 };
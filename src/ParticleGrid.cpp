@@ -0,0 +1,77 @@
+
+#include "ParticleGrid.h"
+
+// One pass over the (large) particles, copying the positions out so the
+// sort only reads a dense array.
+void ParticleGrid::build(const ParticleList &particles) {
+	packedPos.resize(particles.size());
+	for (int i = 0; i < particles.size(); i++) packedPos[i] = particles[i].position;
+	build(packedPos.data(), packedPos.size());
+}
+
+// Counting sort of the particles by bucket.  The table is sized to about
+// the particle count: big enough that few cells share a bucket.  Counting
+// into it directly misses the cache on every particle once it outgrows it,
+// so the top bits of the bucket are sorted first, into partitions whose
+// slice of the table (1 << fineBits counters) stays in cache.
+void ParticleGrid::build(const ofVec3f *positions, int n) {
+	count = n;
+	uint32_t size = 1024;
+	int bits = 10;
+	while (size < count) {
+		size <<= 1;
+		bits++;
+	}
+	mask = size - 1;
+	fineBits = min(bits, 15);
+	int partitions = size >> fineBits;
+	uint32_t fineMask = (1u << fineBits) - 1;
+
+	invCellSize = 1.0 / cellSize;
+	keys.resize(count);
+	partitionStart.assign(partitions + 1, 0);
+	for (int i = 0; i < count; i++) {
+		const ofVec3f &p = positions[i];
+		uint32_t b = bucketOf(cellCoord(p.x), cellCoord(p.y), cellCoord(p.z));
+		keys[i] = (uint64_t) i << 32 | b;
+		partitionStart[(b >> fineBits) + 1]++;
+	}
+	for (int c = 0; c < partitions; c++)
+		partitionStart[c + 1] += partitionStart[c];
+
+	// into partitions, using "next" as the running insert position of each
+	const vector<uint64_t> *byPartition = &keys;
+	if (partitions > 1) {
+		partitioned.resize(count);
+		next.assign(partitionStart.begin(), partitionStart.end() - 1);
+		for (int i = 0; i < count; i++)
+			partitioned[next[(uint32_t) keys[i] >> fineBits]++] = keys[i];
+		byPartition = &partitioned;
+	}
+
+	// each partition by the rest of the bucket, then the positions in order
+	bucketStart.resize(size + 1);
+	sortedIndex.resize(count);
+	next.resize(fineMask + 1);
+	for (int c = 0; c < partitions; c++) {
+		const uint64_t *k = byPartition->data();
+		int lo = partitionStart[c], hi = partitionStart[c + 1];
+		std::fill(next.begin(), next.end(), 0);
+		for (int e = lo; e < hi; e++) next[(uint32_t) k[e] & fineMask]++;
+		int *starts = &bucketStart[c << fineBits];
+		int at = lo;
+		for (uint32_t b = 0; b <= fineMask; b++) {
+			int n = next[b];
+			starts[b] = next[b] = at;
+			at += n;
+		}
+		for (int e = lo; e < hi; e++) sortedIndex[next[(uint32_t) k[e] & fineMask]++] = k[e] >> 32;
+	}
+	bucketStart[size] = count;
+	sortedPos.resize(count);
+	for (int e = 0; e < count; e++) sortedPos[e] = positions[sortedIndex[e]];
+}
+
+void ParticleGrid::queryRadius(const ofVec3f &point, float radius, vector<int> &result) const {
+	forEachNear(point, radius, [&result](int i, const ofVec3f &) { result.push_back(i); });
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "ofMain.h"
+#include "Particle.h"
+
+//  Uniform spatial hash over particle positions.  Rebuilt from scratch with
+//  a counting sort: particles are bucketed by the hash of their cell and
+//  their positions copied out in bucket order, so a query only touches the
+//  buckets of the cells it overlaps.  Different cells can share a bucket,
+//  queries always check the actual distance.
+//
+//  The bucket table is sized to the particle count, too big for the cache
+//  at 1M particles, so the sort runs in two levels: a pass on the top bits
+//  of the bucket splits the particles into partitions, then each partition
+//  is sorted on the rest against its own cache sized slice of the table.
+//
+class ParticleGrid {
+public:
+	ParticleGrid() { cellSize = 1; invCellSize = 1; count = 0; mask = 0; fineBits = 0; }
+	void setCellSize(float s) { cellSize = s; invCellSize = 1.0 / s; }
+	void build(const ParticleList &particles);
+	void build(const ofVec3f *positions, int n);
+	void clear() { count = 0; }
+
+	// indices of particles within "radius" of point (appended to result)
+	void queryRadius(const ofVec3f &point, float radius, vector<int> &result) const;
+
+	// call fn(index, position) for every particle within "radius" of point
+	template <typename F>
+	void forEachNear(const ofVec3f &point, float radius, F fn) const;
+
+	float cellSize;
+	int count;                     // number of particles indexed
+
+private:
+	uint32_t bucketOf(int cx, int cy, int cz) const {
+		return ((uint32_t)cx * 73856093u ^ (uint32_t)cy * 19349663u ^ (uint32_t)cz * 83492791u) & mask;
+	}
+	int cellCoord(float v) const { return (int)floorf(v * invCellSize); }
+
+	float invCellSize;
+	uint32_t mask;
+	int fineBits;                  // bucket bits sorted within a partition
+	vector<int> bucketStart;       // first entry of each bucket, plus an end marker
+	vector<int> sortedIndex;       // particle index for each entry
+	vector<ofVec3f> sortedPos;     // particle position for each entry
+
+	// scratch for build(): index << 32 | bucket, in particle order and
+	// then by partition
+	vector<uint64_t> keys, partitioned;
+	vector<int> partitionStart;
+	vector<int> next;
+	vector<ofVec3f> packedPos;     // positions copied out of a ParticleList
+};
+
+template <typename F>
+void ParticleGrid::forEachNear(const ofVec3f &point, float radius, F fn) const {
+	if (count == 0) return;
+	float r2 = radius * radius;
+	int x0 = cellCoord(point.x - radius), x1 = cellCoord(point.x + radius);
+	int y0 = cellCoord(point.y - radius), y1 = cellCoord(point.y + radius);
+	int z0 = cellCoord(point.z - radius), z1 = cellCoord(point.z + radius);
+
+	// a query can hash two of its cells to the same bucket.  Small queries
+	// remember the buckets already scanned, large ones check each hit
+	// against the cell being scanned, so nothing is reported twice
+	uint32_t seen[64];
+	int nseen = 0;
+	bool track = (x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1) <= 64;
+
+	for (int cx = x0; cx <= x1; cx++) {
+		for (int cy = y0; cy <= y1; cy++) {
+			for (int cz = z0; cz <= z1; cz++) {
+				uint32_t b = bucketOf(cx, cy, cz);
+				if (track) {
+					bool dup = false;
+					for (int k = 0; k < nseen; k++) dup = dup || seen[k] == b;
+					if (dup) continue;
+					seen[nseen++] = b;
+				}
+				for (int e = bucketStart[b]; e < bucketStart[b + 1]; e++) {
+					const ofVec3f &p = sortedPos[e];
+					if (p.squareDistance(point) > r2) continue;
+					// untracked: only report the entry from its own cell
+					if (!track && (cellCoord(p.x) != cx || cellCoord(p.y) != cy || cellCoord(p.z) != cz)) continue;
+					fn(sortedIndex[e], p);
+				}
+			}
+		}
+	}
+}
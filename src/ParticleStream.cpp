@@ -0,0 +1,166 @@
+
+#include "ParticleStream.h"
+#include "Particle.h"
+
+void packParticleVertices(const ParticleList &particles, ParticleVertex *out, int count) {
+	for (int i = 0; i < count; i++) {
+		const Particle &p = particles[i];
+		out[i].position[0] = p.position.x;
+		out[i].position[1] = p.position.y;
+		out[i].position[2] = p.position.z;
+		out[i].birth = p.birthtime / 1000.0;
+	}
+}
+
+ParticleStream::ParticleStream() : bufferMemory(MemStaging) {
+	buffer = 0;
+	capacity = 0;
+	region = 0;
+	written = 0;
+	persistent = false;
+	writing = false;
+	mapped = NULL;
+	for (int i = 0; i < numRegions; i++) fences[i] = 0;
+}
+
+ParticleStream::~ParticleStream() {
+	clear();
+}
+
+void ParticleStream::clear() {
+	for (int i = 0; i < numRegions; i++) {
+#ifndef TARGET_OPENGLES
+		if (fences[i]) glDeleteSync(fences[i]);
+#endif
+		fences[i] = 0;
+	}
+	if (buffer) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (mapped) glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	mapped = NULL;
+	capacity = 0;
+	bufferMemory.set(0);
+}
+
+// allocate all three regions up front
+void ParticleStream::setup(int maxVertices) {
+	clear();
+	capacity = maxVertices;
+	GLsizeiptr size = (GLsizeiptr) sizeof(ParticleVertex) * capacity * numRegions;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#ifdef TARGET_OPENGLES
+	persistent = false;
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	staging.resize(capacity);
+#else
+	persistent = GLEW_ARB_buffer_storage;
+	if (persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		mapped = (ParticleVertex *) glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		if (mapped == NULL) {
+			// some drivers advertise the extension but refuse the mapping;
+			// a buffer made with glBufferStorage is immutable, so start over
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			persistent = false;
+		}
+	}
+	if (!persistent)
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	bufferMemory.set(size);
+
+	ofLogNotice("ParticleStream") << capacity << " vertices x " << numRegions << " regions, "
+		<< (persistent ? "persistent mapping" : "mapped per frame");
+}
+
+// block until the GPU has finished drawing from region r
+void ParticleStream::waitForRegion(int r) {
+#ifndef TARGET_OPENGLES
+	if (fences[r] == 0) return;
+	GLenum status = glClientWaitSync(fences[r], 0, 0);
+	while (status == GL_TIMEOUT_EXPIRED)
+		status = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	glDeleteSync(fences[r]);
+	fences[r] = 0;
+#endif
+}
+
+ParticleVertex *ParticleStream::begin(int &count) {
+	if (buffer == 0) {
+		count = 0;
+		return NULL;
+	}
+	count = min(count, capacity);
+	region = (region + 1) % numRegions;
+	waitForRegion(region);
+	writing = true;
+
+	if (persistent)
+		return mapped + (size_t) region * capacity;
+
+#ifdef TARGET_OPENGLES
+	return &staging[0];
+#else
+	// the fence already guarantees the GPU is done with this range
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	void *p = glMapBufferRange(GL_ARRAY_BUFFER, sizeof(ParticleVertex) * (size_t) region * capacity,
+		sizeof(ParticleVertex) * capacity,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return (ParticleVertex *) p;
+#endif
+}
+
+void ParticleStream::end(int count) {
+	if (!writing) return;
+	writing = false;
+	written = min(count, capacity);
+	if (persistent) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#ifdef TARGET_OPENGLES
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(ParticleVertex) * (size_t) region * capacity,
+		sizeof(ParticleVertex) * written, &staging[0]);
+#else
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleStream::draw(GLenum mode) {
+	if (buffer == 0 || written == 0) return;
+
+	size_t base = sizeof(ParticleVertex) * (size_t) region * capacity;
+	GLsizei stride = sizeof(ParticleVertex);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+#ifdef TARGET_OPENGLES
+	// the whole vertex goes in as a vec4 "position" (default location 0
+	// bound by ofShader), w carries the birth time
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void *) base);
+	glDrawArrays(mode, 0, written);
+	glDisableVertexAttribArray(0);
+#else
+	// the whole vertex goes in as gl_Vertex, w carries the birth time
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(4, GL_FLOAT, stride, (void *) base);
+	glDrawArrays(mode, 0, written);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	if (fences[region]) glDeleteSync(fences[region]);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
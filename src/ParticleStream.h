@@ -0,0 +1,59 @@
+#pragma once
+#include "ofMain.h"
+#include "Particle.h"
+
+//  Streaming vertex buffer for the particle cloud.
+//
+//  One buffer holding three regions, used round robin: the CPU fills one
+//  region while the GPU may still be drawing from the other two.  A fence
+//  after each draw tells us when a region can be written again.  Where
+//  ARB_buffer_storage is available the buffer is mapped once, persistently,
+//  and vertices are written straight into it; otherwise each region is
+//  mapped unsynchronized for the frame (GLES: written with glBufferSubData
+//  from a staging copy).  Nothing is reallocated after setup().
+//
+//  Vertices are 16 bytes: position and birth time.  Colour, fade and point
+//  size are worked out from the age in shaders/shader.vert.
+//
+struct ParticleVertex {
+	float position[3];
+	float birth;         // sec, same clock as the shader's "time" uniform
+};
+
+// fill "out" with the first "count" particles, no GL involved
+void packParticleVertices(const ParticleList &particles, ParticleVertex *out, int count);
+
+class ParticleStream {
+public:
+	ParticleStream();
+	~ParticleStream();
+	void setup(int maxVertices);
+	void clear();
+
+	// pointer to room for "count" vertices in the next free region, count is
+	// clamped to the capacity.  Must be followed by end() with the number written.
+	ParticleVertex *begin(int &count);
+	void end(int count);
+
+	// draw the region written last, then fence it
+	void draw(GLenum mode);
+
+	int getCapacity() const { return capacity; }
+	bool isPersistent() const { return persistent; }
+
+	static const int numRegions = 3;
+
+private:
+	void waitForRegion(int r);
+
+	GLuint buffer;
+	int capacity;          // vertices per region
+	int region;            // region being written / last written
+	int written;           // vertices in that region
+	bool persistent;
+	bool writing;
+	ParticleVertex *mapped;          // persistent mapping of the whole buffer
+	TaggedVector<ParticleVertex, MemStaging> staging;  // GLES only
+	MemoryCharge bufferMemory;       // the GL buffer
+	GLsync fences[numRegions];
+};
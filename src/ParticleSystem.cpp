@@ -1,5 +1,7 @@
 
 #include "ParticleSystem.h"
+#include "Util.h"
+#include "Profiler.h"
 
 void ParticleSystem::add(const Particle &p) {
 	particles.push_back(p);
@@ -11,6 +13,7 @@ void ParticleSystem::addForce(ParticleForce *f) {
 
 void ParticleSystem::remove(int i) {
 	particles.erase(particles.begin() + i);
+	grid.clear();
 }
 
 void ParticleSystem::setLifespan(float l) {
@@ -25,29 +28,32 @@ void ParticleSystem::reset() {
 	}
 }
 
+// advance one frame at the current frame rate
 void ParticleSystem::update() {
+	float framerate = ofGetFrameRate();
+	if (framerate < 1.0) return;
+	update(1.0 / framerate);
+}
+
+void ParticleSystem::update(float dt) {
+	PROFILE_SCOPE("particle update");
 	// check if empty and just return
 	if (particles.size() == 0) return;
 
-	vector<Particle>::iterator p = particles.begin();
-	vector<Particle>::iterator tmp;
-
 	// check which particles have exceed their lifespan and delete
-	// from list.  When deleting multiple objects from a vector while
-	// traversing at the same time, we need to use an iterator.
-	while (p != particles.end()) {
-		if (p->lifespan != -1 && p->age() > p->lifespan) {
-			tmp = particles.erase(p);
-			p = tmp;
-		}
-		else p++;
+	// them from the list in a single pass
+	dead.assign(particles.size(), 0);
+	for (int i = 0; i < particles.size(); i++) {
+		if (particles[i].lifespan != -1 && particles[i].age() > particles[i].lifespan)
+			dead[i] = 1;
 	}
+	removeMarked();
 
-	// update forces on all particles first 
-	for (int i = 0; i < particles.size(); i++) {
+	// update forces on all particles first, a force at a time
+	if (particles.size() > 0) {
 		for (int k = 0; k < forces.size(); k++) {
 			if (!forces[k]->applied)
-				forces[k]->updateForce( &particles[i] );
+				forces[k]->updateForces(&particles[0], particles.size());
 		}
 	}
 
@@ -59,13 +65,190 @@ void ParticleSystem::update() {
 	}
 
 	// integrate all the particles in the store
-	for (int i = 0; i < particles.size(); i++)
-		particles[i].integrate();
+	if (integrator == RK4Integrator) {
+		for (int i = 0; i < particles.size(); i++)
+			integrateRK4(particles[i], dt);
+	}
+	else {
+		for (int i = 0; i < particles.size(); i++)
+			particles[i].integrate(dt, integrator);
+	}
+
+	if (terrain != NULL && collision != NoCollision)
+		collideTerrain();
+
+	if (useGrid)
+		grid.build(particles);
+}
+
+// compact the store, dropping every particle flagged in "dead".  Keeps the
+// order of the survivors (the lander relies on being particles[0]).
+void ParticleSystem::removeMarked() {
+	int j = 0;
+	for (int i = 0; i < particles.size(); i++) {
+		if (dead[i]) continue;
+		if (i != j) particles[j] = particles[i];
+		j++;
+	}
+	particles.resize(j);
+	grid.clear();
+}
+
+// Test every live particle against the terrain in one pass.  Particles
+// above the terrain bounds are rejected up front and the rest are sorted
+// into z-order over the terrain footprint.  The terrain is sampled once per
+// cell (terrainCellSize wide) at the cell center and the sample is kept, so
+// after the first few steps each cell costs one lookup no matter how many
+// particles are in it.  The samples are dropped when the terrain or its
+// build changes, and when there are more than terrainCacheLimit of them.
+void ParticleSystem::collideTerrain() {
+	const Box &root = terrain->root;
+	float minx = root.parameters[0].x();
+	float minz = root.parameters[0].z();
+	float top = root.parameters[1].y();
+
+	// at most 65536 cells across, for the 16 bit z-order keys
+	float cell = max(terrainCellSize, max(root.parameters[1].x() - minx, root.parameters[1].z() - minz) / 65535);
+	float scale = 1 / cell;
+	if (terrain != cachedTerrain || terrain->generation != cachedGeneration ||
+		terrainCache.size() > terrainCacheLimit) {
+		terrainCache.clear();
+		cachedTerrain = terrain;
+		cachedGeneration = terrain->generation;
+	}
+
+	sortKeys.clear();
+	sortIndices.clear();
+	for (int i = 0; i < particles.size(); i++) {
+		const ofVec3f &p = particles[i].position;
+		if (p.y > top) continue;
+		float qx = (p.x - minx) * scale;
+		float qz = (p.z - minz) * scale;
+		if (qx < 0 || qz < 0 || qx > 65535 || qz > 65535) continue;
+		sortKeys.push_back(mortonKey2D((uint32_t)qx, (uint32_t)qz));
+		sortIndices.push_back(i);
+	}
+	if (sortIndices.size() == 0) return;
+	radixSortByKey(sortKeys, sortIndices, keyScratch, indexScratch);
+
+	// resolve one sample per cell walking the cells in z-order, then apply
+	// the response walking the particles in memory order
+	samples.assign(particles.size(), NULL);
+	const TerrainSample *sample = NULL;
+	for (int k = 0; k < sortIndices.size(); k++) {
+		if (k == 0 || sortKeys[k] != sortKeys[k - 1]) {
+			auto found = terrainCache.find(sortKeys[k]);
+			if (found == terrainCache.end()) {
+				const ofVec3f &p = particles[sortIndices[k]].position;
+				uint32_t cx = (uint32_t)((p.x - minx) * scale);
+				uint32_t cz = (uint32_t)((p.z - minz) * scale);
+				TerrainSample s;
+				s.valid = terrain->surfaceAt(minx + (cx + 0.5) * cell, minz + (cz + 0.5) * cell, s.height, s.normal) != NULL;
+				found = terrainCache.emplace(sortKeys[k], s).first;
+			}
+			sample = found->second.valid ? &found->second : NULL;
+		}
+		samples[sortIndices[k]] = sample;
+	}
+
+	dead.assign(particles.size(), 0);
+	bool anyDead = false;
+	for (int i = 0; i < particles.size(); i++) {
+		const TerrainSample *sample = samples[i];
+		Particle &p = particles[i];
+		if (sample == NULL || p.position.y > sample->height) continue;
+
+		switch (collision) {
+		case BounceCollision:
+			p.position.y = sample->height;
+			if (p.velocity.dot(sample->normal) < 0) {
+				ofVec3f r = reflectVector(p.velocity, sample->normal);
+				ofVec3f rn = sample->normal * r.dot(sample->normal);
+				p.velocity = rn * restitution + (r - rn) * (1 - friction);
+			}
+			break;
+		case DepositCollision:
+			p.position.y = sample->height;
+			p.velocity.set(0, 0, 0);
+			break;
+		case KillCollision:
+			dead[i] = 1;
+			anyDead = true;
+			break;
+		default:
+			break;
+		}
+	}
+	if (anyDead) removeMarked();
+}
+
+// acceleration of particle "p" if it were at pos/vel.  Continuous forces are
+// re-evaluated on a probe copy; "impulse" carries the one-shot forces which
+// are held constant over the step.  Damping enters as drag so that it is
+// integrated to the same order as the forces.
+ofVec3f ParticleSystem::evaluateAcceleration(const Particle &p, const ofVec3f &pos, const ofVec3f &vel, const ofVec3f &impulse) {
+	Particle probe = p;
+	probe.position = pos;
+	probe.velocity = vel;
+	probe.forces = impulse;
+	for (int k = 0; k < forces.size(); k++) {
+		if (!forces[k]->applyOnce)
+			forces[k]->updateForce(&probe);
+	}
+	return p.acceleration + probe.forces * (1.0 / p.mass) - vel * Particle::dragCoefficient(p.damping);
+}
 
+// classic 4th order Runge-Kutta.  Only worth it for a handful of bodies
+// (the lander), each step costs four force evaluations.
+void ParticleSystem::integrateRK4(Particle &p, float dt) {
+
+	// p.forces already holds the forces at the start of the step, including
+	// any one-shot impulse; split that out so later stages keep it.
+	ofVec3f a1 = evaluateAcceleration(p, p.position, p.velocity, ofVec3f(0, 0, 0));
+	ofVec3f impulse = p.forces - (a1 - p.acceleration + p.velocity * Particle::dragCoefficient(p.damping)) * p.mass;
+	a1 += impulse * (1.0 / p.mass);
+
+	ofVec3f x1 = p.position;
+	ofVec3f v1 = p.velocity;
+
+	ofVec3f x2 = x1 + v1 * (dt / 2);
+	ofVec3f v2 = v1 + a1 * (dt / 2);
+	ofVec3f a2 = evaluateAcceleration(p, x2, v2, impulse);
+
+	ofVec3f x3 = x1 + v2 * (dt / 2);
+	ofVec3f v3 = v1 + a2 * (dt / 2);
+	ofVec3f a3 = evaluateAcceleration(p, x3, v3, impulse);
+
+	ofVec3f x4 = x1 + v3 * dt;
+	ofVec3f v4 = v1 + a3 * dt;
+	ofVec3f a4 = evaluateAcceleration(p, x4, v4, impulse);
+
+	p.position += (v1 + v2 * 2 + v3 * 2 + v4) * (dt / 6);
+	p.velocity += (a1 + a2 * 2 + a3 * 2 + a4) * (dt / 6);
+	p.forces.set(0, 0, 0);
 }
 
-// remove all particlies within "dist" of point 
-int ParticleSystem::removeNear(const ofVec3f & point, float dist) { return 0; }
+// indices of all particles within "dist" of point.  Uses the grid for the
+// particles it covers and a linear scan for any added after it was built.
+void ParticleSystem::queryRadius(const ofVec3f &point, float dist, vector<int> &result) const {
+	grid.queryRadius(point, dist, result);
+	float d2 = dist * dist;
+	for (int i = grid.count; i < particles.size(); i++) {
+		if (particles[i].position.squareDistance(point) <= d2) result.push_back(i);
+	}
+}
+
+// remove all particlies within "dist" of point, return how many were removed
+int ParticleSystem::removeNear(const ofVec3f & point, float dist) {
+	vector<int> near;
+	queryRadius(point, dist, near);
+	if (near.size() == 0) return 0;
+
+	dead.assign(particles.size(), 0);
+	for (int i : near) dead[i] = 1;
+	removeMarked();
+	return near.size();
+}
 
 //  draw the particle cloud
 void ParticleSystem::draw() {
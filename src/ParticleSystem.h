@@ -1,6 +1,12 @@
 #pragma once
 #include "ofMain.h"
 #include "Particle.h"
+#include "Octree.h"
+#include "ParticleGrid.h"
+#include <unordered_map>
+
+// what happens to a particle that hits the terrain
+typedef enum { NoCollision, BounceCollision, DepositCollision, KillCollision } CollisionResponse;
 
 class ParticleForce {
 protected:
@@ -8,22 +14,104 @@ public:
 	bool applyOnce = false;
 	bool applied = false;
 	virtual void updateForce(Particle *) = 0;
+	// particles[0 .. n-1], for forces that do better than a call each
+	virtual void updateForces(Particle *particles, int n) {
+		for (int i = 0; i < n; i++) updateForce(&particles[i]);
+	}
 };
 
 class ParticleSystem {
 public:
+	ParticleSystem() {
+		integrator = EulerIntegrator;
+		terrain = NULL;
+		cachedTerrain = NULL;
+		cachedGeneration = -1;
+		terrainCellSize = 0.5;
+		terrainCacheLimit = 1 << 18;
+		collision = NoCollision;
+		restitution = 0.3;
+		friction = 0.2;
+		useGrid = false;
+	}
 	void add(const Particle &);
 	void addForce(ParticleForce *);
 	void remove(int);
 	void update();
+	void update(float dt);
+	void setIntegrator(IntegratorType t) { integrator = t; }
+	void setTerrain(const Octree *t) { terrain = t; }
+	void setCollisionResponse(CollisionResponse r, float e = 0.3, float f = 0.2) {
+		collision = r;
+		restitution = e;
+		friction = f;
+	}
 	void setLifespan(float);
 	void reset();
+	// neighbor queries scan every particle unless enableGrid() is on, which
+	// rebuilds the spatial hash at the end of each update (SpatialBench
+	// grid_build).  Nothing in the app queries neighbors yet, so no system
+	// turns it on.
 	int removeNear(const ofVec3f & point, float dist);
+	void queryRadius(const ofVec3f &point, float dist, vector<int> &result) const;
+	template <typename F> void forEachNeighbor(int i, float dist, F fn) const;
+	void enableGrid(float cellSize) { useGrid = true; grid.setCellSize(cellSize); grid.clear(); }
+	void disableGrid() { useGrid = false; grid.clear(); }
 	void draw();
-	vector<Particle> particles;
+	ParticleList particles;
 	vector<ParticleForce *> forces;
+	IntegratorType integrator;
+
+	// terrain collision stage
+	const Octree *terrain;
+	CollisionResponse collision;
+	float restitution;  // fraction of normal speed kept on a bounce
+	float friction;     // fraction of tangential speed lost on a bounce
+	float terrainCellSize;      // world units per terrain sample
+	int terrainCacheLimit;      // samples kept before the cache starts over
+
+	// spatial hash over the particles, rebuilt at the end of each update.
+	// Particles added since then are not in it and are scanned directly.
+	ParticleGrid grid;
+	bool useGrid;
+
+	// the terrain collision stage on its own, for stores that do their own
+	// integration (CompactParticleSystem)
+	void collideTerrain();
+
+private:
+	void removeMarked();
+	ofVec3f evaluateAcceleration(const Particle &, const ofVec3f &pos, const ofVec3f &vel, const ofVec3f &impulse);
+	void integrateRK4(Particle &, float dt);
+
+	// terrain samples per z-order cell, filled lazily
+	struct TerrainSample {
+		float height;
+		ofVec3f normal;
+		bool valid;
+	};
+	unordered_map<uint32_t, TerrainSample> terrainCache;
+	const Octree *cachedTerrain;    // the build the samples are from
+	int cachedGeneration;
+
+	// scratch buffers, kept between steps to avoid reallocating
+	vector<uint32_t> sortKeys, keyScratch;
+	vector<int> sortIndices, indexScratch;
+	vector<char> dead;
+	vector<const TerrainSample *> samples;
 };
 
+// call fn(index) for every other particle within "dist" of particle i
+template <typename F>
+void ParticleSystem::forEachNeighbor(int i, float dist, F fn) const {
+	const ofVec3f &point = particles[i].position;
+	grid.forEachNear(point, dist, [i, &fn](int j, const ofVec3f &) { if (j != i) fn(j); });
+	float d2 = dist * dist;
+	for (int j = grid.count; j < particles.size(); j++) {
+		if (j != i && particles[j].position.squareDistance(point) <= d2) fn(j);
+	}
+}
+
 class GravityForce: public ParticleForce {
 	ofVec3f gravity;
 public:
@@ -66,6 +154,7 @@ class ThrusterForce : public ParticleForce {
 public:
 	void set(ofVec3f t) { thrust = t; }
 	void add(ofVec3f t) { thrust += t;  }
+	ofVec3f get() const { return thrust; }
 	ThrusterForce(ofVec3f t) { thrust = t; }
 	ThrusterForce() {}
 	void updateForce(Particle *);
@@ -0,0 +1,183 @@
+
+#include "Profiler.h"
+
+std::atomic<bool> Profiler::enabled(false);
+size_t Profiler::captureLimit = 1 << 20;
+int Profiler::historyFrames = 300;
+
+std::chrono::steady_clock::time_point Profiler::epoch = std::chrono::steady_clock::now();
+std::mutex Profiler::ringsMutex;
+vector<unique_ptr<ProfileRing> > Profiler::rings;
+vector<pair<int, ProfileEvent> > Profiler::capture;
+size_t Profiler::captureStart = 0;
+vector<pair<int, ProfileEvent> > Profiler::latest;
+deque<ProfileFrame> Profiler::history;
+int64_t Profiler::frameStart = -1;
+int Profiler::mainThread = -1;
+uint32_t Profiler::droppedTotal = 0;
+
+// Rings live as long as the program, so one left by a finished thread can
+// still be drained.
+ProfileRing &Profiler::ring() {
+	static thread_local ProfileRing *mine = NULL;
+	if (mine) return *mine;
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	rings.push_back(unique_ptr<ProfileRing>(new ProfileRing()));
+	mine = rings.back().get();
+	mine->thread = rings.size() - 1;
+	return *mine;
+}
+
+void Profiler::collect() {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	latest.clear();
+	for (unique_ptr<ProfileRing> &r : rings) {
+		uint32_t tail = r->tail.load(std::memory_order_relaxed);
+		uint32_t head = r->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++) {
+			const ProfileEvent &e = r->events[tail % ProfileRing::capacity];
+			latest.push_back(make_pair(r->thread, e));
+			if (capture.size() < captureLimit) capture.push_back(make_pair(r->thread, e));
+			else {
+				capture[captureStart] = make_pair(r->thread, e);
+				captureStart = (captureStart + 1) % capture.size();
+			}
+		}
+		r->tail.store(tail, std::memory_order_release);
+		droppedTotal += r->dropped.exchange(0, std::memory_order_relaxed);
+	}
+}
+
+void Profiler::nextFrame() {
+	int64_t t = now();
+	if (!enabled) {
+		frameStart = -1;
+		return;
+	}
+	mainThread = ring().thread;
+	collect();
+
+	if (frameStart >= 0) {
+		// top level main thread zones of the frame just ended
+		ProfileFrame f;
+		f.start = frameStart;
+		f.end = t;
+		for (const pair<int, ProfileEvent> &c : latest) {
+			if (c.first != mainThread || c.second.depth != 0 || c.second.start < frameStart) continue;
+			float ms = (c.second.end - c.second.start) / 1e6;
+			bool merged = false;
+			for (auto &z : f.zones) {
+				if (strcmp(z.first, c.second.name) == 0) {
+					z.second += ms;
+					merged = true;
+				}
+			}
+			if (!merged) f.zones.push_back(make_pair(c.second.name, ms));
+		}
+		history.push_back(f);
+		while (history.size() > historyFrames) history.pop_front();
+	}
+	frameStart = t;
+}
+
+//--------------------------------------------------------------
+// HUD: a bar per frame, split by top level zone, with the 60 and 30 fps
+// lines, and the zone averages over the last 60 frames.
+
+static ofColor zoneColor(const char *name) {
+	uint32_t h = 2166136261u;
+	for (const char *c = name; *c; c++) h = (h ^ (unsigned char) *c) * 16777619u;
+	return ofColor::fromHsb(h % 255, 160, 230);
+}
+
+void Profiler::drawHud(float x, float y, float w, float h) {
+	ofPushStyle();
+	ofFill();
+	ofSetColor(0, 0, 0, 160);
+	ofDrawRectangle(x, y, w, h);
+
+	float msScale = h / 50.0;         // 50 ms full height
+	float barW = w / historyFrames;
+	map<string, float> averages;
+	int counted = 0;
+	for (int i = 0; i < history.size(); i++) {
+		const ProfileFrame &f = history[i];
+		float bx = x + w - (history.size() - i) * barW;
+		float frameMs = (f.end - f.start) / 1e6;
+		ofSetColor(90);
+		ofDrawRectangle(bx, y + h - min(frameMs, 50.0f) * msScale, max(barW - 1, 1.0f), min(frameMs, 50.0f) * msScale);
+		float top = y + h;
+		for (auto &z : f.zones) {
+			float zh = min(z.second * msScale, top - y);
+			ofSetColor(zoneColor(z.first));
+			ofDrawRectangle(bx, top - zh, max(barW - 1, 1.0f), zh);
+			top -= zh;
+		}
+		if (i >= (int) history.size() - 60) {
+			counted++;
+			averages["frame"] += frameMs;
+			for (auto &z : f.zones) averages[z.first] += z.second;
+		}
+	}
+	ofSetColor(ofColor::green);
+	ofDrawLine(x, y + h - 1000.0 / 60 * msScale, x + w, y + h - 1000.0 / 60 * msScale);
+	ofSetColor(ofColor::yellow);
+	ofDrawLine(x, y + h - 1000.0 / 30 * msScale, x + w, y + h - 1000.0 / 30 * msScale);
+
+	float ty = y + 14;
+	for (auto &a : averages) {
+		ofSetColor(a.first == "frame" ? ofColor::white : zoneColor(a.first.c_str()));
+		ofDrawBitmapString(a.first + " " + ofToString(a.second / max(counted, 1), 2) + " ms", x + 4, ty);
+		ty += 12;
+	}
+	if (droppedTotal > 0) {
+		ofSetColor(ofColor::red);
+		ofDrawBitmapString(ofToString(droppedTotal) + " zones dropped", x + 4, ty);
+	}
+	ofPopStyle();
+}
+
+//--------------------------------------------------------------
+// export
+
+static void escapeJson(ostream &out, const char *s) {
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') out << '\\';
+		out << *s;
+	}
+}
+
+bool Profiler::writeChromeTrace(const string &path) {
+	collect();
+	ofstream out(ofToDataPath(path).c_str());
+	if (!out) return false;
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << max(mainThread, 0)
+		<< ", \"args\": {\"name\": \"main\"}}";
+	out.precision(3);
+	out << fixed;
+	for (size_t k = 0; k < capture.size(); k++) {
+		const pair<int, ProfileEvent> &c = capture[(captureStart + k) % capture.size()];
+		out << ",\n{\"name\": \"";
+		escapeJson(out, c.second.name);
+		out << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << c.first << ", \"ts\": " << c.second.start / 1e3
+			<< ", \"dur\": " << (c.second.end - c.second.start) / 1e3 << "}";
+	}
+	out << "\n]}\n";
+	return (bool) out;
+}
+
+bool Profiler::writeCsv(const string &path) {
+	collect();
+	ofstream out(ofToDataPath(path).c_str());
+	if (!out) return false;
+	out << "thread,zone,depth,start_us,duration_us" << endl;
+	out.precision(3);
+	out << fixed;
+	for (size_t k = 0; k < capture.size(); k++) {
+		const pair<int, ProfileEvent> &c = capture[(captureStart + k) % capture.size()];
+		out << c.first << "," << c.second.name << "," << c.second.depth << "," << c.second.start / 1e3
+			<< "," << (c.second.end - c.second.start) / 1e3 << "\n";
+	}
+	return (bool) out;
+}
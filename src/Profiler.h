@@ -0,0 +1,127 @@
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+
+//  Frame profiler.  PROFILE_SCOPE("name") times the rest of the enclosing
+//  block as a zone; zones nest.  Every thread writes its zones to its own
+//  single producer / single consumer ring, so recording takes no locks, and
+//  the main thread drains all rings once a frame in endFrame().
+//
+//  The last few hundred frames are kept for the HUD (frame time graph and
+//  per zone averages) and the last captureLimit zones for export as Chrome
+//  trace JSON (chrome://tracing, Perfetto) or CSV.
+//
+//  Build with LANDER_PROFILE=0 to compile the zones out.  Compiled in, a
+//  zone costs one relaxed load while Profiler::enabled is false.
+//
+
+#ifndef LANDER_PROFILE
+#define LANDER_PROFILE 1
+#endif
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#if LANDER_PROFILE
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+struct ProfileEvent {
+	const char *name;               // string literal, or outlives the profiler
+	int64_t start, end;             // ns since Profiler::epoch
+	int depth;
+};
+
+// ring of one thread's zones, written by that thread only
+struct ProfileRing {
+	static const int capacity = 1 << 16;
+	ProfileEvent events[capacity];
+	std::atomic<uint32_t> head, tail;     // head: next write, tail: next read
+	std::atomic<uint32_t> dropped;
+	int thread;                           // 0 = first thread to profile (main)
+	int depth;
+	ProfileRing() : head(0), tail(0), dropped(0), thread(0), depth(0) {}
+};
+
+struct ProfileFrame {
+	int64_t start, end;
+	vector<pair<const char *, float> > zones;   // top level zones on the main thread, ms
+};
+
+class Profiler {
+public:
+	static std::atomic<bool> enabled;
+
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - epoch).count();
+	}
+	static ProfileRing &ring();           // this thread's, registered on first use
+
+	// main thread, once at the top of each frame: ends the previous frame
+	// and drains every ring
+	static void nextFrame();
+
+	// drain every ring into the capture (nextFrame does this)
+	static void collect();
+
+	static void drawHud(float x, float y, float w, float h);
+	static bool writeChromeTrace(const string &path);
+	static bool writeCsv(const string &path);
+
+	static size_t captureLimit;           // zones kept for export
+	static int historyFrames;             // frames kept for the HUD
+
+private:
+	static std::chrono::steady_clock::time_point epoch;
+	static std::mutex ringsMutex;
+	static vector<unique_ptr<ProfileRing> > rings;
+
+	static vector<pair<int, ProfileEvent> > capture;   // (thread, zone), oldest first
+	static size_t captureStart;                        // capture is a ring once full
+	static vector<pair<int, ProfileEvent> > latest;    // drained by the last collect()
+	static deque<ProfileFrame> history;
+	static int64_t frameStart;
+	static int mainThread;
+	static uint32_t droppedTotal;
+};
+
+class ProfileZone {
+public:
+	ProfileZone(const char *name) {
+		if (!Profiler::enabled.load(std::memory_order_relaxed)) {
+			ring = NULL;
+			return;
+		}
+		ring = &Profiler::ring();
+		this->name = name;
+		depth = ring->depth++;
+		start = Profiler::now();
+	}
+	~ProfileZone() {
+		if (!ring) return;
+		int64_t end = Profiler::now();
+		ring->depth--;
+		uint32_t head = ring->head.load(std::memory_order_relaxed);
+		if (head - ring->tail.load(std::memory_order_acquire) >= ProfileRing::capacity) {
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		ProfileEvent &e = ring->events[head % ProfileRing::capacity];
+		e.name = name;
+		e.start = start;
+		e.end = end;
+		e.depth = depth;
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+private:
+	ProfileRing *ring;
+	const char *name;
+	int64_t start;
+	int depth;
+};
@@ -0,0 +1,67 @@
+
+#include "QualityGovernor.h"
+
+QualityGovernor::QualityGovernor() {
+	level = 0;
+	maxLevel = 4;
+	budgetMs = 1000.0 / 60;
+	averageMs = 0;
+	restoreBelow = 0.7;
+	degradeAfter = 10;
+	restoreAfter = 120;
+	settleFrames = 30;
+	over = under = 0;
+	settle = settleFrames;
+	enabled = true;
+}
+
+void QualityGovernor::addKnob(const string &name, Knob knob) {
+	knobs.push_back(make_pair(name, knob));
+	settings.push_back(knob(level));
+}
+
+void QualityGovernor::frame(float ms) {
+	averageMs = averageMs > 0 ? averageMs + (ms - averageMs) * 0.1f : ms;
+	if (!enabled) return;
+	if (settle > 0) {
+		settle--;
+		return;
+	}
+
+	if (averageMs > budgetMs) {
+		over++;
+		under = 0;
+	}
+	else if (averageMs < budgetMs * restoreBelow) {
+		under++;
+		over = 0;
+	}
+	else over = under = 0;
+
+	if (over >= degradeAfter && level < maxLevel) setLevel(level + 1);
+	else if (under >= restoreAfter && level > 0) setLevel(level - 1);
+}
+
+void QualityGovernor::setEnabled(bool on) {
+	enabled = on;
+	if (!on && level > 0) setLevel(0);
+}
+
+void QualityGovernor::setLevel(int l) {
+	ostringstream log;
+	log << "quality " << level << " -> " << l << ", " << ofToString(averageMs, 1) << " ms a frame against "
+		<< ofToString(budgetMs, 1);
+	level = l;
+	const char *separator = ": ";
+	for (int k = 0; k < knobs.size(); k++) {
+		string now = knobs[k].second(level);
+		if (now != settings[k]) {
+			log << separator << knobs[k].first << " " << settings[k] << " -> " << now;
+			separator = ", ";
+		}
+		settings[k] = now;
+	}
+	ofLogNotice("QualityGovernor") << log.str();
+	over = under = 0;
+	settle = settleFrames;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "ofMain.h"
+#include <functional>
+
+//  Holds the frame time under a budget by trading quality.
+//
+//  frame() is given each frame's cost (update + draw) and keeps a smoothed
+//  average.  After degradeAfter frames in a row over the budget the quality
+//  level goes down one step; after restoreAfter frames in a row under
+//  restoreBelow of the budget it comes back one step.  Between the two the
+//  level holds, and after every change the next settleFrames are ignored
+//  while the average catches up, so the level doesn't flip back and forth.
+//
+//  Knobs turn a level into settings: level 0 is full quality, maxLevel the
+//  cheapest.  Each returns a short description of what it set, and every
+//  change is logged with the settings that moved.
+//
+
+class QualityGovernor {
+public:
+	typedef std::function<string(int level)> Knob;
+
+	QualityGovernor();
+
+	void addKnob(const string &name, Knob knob);
+	void frame(float ms);
+	void setEnabled(bool on);       // off goes back to full quality
+	bool isEnabled() const { return enabled; }
+
+	int level;                      // 0 full quality .. maxLevel
+	int maxLevel;
+	float budgetMs;
+	float averageMs;
+	float restoreBelow;             // fraction of the budget
+	int degradeAfter, restoreAfter, settleFrames;
+
+private:
+	void setLevel(int l);
+
+	vector<pair<string, Knob> > knobs;
+	vector<string> settings;        // what each knob last set
+	int over, under, settle;
+	bool enabled;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+//  Fixed size lock-free queue for one producer thread and one consumer
+//  thread.  push() fails when the queue is full rather than blocking.
+//
+
+template <class T, int Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// producer
+	bool push(const T &item) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+		items[h % Capacity] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer
+	bool pop(T &item) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		item = items[t % Capacity];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[Capacity];
+	// apart, so the two threads don't share a cache line (padding rather
+	// than alignas, which would make every owner over-aligned for new)
+	char pad0[64];
+	std::atomic<uint32_t> head;     // next write
+	char pad1[64];
+	std::atomic<uint32_t> tail;     // next read
+};
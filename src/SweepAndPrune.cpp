@@ -0,0 +1,263 @@
+
+#include "SweepAndPrune.h"
+#include "Profiler.h"
+
+// the axes swept; see SweepAndPrune.h for y
+static const int sweptAxes[2] = { 0, 2 };
+
+// Lower ends sort before upper ends of the same value, so boxes that
+// touch are overlapping.
+static inline bool endBefore(float value, uint32_t key, float otherValue, uint32_t otherKey) {
+	return value < otherValue || (value == otherValue && (key & 1) < (otherKey & 1));
+}
+
+SweepAndPrune::SweepAndPrune() {
+	count = 0;
+	added = 0;
+	terrain = NULL;
+	terrainGeneration = -1;
+}
+
+int SweepAndPrune::add(const ofVec3f &min, const ofVec3f &max) {
+	int id;
+	if (!freeIds.empty()) {
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else {
+		id = bodies.size();
+		bodies.push_back(Body());
+	}
+	Body &b = bodies[id];
+	b.alive = true;
+	b.moved = true;
+	b.onTerrain = false;
+	b.home = NULL;
+	b.pairs = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		b.lo[axis] = min[axis];
+		b.hi[axis] = max[axis];
+	}
+	for (int k = 0; k < 2; k++) {
+		// appended out of order; update() sorts them in
+		int axis = sweptAxes[k];
+		End lo = { min[axis], (uint32_t) id << 1 }, hi = { max[axis], (uint32_t) id << 1 | 1 };
+		ends[k].push_back(lo);
+		ends[k].push_back(hi);
+	}
+	count++;
+	added++;
+	return id;
+}
+
+void SweepAndPrune::remove(int id) {
+	if (id < 0 || id >= bodies.size() || !bodies[id].alive) return;
+	for (int k = 0; k < 2; k++) {
+		vector<End> &list = ends[k];
+		list.erase(std::remove_if(list.begin(), list.end(), [id](const End &e) { return (int) (e.key >> 1) == id; }), list.end());
+	}
+	for (int i = 0; i < columnPairs.size(); i++) {
+		if (columnPairs[i].a == id || columnPairs[i].b == id) {
+			removePair(columnPairs[i].a, columnPairs[i].b);
+			i--;
+		}
+	}
+	for (int i = 0; i < pairs.size(); i++) {
+		if (pairs[i].a == id || pairs[i].b == id) {
+			pairs[i] = pairs.back();
+			pairs.pop_back();
+			i--;
+		}
+	}
+	bodies[id].alive = false;
+	freeIds.push_back(id);
+	count--;
+}
+
+void SweepAndPrune::clear() {
+	bodies.clear();
+	freeIds.clear();
+	for (int k = 0; k < 2; k++) ends[k].clear();
+	columnPairs.clear();
+	pairs.clear();
+	pairIndex.clear();
+	terrainContacts.clear();
+	count = 0;
+	added = 0;
+}
+
+void SweepAndPrune::setBounds(int id, const ofVec3f &min, const ofVec3f &max) {
+	Body &b = bodies[id];
+	for (int axis = 0; axis < 3; axis++) {
+		if (b.lo[axis] != min[axis] || b.hi[axis] != max[axis]) b.moved = true;
+		b.lo[axis] = min[axis];
+		b.hi[axis] = max[axis];
+	}
+}
+
+bool SweepAndPrune::overlaps(int a, int b) const {
+	const Body &p = bodies[a], &q = bodies[b];
+	return columnsOverlap(a, b) && p.lo[1] <= q.hi[1] && q.lo[1] <= p.hi[1];
+}
+
+bool SweepAndPrune::columnsOverlap(int a, int b) const {
+	const Body &p = bodies[a], &q = bodies[b];
+	return p.lo[0] <= q.hi[0] && q.lo[0] <= p.hi[0] &&
+		p.lo[2] <= q.hi[2] && q.lo[2] <= p.hi[2];
+}
+
+void SweepAndPrune::addPair(int a, int b) {
+	uint64_t key = pairKey(a, b);
+	if (pairIndex.count(key)) return;
+	BodyPair pair = { min(a, b), max(a, b) };
+	pairIndex[key] = columnPairs.size();
+	columnPairs.push_back(pair);
+	bodies[a].pairs++;
+	bodies[b].pairs++;
+}
+
+void SweepAndPrune::removePair(int a, int b) {
+	// most bodies are in no pair, skip the lookup for them
+	if (bodies[a].pairs == 0 || bodies[b].pairs == 0) return;
+	auto it = pairIndex.find(pairKey(a, b));
+	if (it == pairIndex.end()) return;
+	int i = it->second;
+	pairIndex.erase(it);
+	if (i != columnPairs.size() - 1) {
+		columnPairs[i] = columnPairs.back();
+		pairIndex[pairKey(columnPairs[i].a, columnPairs[i].b)] = i;
+	}
+	columnPairs.pop_back();
+	bodies[a].pairs--;
+	bodies[b].pairs--;
+}
+
+// Insertion sort of ends[k].  An end moving down past an end of another
+// body is the only time two bodies can start or stop overlapping along the
+// axis: a lower end passing an upper end starts it (the pair is added if
+// the columns now overlap along the other axis too), an upper end passing
+// a lower end stops it.
+void SweepAndPrune::sortAxis(int k) {
+	End *list = ends[k].data();
+	int n = ends[k].size();
+	for (int i = 1; i < n; i++) {
+		End e = list[i];
+		// in place already, the usual case
+		if (!endBefore(e.value, e.key, list[i - 1].value, list[i - 1].key)) continue;
+		int j = i;
+		do {
+			const End &other = list[j - 1];
+			if ((e.key ^ other.key) & 1) {
+				int a = e.key >> 1, b = other.key >> 1;
+				if (e.key & 1) removePair(a, b);
+				else if (columnsOverlap(a, b)) addPair(a, b);
+			}
+			list[j] = other;
+			j--;
+		} while (j > 0 && endBefore(e.value, e.key, list[j - 1].value, list[j - 1].key));
+		list[j] = e;
+	}
+}
+
+// Full sort of the ends, then one sweep along x: each body is tested
+// against the bodies whose x span is open when it starts.
+void SweepAndPrune::rebuild() {
+	for (int k = 0; k < 2; k++) {
+		std::sort(ends[k].begin(), ends[k].end(), [](const End &a, const End &b) {
+			return endBefore(a.value, a.key, b.value, b.key);
+		});
+	}
+	columnPairs.clear();
+	pairIndex.clear();
+	for (Body &b : bodies) b.pairs = 0;
+	vector<int> open;
+	vector<int> slot(bodies.size(), -1);
+	for (const End &e : ends[0]) {
+		int id = e.key >> 1;
+		if (e.key & 1) {
+			int i = slot[id];
+			slot[open.back()] = i;
+			open[i] = open.back();
+			open.pop_back();
+			continue;
+		}
+		for (int other : open)
+			if (columnsOverlap(id, other)) addPair(id, other);
+		slot[id] = open.size();
+		open.push_back(id);
+	}
+}
+
+bool SweepAndPrune::reachesTerrain(const Box &node, const Body &body) const {
+	const Vector3 &lo = node.parameters[0], &hi = node.parameters[1];
+	if (body.lo[0] > hi.x() || body.hi[0] < lo.x() ||
+		body.lo[1] > hi.y() || body.hi[1] < lo.y() ||
+		body.lo[2] > hi.z() || body.hi[2] < lo.z())
+		return false;
+	if (node.children.empty()) return !node.vertexIndices.empty();
+	for (const Box &child : node.children)
+		if (reachesTerrain(child, body)) return true;
+	return false;
+}
+
+static bool holds(const Box &node, const float *lo, const float *hi) {
+	const Vector3 &nlo = node.parameters[0], &nhi = node.parameters[1];
+	return nlo.x() < lo[0] && nlo.y() < lo[1] && nlo.z() < lo[2] &&
+		nhi.x() > hi[0] && nhi.y() > hi[1] && nhi.z() > hi[2];
+}
+
+// Nodes only share faces, so nothing outside a node holding the box
+// strictly inside it can reach the box.
+bool SweepAndPrune::touchesTerrain(Body &body) const {
+	if (body.home == NULL || !holds(*body.home, body.lo, body.hi)) {
+		body.home = NULL;
+		const Box *node = &terrain->root;
+		while (node != NULL && holds(*node, body.lo, body.hi)) {
+			body.home = node;
+			const Box *parent = node;
+			node = NULL;
+			for (const Box &child : parent->children) {
+				if (holds(child, body.lo, body.hi)) {
+					node = &child;
+					break;
+				}
+			}
+		}
+	}
+	return reachesTerrain(body.home ? *body.home : terrain->root, body);
+}
+
+void SweepAndPrune::update() {
+	PROFILE_SCOPE("broad phase");
+	// refresh the ends from the bodies
+	for (int k = 0; k < 2; k++) {
+		int axis = sweptAxes[k];
+		for (End &e : ends[k]) {
+			const Body &b = bodies[e.key >> 1];
+			e.value = (e.key & 1) ? b.hi[axis] : b.lo[axis];
+		}
+	}
+	// many new bodies would take the insertion sort a long way
+	if (added > 32 && added * 8 > count) rebuild();
+	else for (int k = 0; k < 2; k++) sortAxis(k);
+	added = 0;
+
+	pairs.clear();
+	for (const BodyPair &p : columnPairs) {
+		const Body &a = bodies[p.a], &b = bodies[p.b];
+		if (a.lo[1] <= b.hi[1] && b.lo[1] <= a.hi[1]) pairs.push_back(p);
+	}
+
+	bool hasTerrain = terrain != NULL && terrain->mesh != NULL;
+	bool rebuilt = hasTerrain && terrain->generation != terrainGeneration;
+	terrainContacts.clear();
+	for (int id = 0; id < bodies.size(); id++) {
+		Body &b = bodies[id];
+		if (!b.alive) continue;
+		if (rebuilt || !hasTerrain) b.home = NULL;
+		if (b.moved || rebuilt || !hasTerrain) b.onTerrain = hasTerrain && touchesTerrain(b);
+		b.moved = false;
+		if (b.onTerrain) terrainContacts.push_back(id);
+	}
+	if (hasTerrain) terrainGeneration = terrain->generation;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "ofMain.h"
+#include "Octree.h"
+#include <unordered_map>
+
+//  Broad phase for dynamic bodies (landers, jettisoned stages, debris).
+//
+//  Each body is an axis aligned box, e.g. Octree::meshBounds of its mesh.
+//  The box ends are kept sorted along x and z.  update() refreshes the ends
+//  from the bodies' current boxes and re-sorts them by insertion sort: from
+//  one step to the next bodies move a little, so the lists are nearly sorted
+//  and the sort costs about one pass.  When a start passes an end the two
+//  bodies begin or stop overlapping along that axis, which is where the
+//  list of bodies whose columns (x and z spans) overlap is updated; pairs
+//  that still overlap are not looked at.  After many bodies are added at
+//  once the lists are sorted and swept from scratch instead.
+//
+//  y is not swept.  Bodies spread out over the ground but crowd into the
+//  band above the terrain, so along y the ends pass each other several
+//  times as often and prune the least.  The few column pairs are checked
+//  along y instead, at the end of each update().
+//
+//  The terrain is a separate, static layer: bodies whose box moved are
+//  tested against the octree, down to the leaves, and terrainContacts lists
+//  those reaching a leaf.  Each body remembers the deepest node holding its
+//  box and starts there while it still does.  Both lists are candidates for
+//  a narrow phase.
+//  Boxes that touch count as overlapping.
+//
+
+struct BodyPair {
+	int a, b;               // a < b
+};
+
+class SweepAndPrune {
+public:
+	SweepAndPrune();
+
+	// returns the body's id; ids of removed bodies are reused
+	int add(const ofVec3f &min, const ofVec3f &max);
+	int add(const Box &bounds) { return add(bounds.parameters[0], bounds.parameters[1]); }
+	void remove(int id);
+	void clear();
+
+	// takes effect at the next update()
+	void setBounds(int id, const ofVec3f &min, const ofVec3f &max);
+	void setBounds(int id, const Box &bounds) { setBounds(id, bounds.parameters[0], bounds.parameters[1]); }
+
+	void setTerrain(const Octree *t) { terrain = t; terrainGeneration = -1; }
+
+	void update();
+
+	int size() const { return count; }
+	bool overlaps(int a, int b) const;
+
+	vector<BodyPair> pairs;         // overlapping bodies, in no particular order
+	vector<int> terrainContacts;    // bodies whose box reaches a terrain leaf
+
+private:
+	struct Body {
+		float lo[3], hi[3];
+		bool alive;
+		bool moved;
+		bool onTerrain;
+		const Box *home;    // deepest terrain node holding the box, NULL if none
+		int pairs;          // how many column pairs it is in
+	};
+	// a box end along x or z; body << 1 | 1 for the upper end
+	struct End {
+		float value;
+		uint32_t key;
+	};
+
+	static uint64_t pairKey(int a, int b) { return a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a; }
+	void addPair(int a, int b);
+	void removePair(int a, int b);
+	bool columnsOverlap(int a, int b) const;
+	void sortAxis(int k);
+	void rebuild();
+	bool reachesTerrain(const Box &node, const Body &body) const;
+	bool touchesTerrain(Body &body) const;
+
+	vector<Body> bodies;
+	vector<int> freeIds;
+	int count;
+	vector<End> ends[2];            // x, z
+	vector<BodyPair> columnPairs;
+	unordered_map<uint64_t, int> pairIndex;    // into columnPairs
+	int added;                      // since the last update
+
+	const Octree *terrain;
+	int terrainGeneration;          // of the octree the contacts were found in
+};
@@ -0,0 +1,216 @@
+
+#include "TaskGraph.h"
+#include "Profiler.h"
+
+// the pool and worker index of the calling thread, if it is a pool worker
+static thread_local const TaskPool *currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+TaskPool::TaskPool(int threads) {
+	if (threads <= 0) threads = max(1, (int) std::thread::hardware_concurrency() - 1);
+	queued = 0;
+	next = 0;
+	quit = false;
+	for (int w = 0; w < threads; w++) workers.push_back(unique_ptr<Worker>(new Worker()));
+	for (int w = 0; w < threads; w++) this->threads.push_back(std::thread(&TaskPool::workerLoop, this, w));
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread &t : threads) t.join();
+}
+
+int TaskPool::self() const {
+	return currentPool == this ? currentWorker : -1;
+}
+
+void TaskPool::submit(Job job) {
+	int w = self();
+	if (w < 0) w = next++ % workers.size();
+	{
+		std::lock_guard<std::mutex> lock(workers[w]->mutex);
+		workers[w]->jobs.push_back(std::move(job));
+	}
+	queued++;
+	// taking the lock orders this against a worker about to sleep
+	{ std::lock_guard<std::mutex> lock(sleepMutex); }
+	wake.notify_one();
+}
+
+// own deque newest first, then the others' oldest
+bool TaskPool::take(int self, Job &job) {
+	int n = workers.size();
+	if (self >= 0) {
+		Worker &mine = *workers[self];
+		std::lock_guard<std::mutex> lock(mine.mutex);
+		if (!mine.jobs.empty()) {
+			job = std::move(mine.jobs.back());
+			mine.jobs.pop_back();
+			return true;
+		}
+	}
+	for (int k = 1; k <= n; k++) {
+		Worker &victim = *workers[(max(self, 0) + k) % n];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool TaskPool::runOne() {
+	Job job;
+	if (!take(self(), job)) return false;
+	queued--;
+	job();
+	return true;
+}
+
+void TaskPool::workerLoop(int w) {
+	currentPool = this;
+	currentWorker = w;
+	while (true) {
+		if (runOne()) continue;
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [&]() { return quit || queued > 0; });
+		if (quit) return;
+	}
+}
+
+//--------------------------------------------------------------
+
+static int64_t nowMicros() {
+	return ofGetElapsedTimeMicros();
+}
+
+int TaskGraph::add(const string &name, Job job, const vector<string> &reads, const vector<string> &writes,
+	bool mainThread) {
+	int id = stages.size();
+	stages.emplace_back();
+	Stage &s = stages.back();
+	s.name = name;
+	s.job = job;
+	s.mainThread = mainThread;
+	s.start = s.end = 0;
+
+	auto after = [&](int a) {
+		if (a != id && find(s.after.begin(), s.after.end(), a) == s.after.end()) {
+			s.after.push_back(a);
+			stages[a].dependents.push_back(id);
+		}
+	};
+	for (const string &r : reads) {
+		auto w = lastWriter.find(r);
+		if (w != lastWriter.end()) after(w->second);
+	}
+	for (const string &r : writes) {
+		auto w = lastWriter.find(r);
+		if (w != lastWriter.end()) after(w->second);
+		for (int reader : readers[r]) after(reader);
+	}
+	for (const string &r : reads) readers[r].push_back(id);
+	for (const string &r : writes) {
+		lastWriter[r] = id;
+		readers[r].clear();
+	}
+	return id;
+}
+
+void TaskGraph::release(int s, TaskPool &pool) {
+	if (stages[s].mainThread) {
+		std::lock_guard<std::mutex> lock(mainMutex);
+		mainReady.push_back(s);
+	}
+	else pool.submit([this, s, &pool]() { execute(s, pool); });
+}
+
+void TaskGraph::execute(int s, TaskPool &pool) {
+	Stage &stage = stages[s];
+	stage.start = nowMicros();
+	{
+		PROFILE_SCOPE(stage.name.c_str());
+		stage.job();
+	}
+	stage.end = nowMicros();
+	for (int d : stage.dependents)
+		if (--stages[d].waiting == 0) release(d, pool);
+	remaining--;
+}
+
+// The main thread runs its own stages and helps the pool until all are done.
+void TaskGraph::run(TaskPool &pool) {
+	frameStart = nowMicros();
+	remaining = stages.size();
+	for (Stage &s : stages) s.waiting = s.after.size();
+	for (int s = 0; s < stages.size(); s++)
+		if (stages[s].after.empty()) release(s, pool);
+
+	while (remaining > 0) {
+		int s = -1;
+		{
+			std::lock_guard<std::mutex> lock(mainMutex);
+			if (!mainReady.empty()) {
+				s = mainReady.front();
+				mainReady.erase(mainReady.begin());
+			}
+		}
+		if (s >= 0) execute(s, pool);
+		else if (!pool.runOne()) std::this_thread::yield();
+	}
+	findCriticalPath();
+}
+
+// Back from the stage that finished last, each time to the input that
+// finished last: the chain that a faster stage would have shortened.
+void TaskGraph::findCriticalPath() {
+	path.clear();
+	if (stages.empty()) return;
+	int s = 0;
+	for (int k = 1; k < stages.size(); k++)
+		if (stages[k].end > stages[s].end) s = k;
+	while (s >= 0) {
+		path.push_back(s);
+		int gate = -1;
+		for (int a : stages[s].after)
+			if (gate < 0 || stages[a].end > stages[gate].end) gate = a;
+		s = gate;
+	}
+	reverse(path.begin(), path.end());
+
+	FramePath f;
+	f.totalMs = (stages[path.back()].end - frameStart) / 1000.0;
+	for (int p : path) f.stages.push_back(make_pair(p, (stages[p].end - stages[p].start) / 1000.0f));
+	history.push_back(f);
+	while (history.size() > historyFrames) history.pop_front();
+}
+
+string TaskGraph::criticalPathReport() const {
+	if (history.empty()) return "";
+	const FramePath &f = history.back();
+	string r;
+	for (const pair<int, float> &p : f.stages)
+		r += (r == "" ? "" : " > ") + stages[p.first].name + " " + ofToString(p.second, 2);
+	return r + " = " + ofToString(f.totalMs, 2) + " ms";
+}
+
+bool TaskGraph::writeCriticalPaths(const string &file) const {
+	ofstream out(ofToDataPath(file).c_str());
+	if (!out) return false;
+	out << "frame,total_ms,path,path_ms" << endl;
+	for (int k = 0; k < history.size(); k++) {
+		const FramePath &f = history[k];
+		out << k << "," << f.totalMs << ",";
+		for (int p = 0; p < f.stages.size(); p++) out << (p ? ">" : "") << stages[f.stages[p].first].name;
+		out << ",";
+		for (int p = 0; p < f.stages.size(); p++) out << (p ? ">" : "") << f.stages[p].second;
+		out << "\n";
+	}
+	return (bool) out;
+}
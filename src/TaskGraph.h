@@ -0,0 +1,108 @@
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+
+//  Per frame task graph on a work-stealing pool.
+//
+//  Stages are added once, in the order a plain sequential frame would run
+//  them, each naming the data it reads and writes.  A stage runs after the
+//  last earlier stage that writes anything it reads or writes, and after the
+//  earlier readers of anything it writes, so the result is the same as the
+//  sequential order while stages with no shared data run at the same time.
+//  Stages that need GL, sound or other main thread only state are marked
+//  mainThread; run() executes those itself and helps the pool otherwise.
+//
+//  After each run the critical path (the chain of stages that ended the
+//  frame, each gated by the last of its inputs) is kept for the HUD and for
+//  export as CSV.
+//
+
+// Worker threads with a deque each: a worker takes its newest job first and
+// steals the oldest from the others when its own deque is empty.
+class TaskPool {
+public:
+	typedef std::function<void()> Job;
+
+	explicit TaskPool(int threads = 0);     // 0: one per core, less the main thread
+	~TaskPool();
+
+	// onto the calling worker's deque, or round robin from other threads
+	void submit(Job job);
+	// run one queued job on the calling thread, false if there was none
+	bool runOne();
+	int size() const { return workers.size(); }
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	bool take(int self, Job &job);
+	void workerLoop(int self);
+	int self() const;
+
+	vector<unique_ptr<Worker> > workers;
+	vector<std::thread> threads;
+	std::atomic<int> queued;
+	std::atomic<unsigned> next;
+	bool quit;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+};
+
+class TaskGraph {
+public:
+	typedef std::function<void()> Job;
+
+	// returns the stage id
+	int add(const string &name, Job job, const vector<string> &reads, const vector<string> &writes,
+		bool mainThread = false);
+
+	// one frame: returns once every stage has run
+	void run(TaskPool &pool);
+
+	// critical path of the last run, stage ids in order
+	const vector<int> &criticalPath() const { return path; }
+	string criticalPathReport() const;     // "simulate 1.20 > exhaust 0.80 = 2.00 ms"
+	bool writeCriticalPaths(const string &path) const;   // CSV, one row per frame kept
+	string stageName(int id) const { return stages[id].name; }
+
+	int historyFrames = 600;
+
+private:
+	struct Stage {
+		string name;
+		Job job;
+		bool mainThread;
+		vector<int> after, dependents;
+		std::atomic<int> waiting;
+		int64_t start, end;        // us, last run
+	};
+	struct FramePath {
+		float totalMs;
+		vector<pair<int, float> > stages;   // id, ms
+	};
+
+	void release(int s, TaskPool &pool);
+	void execute(int s, TaskPool &pool);
+	void findCriticalPath();
+
+	std::deque<Stage> stages;           // a deque, Stage holds an atomic
+	map<string, int> lastWriter;
+	map<string, vector<int> > readers;  // since the last write
+
+	std::atomic<int> remaining;
+	std::mutex mainMutex;
+	vector<int> mainReady;              // main thread stages ready to run
+	int64_t frameStart;
+
+	vector<int> path;
+	std::deque<FramePath> history;
+};
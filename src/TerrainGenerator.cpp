@@ -0,0 +1,231 @@
+
+#include "TerrainGenerator.h"
+#include <thread>
+#include <functional>
+
+static const float craterReach = 2.5;   // rim falloff ends at this many radii
+
+static uint32_t hash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+static float hashUniform(uint32_t x) {
+	return (hash32(x) >> 8) * (1.0f / 16777216.0f);
+}
+
+// 2D gradient noise, about [-1, 1], gradients from 8 directions
+static float gradientNoise(float x, float z, uint32_t seed) {
+	static const float gx[8] = { 1, -1, 1, -1, 1.4142f, -1.4142f, 0, 0 };
+	static const float gz[8] = { 1, 1, -1, -1, 0, 0, 1.4142f, -1.4142f };
+
+	float fx = floorf(x), fz = floorf(z);
+	int ix = (int) fx, iz = (int) fz;
+	float dx = x - fx, dz = z - fz;
+
+	float dot[4];
+	for (int k = 0; k < 4; k++) {
+		int cx = ix + (k & 1), cz = iz + (k >> 1);
+		uint32_t h = hash32((uint32_t) cx * 0x8da6b343u ^ (uint32_t) cz * 0xd8163841u ^ seed) & 7;
+		dot[k] = gx[h] * (dx - (k & 1)) + gz[h] * (dz - (k >> 1));
+	}
+	float u = dx * dx * dx * (dx * (dx * 6 - 15) + 10);
+	float v = dz * dz * dz * (dz * (dz * 6 - 15) + 10);
+	float a = dot[0] + (dot[1] - dot[0]) * u;
+	float b = dot[2] + (dot[3] - dot[2]) * u;
+	return a + (b - a) * v;
+}
+
+bool TerrainGenerator::isSpec(const string &s) {
+	return s.compare(0, 10, "procedural") == 0;
+}
+
+bool TerrainGenerator::parseSpec(const string &s, TerrainParams &p) {
+	if (!isSpec(s)) return false;
+	size_t colon = s.find(':');
+	if (colon == string::npos) return s.size() == 10;
+	for (string item : ofSplitString(s.substr(colon + 1), ",", true, true)) {
+		vector<string> kv = ofSplitString(item, "=", false, true);
+		if (kv.size() != 2) return false;
+		const string &k = kv[0];
+		float v = ofToFloat(kv[1]);
+		if (k == "res") p.resolution = max(2, (int) v);
+		else if (k == "vertices") p.resolution = max(2, (int) sqrt(v));
+		else if (k == "size") p.size = v;
+		else if (k == "height") p.height = v;
+		else if (k == "frequency") p.frequency = v;
+		else if (k == "octaves") p.octaves = (int) v;
+		else if (k == "craters") p.craters = (int) v;
+		else if (k == "craterMin") p.craterMin = v;
+		else if (k == "craterMax") p.craterMax = v;
+		else if (k == "seed") p.seed = (uint32_t) ofToInt(kv[1]);
+		else if (k == "texcoords") p.texcoords = v != 0;
+		else {
+			ofLogError("TerrainGenerator") << "unknown terrain parameter " << k;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Scatter the craters and bucket them on a grid of cells as wide as the
+// largest crater's reach, so each vertex only looks at a few of them.
+void TerrainGenerator::prepare() {
+	craters.clear();
+	float half = params.size / 2;
+	float rmin = max(params.craterMin, 1e-3f), rmax = max(params.craterMax, rmin);
+	for (int i = 0; i < params.craters; i++) {
+		uint32_t h = params.seed * 0x9e3779b9u + i * 4;
+		Crater c;
+		c.x = hashUniform(h) * params.size - half;
+		c.z = hashUniform(h + 1) * params.size - half;
+		// many small craters, few big ones
+		float u = hashUniform(h + 2);
+		c.radius = rmin * powf(rmax / rmin, u * u * u);
+		c.depth = c.radius * (0.2 + 0.1 * hashUniform(h + 3));
+		c.rim = c.depth * 0.35;
+		craters.push_back(c);
+	}
+
+	cellSize = max(rmax * craterReach, params.size / 256);
+	cells = max(1, (int) ceilf(params.size / cellSize));
+	vector<vector<int> > buckets(cells * cells);
+	for (int i = 0; i < craters.size(); i++) {
+		const Crater &c = craters[i];
+		float reach = c.radius * craterReach;
+		int x0 = ofClamp((int) ((c.x - reach + half) / cellSize), 0, cells - 1);
+		int x1 = ofClamp((int) ((c.x + reach + half) / cellSize), 0, cells - 1);
+		int z0 = ofClamp((int) ((c.z - reach + half) / cellSize), 0, cells - 1);
+		int z1 = ofClamp((int) ((c.z + reach + half) / cellSize), 0, cells - 1);
+		for (int z = z0; z <= z1; z++)
+			for (int x = x0; x <= x1; x++) buckets[z * cells + x].push_back(i);
+	}
+	cellStart.assign(1, 0);
+	cellCraters.clear();
+	for (const vector<int> &b : buckets) {
+		cellCraters.insert(cellCraters.end(), b.begin(), b.end());
+		cellStart.push_back(cellCraters.size());
+	}
+	prepared = true;
+}
+
+float TerrainGenerator::fbm(float x, float z) const {
+	float sum = 0, amp = 1, norm = 0, f = params.frequency;
+	for (int o = 0; o < params.octaves; o++) {
+		sum += amp * gradientNoise(x * f, z * f, params.seed + o * 1013);
+		norm += amp;
+		amp *= params.gain;
+		f *= params.lacunarity;
+	}
+	return norm > 0 ? params.height * sum / norm * 1.5f : 0;
+}
+
+// bowl inside the radius, raised rim falling off outside
+float TerrainGenerator::craterHeight(float x, float z) const {
+	float half = params.size / 2;
+	int cx = ofClamp((int) ((x + half) / cellSize), 0, cells - 1);
+	int cz = ofClamp((int) ((z + half) / cellSize), 0, cells - 1);
+	int cell = cz * cells + cx;
+	float h = 0;
+	for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+		const Crater &c = craters[cellCraters[k]];
+		float d2 = ((x - c.x) * (x - c.x) + (z - c.z) * (z - c.z)) / (c.radius * c.radius);
+		if (d2 >= craterReach * craterReach) continue;
+		if (d2 < 1) h += c.rim - (c.depth + c.rim) * (1 - d2);
+		else {
+			float t = (sqrtf(d2) - 1) / (craterReach - 1);
+			h += c.rim * (1 - t) * (1 - t);
+		}
+	}
+	return h;
+}
+
+float TerrainGenerator::heightAt(float x, float z) const {
+	return fbm(x, z) + craterHeight(x, z);
+}
+
+void TerrainGenerator::generate(ofMesh &mesh, int threads) {
+	int res = max(2, params.resolution);
+	prepare();
+	generateRegion(mesh, 0, 0, res, res, 1, threads);
+}
+
+// Vertex (a, b) of the region is grid point (i0 + a * stride, j0 + b * stride),
+// clamped to the last row/column.  Heights are computed with a one sample
+// border so normals match across neighbouring regions.
+void TerrainGenerator::generateRegion(ofMesh &mesh, int i0, int j0, int ni, int nj, int stride, int threads) {
+	int res = max(2, params.resolution);
+	ni = max(ni, 2);
+	nj = max(nj, 2);
+	stride = max(stride, 1);
+	size_t n = (size_t) ni * nj;
+	float spacing = params.size / (res - 1);
+	float half = params.size / 2;
+	if (!prepared) prepare();
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	vector<ofVec3f> &vertices = mesh.getVertices();
+	vector<ofVec3f> &normals = mesh.getNormals();
+	vector<ofVec2f> &texcoords = mesh.getTexCoords();
+	vector<ofIndexType> &indices = mesh.getIndices();
+	vertices.resize(n);
+	normals.resize(n);
+	if (params.texcoords) texcoords.resize(n);
+	indices.resize((size_t) (ni - 1) * (nj - 1) * 6);
+
+	// grid coordinate of region sample a (-1 .. ni), clamped to the world
+	vector<int> gi(ni + 2), gj(nj + 2);
+	for (int a = -1; a <= ni; a++) gi[a + 1] = ofClamp(i0 + a * stride, 0, res - 1);
+	for (int b = -1; b <= nj; b++) gj[b + 1] = ofClamp(j0 + b * stride, 0, res - 1);
+	int pw = ni + 2;
+	vector<float> heights((size_t) pw * (nj + 2));
+
+	if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+	threads = min(threads, nj);
+
+	// run "rows(begin, end)" over all rows, one band per thread
+	auto parallelRows = [&](int count, std::function<void(int, int)> rows) {
+		vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+			workers.push_back(std::thread(rows, (long) count * t / threads, (long) count * (t + 1) / threads));
+		for (std::thread &w : workers) w.join();
+	};
+
+	// heights, with the border
+	parallelRows(nj + 2, [&](int b0, int b1) {
+		for (int b = b0; b < b1; b++) {
+			float z = gj[b] * spacing - half;
+			for (int a = 0; a < pw; a++)
+				heights[(size_t) b * pw + a] = heightAt(gi[a] * spacing - half, z);
+		}
+	});
+
+	// vertices, normals from central differences, two triangles per quad
+	parallelRows(nj, [&](int b0, int b1) {
+		for (int b = b0; b < b1; b++) {
+			const float *row = &heights[(size_t) (b + 1) * pw + 1];
+			float dj = gj[b + 2] - gj[b];
+			for (int a = 0; a < ni; a++) {
+				size_t v = (size_t) b * ni + a;
+				float di = gi[a + 2] - gi[a];
+				float dx = row[a + 1] - row[a - 1];
+				float dz = row[a + pw] - row[a - pw];
+				vertices[v].set(gi[a + 1] * spacing - half, row[a], gj[b + 1] * spacing - half);
+				normals[v] = ofVec3f(-dx * dj, di * dj * spacing, -dz * di).getNormalized();
+				if (params.texcoords) texcoords[v] = ofVec2f(gi[a + 1] / (float) (res - 1), gj[b + 1] / (float) (res - 1));
+			}
+			if (b == nj - 1) continue;
+			ofIndexType *out = &indices[(size_t) b * (ni - 1) * 6];
+			for (int a = 0; a + 1 < ni; a++) {
+				ofIndexType p = b * ni + a, q = p + 1, r = p + ni, t = r + 1;
+				*out++ = p; *out++ = r; *out++ = q;
+				*out++ = q; *out++ = r; *out++ = t;
+			}
+		}
+	});
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "ofMain.h"
+
+//  Procedural terrain: a square height field of fractal gradient noise with
+//  craters stamped on top, built straight into an ofMesh (positions,
+//  normals, texcoords and triangle indices).  The same parameters and seed
+//  always give the same world.  Rows are generated on all cores.
+//
+//  A terrain can be described by a spec string, used wherever an OBJ path
+//  is accepted (the app's command line, lander_headless):
+//
+//     procedural:res=2048,size=400,height=12,craters=300,seed=7
+//
+struct TerrainParams {
+	int resolution = 512;       // vertices per side
+	float size = 200;           // world units per side, centred on the origin
+	float height = 10;          // fBm amplitude
+	float frequency = 0.02;     // lowest octave, cycles per world unit
+	int octaves = 6;
+	float lacunarity = 2;
+	float gain = 0.5;
+	int craters = 40;
+	float craterMin = 1.5;      // crater radius range, world units
+	float craterMax = 25;
+	uint32_t seed = 1;
+	bool texcoords = true;
+};
+
+class TerrainGenerator {
+public:
+	TerrainGenerator() {}
+	TerrainGenerator(const TerrainParams &p) : params(p) {}
+
+	// "procedural[:key=value,...]"; false if not a spec or a key is unknown
+	static bool isSpec(const string &s);
+	static bool parseSpec(const string &s, TerrainParams &p);
+
+	void generate(ofMesh &mesh, int threads = 0);
+
+	// scatter the craters for the current params.  generate() does this;
+	// call it before generateRegion() from several threads at once.
+	void prepare();
+
+	// part of the world: ni x nj vertices starting at grid point (i0, j0),
+	// taking every stride'th grid point (coarser levels of a tile pyramid).
+	// Prepares on first use only.
+	void generateRegion(ofMesh &mesh, int i0, int j0, int ni, int nj, int stride = 1, int threads = 0);
+	float heightAt(float x, float z) const;   // valid after generate()
+
+	TerrainParams params;
+
+private:
+	struct Crater {
+		float x, z, radius, depth, rim;
+	};
+	float fbm(float x, float z) const;
+	float craterHeight(float x, float z) const;
+
+	vector<Crater> craters;
+	vector<int> cellStart, cellCraters;   // craters touching each bucket cell
+	int cells;
+	float cellSize;
+	bool prepared = false;
+};
@@ -0,0 +1,622 @@
+
+#include "TerrainTiles.h"
+#include "Profiler.h"
+#include <atomic>
+#include <functional>
+#include <cfloat>
+
+static const char tileMagic[4] = { 'L', 'T', 'I', 'L' };
+static const int32_t tileVersion = 1;
+
+//--------------------------------------------------------------
+// tile files
+
+static void writeTile(const string &path, int level, int i, int j, const ofMesh &mesh, const Octree *octree) {
+	ofstream out(path.c_str(), ios::binary);
+	int32_t header[4] = { tileVersion, level, i, j };
+	uint32_t counts[4] = { (uint32_t) mesh.getNumVertices(), (uint32_t) mesh.getNumNormals(),
+		(uint32_t) mesh.getNumTexCoords(), (uint32_t) mesh.getNumIndices() };
+	out.write(tileMagic, 4);
+	out.write((const char *) header, sizeof(header));
+	out.write((const char *) counts, sizeof(counts));
+	for (const ofVec3f &v : mesh.getVertices()) out.write((const char *) &v.x, 3 * sizeof(float));
+	for (const ofVec3f &n : mesh.getNormals()) out.write((const char *) &n.x, 3 * sizeof(float));
+	for (const ofVec2f &t : mesh.getTexCoords()) out.write((const char *) &t.x, 2 * sizeof(float));
+	for (ofIndexType i : mesh.getIndices()) {
+		uint32_t v = i;
+		out.write((const char *) &v, sizeof(v));
+	}
+	char hasOctree = octree != NULL;
+	out.write(&hasOctree, 1);
+	if (octree) octree->write(out);
+}
+
+static size_t nodeBytes(const Box &node) {
+	size_t bytes = sizeof(Box) + node.vertexIndices.capacity() * sizeof(int);
+	for (const Box &child : node.children) bytes += nodeBytes(child);
+	return bytes;
+}
+
+static void writeManifest(const string &dir, int levels, int nx, int nz, float minx, float minz,
+	float maxx, float maxz, float miny, float maxy, float tileW, float tileD) {
+	ofstream out(ofFilePath::join(dir, "tiles.txt").c_str());
+	out << "# terrain tile pyramid, see src/TerrainTiles.h" << endl;
+	out << "levels " << levels << endl;
+	out << "grid " << nx << " " << nz << endl;
+	out << "bounds " << minx << " " << minz << " " << maxx << " " << maxz << endl;
+	out << "height " << miny << " " << maxy << endl;
+	out << "tile " << tileW << " " << tileD << endl;
+}
+
+// levels needed for one tile to cover the world
+static int pyramidLevels(int nx, int nz) {
+	int levels = 1;
+	while (((max(nx, nz) + (1 << (levels - 1)) - 1) >> (levels - 1)) > 1) levels++;
+	return levels;
+}
+
+// run job(0 .. count-1) on all cores
+static void parallelJobs(int count, std::function<void(int)> job) {
+	std::atomic<int> next(0);
+	int threads = max(1u, std::thread::hardware_concurrency());
+	vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&]() {
+			for (int k = next++; k < count; k = next++) job(k);
+		}));
+	}
+	for (std::thread &w : workers) w.join();
+}
+
+//--------------------------------------------------------------
+// building
+
+bool TerrainTiles::build(const string &dir, TerrainGenerator &generator, int tileQuads, int maxDepth) {
+	const TerrainParams &p = generator.params;
+	int res = max(2, p.resolution);
+	tileQuads = max(tileQuads, 2);
+	int n = (res - 2) / tileQuads + 1;
+	int levels = pyramidLevels(n, n);
+	float spacing = p.size / (res - 1);
+	float half = p.size / 2;
+	if (!ofDirectory::createDirectory(dir, false, true) && !ofDirectory::doesDirectoryExist(dir, false)) {
+		ofLogError("TerrainTiles") << "can't create " << dir;
+		return false;
+	}
+
+	vector<TerrainTiles::Key> jobs;
+	for (int l = 0; l < levels; l++) {
+		int count = (n + (1 << l) - 1) >> l;
+		for (int j = 0; j < count; j++)
+			for (int i = 0; i < count; i++) jobs.push_back(key(l, i, j));
+	}
+
+	generator.prepare();
+	std::mutex heightMutex;
+	float miny = FLT_MAX, maxy = -FLT_MAX;
+	parallelJobs(jobs.size(), [&](int k) {
+		int l = keyLevel(jobs[k]), i = keyI(jobs[k]), j = keyJ(jobs[k]);
+		int stride = 1 << l, span = tileQuads << l;
+		int gi0 = i * span, gj0 = j * span;
+		int gi1 = min(gi0 + span, res - 1), gj1 = min(gj0 + span, res - 1);
+
+		ofMesh mesh;
+		generator.generateRegion(mesh, gi0, gj0, (gi1 - gi0 + stride - 1) / stride + 1,
+			(gj1 - gj0 + stride - 1) / stride + 1, stride, 1);
+		Octree octree;
+		octree.create(mesh, maxDepth);
+		writeTile(ofFilePath::join(dir, "L" + ofToString(l) + "_" + ofToString(i) + "_" + ofToString(j) + ".tile"),
+			l, i, j, mesh, &octree);
+
+		std::lock_guard<std::mutex> lock(heightMutex);
+		miny = min(miny, octree.root.parameters[0].y());
+		maxy = max(maxy, octree.root.parameters[1].y());
+	});
+
+	writeManifest(dir, levels, n, n, -half, -half, half, half, miny, maxy,
+		tileQuads * spacing, tileQuads * spacing);
+	return true;
+}
+
+// Level 0 tiles take the triangles whose centroid falls in them.  Coarser
+// tiles cluster the vertices of their triangles on a grid of about
+// tileVertices cells and drop the triangles that collapse.
+bool TerrainTiles::build(const string &dir, const ofMesh &source, int tileVertices, int maxDepth) {
+	int nv = source.getNumVertices();
+	if (nv < 3) return false;
+	Box bounds = Octree::meshBounds(source);
+	float minx = bounds.parameters[0].x(), minz = bounds.parameters[0].z();
+	float w = bounds.parameters[1].x() - minx, d = bounds.parameters[1].z() - minz;
+	float tiles = max(1.0f, (float) nv / max(tileVertices, 16));
+	int nx = max(1, (int) ceil(sqrt(tiles * w / d)));
+	int nz = max(1, (int) ceil(tiles / nx));
+	int levels = pyramidLevels(nx, nz);
+	float tileW = w / nx, tileD = d / nz;
+	if (!ofDirectory::createDirectory(dir, false, true) && !ofDirectory::doesDirectoryExist(dir, false)) {
+		ofLogError("TerrainTiles") << "can't create " << dir;
+		return false;
+	}
+
+	// triangles by level 0 tile
+	const vector<ofVec3f> &verts = source.getVertices();
+	int nt = source.hasIndices() ? source.getNumIndices() / 3 : nv / 3;
+	auto corner = [&](int t, int c) { return source.hasIndices() ? (int) source.getIndex(t * 3 + c) : t * 3 + c; };
+	vector<vector<int> > baseTriangles(nx * nz);
+	for (int t = 0; t < nt; t++) {
+		ofVec3f c = (verts[corner(t, 0)] + verts[corner(t, 1)] + verts[corner(t, 2)]) / 3;
+		int i = ofClamp((int) ((c.x - minx) / tileW), 0, nx - 1);
+		int j = ofClamp((int) ((c.z - minz) / tileD), 0, nz - 1);
+		baseTriangles[j * nx + i].push_back(t);
+	}
+
+	vector<TerrainTiles::Key> jobs;
+	for (int l = 0; l < levels; l++)
+		for (int j = 0; j < ((nz + (1 << l) - 1) >> l); j++)
+			for (int i = 0; i < ((nx + (1 << l) - 1) >> l); i++) jobs.push_back(key(l, i, j));
+
+	bool hasNormals = source.getNumNormals() == nv;
+	bool hasTexcoords = source.getNumTexCoords() == nv;
+	int cells = max(2, (int) sqrt((float) tileVertices));
+
+	parallelJobs(jobs.size(), [&](int k) {
+		int l = keyLevel(jobs[k]), i = keyI(jobs[k]), j = keyJ(jobs[k]);
+		int span = 1 << l;
+		float x0 = minx + i * span * tileW, z0 = minz + j * span * tileD;
+
+		// source vertex -> tile vertex, by vertex (level 0) or by cluster cell
+		unordered_map<int, ofIndexType> remap;
+		ofMesh mesh;
+		vector<int> members;
+		auto vertexFor = [&](int v) -> ofIndexType {
+			int id = v;
+			if (l > 0) {
+				int cx = ofClamp((int) ((verts[v].x - x0) / (span * tileW) * cells), 0, cells - 1);
+				int cz = ofClamp((int) ((verts[v].z - z0) / (span * tileD) * cells), 0, cells - 1);
+				id = cz * cells + cx;
+			}
+			auto found = remap.find(id);
+			if (found != remap.end()) {
+				if (l > 0) {   // running sums, averaged below
+					ofIndexType t = found->second;
+					mesh.getVertices()[t] += verts[v];
+					if (hasNormals) mesh.getNormals()[t] += source.getNormals()[v];
+					if (hasTexcoords) mesh.getTexCoords()[t] += source.getTexCoords()[v];
+					members[t]++;
+				}
+				return found->second;
+			}
+			ofIndexType t = mesh.getNumVertices();
+			remap[id] = t;
+			mesh.addVertex(verts[v]);
+			if (hasNormals) mesh.addNormal(source.getNormals()[v]);
+			if (hasTexcoords) mesh.addTexCoord(source.getTexCoords()[v]);
+			members.push_back(1);
+			return t;
+		};
+
+		for (int bj = j * span; bj < min((j + 1) * span, nz); bj++) {
+			for (int bi = i * span; bi < min((i + 1) * span, nx); bi++) {
+				for (int t : baseTriangles[bj * nx + bi]) {
+					ofIndexType a = vertexFor(corner(t, 0)), b = vertexFor(corner(t, 1)), c = vertexFor(corner(t, 2));
+					if (a == b || b == c || a == c) continue;
+					mesh.addTriangle(a, b, c);
+				}
+			}
+		}
+		for (int v = 0; v < mesh.getNumVertices(); v++) {
+			if (members[v] == 1) continue;
+			mesh.getVertices()[v] /= members[v];
+			if (hasNormals) mesh.getNormals()[v].normalize();
+			if (hasTexcoords) mesh.getTexCoords()[v] /= members[v];
+		}
+
+		Octree octree;
+		bool indexed = mesh.getNumVertices() >= 2;
+		if (indexed) octree.create(mesh, maxDepth);
+		writeTile(ofFilePath::join(dir, "L" + ofToString(l) + "_" + ofToString(i) + "_" + ofToString(j) + ".tile"),
+			l, i, j, mesh, indexed ? &octree : NULL);
+	});
+
+	writeManifest(dir, levels, nx, nz, minx, minz, minx + w, minz + d,
+		bounds.parameters[0].y(), bounds.parameters[1].y(), tileW, tileD);
+	return true;
+}
+
+//--------------------------------------------------------------
+// paging
+
+TerrainTiles::TerrainTiles() {
+	levels = 0;
+	nx = nz = 0;
+	minx = minz = maxx = maxz = miny = maxy = 0;
+	tileW = tileD = 1;
+	budget = 256 << 20;
+	radius = 0;
+	residentBytes = 0;
+	loads = evictions = 0;
+	opened = false;
+	quit = false;
+}
+
+TerrainTiles::~TerrainTiles() {
+	close();
+}
+
+bool TerrainTiles::open(const string &path, int loaderThreads) {
+	close();
+	dir = path;
+	ifstream in(ofFilePath::join(dir, "tiles.txt").c_str());
+	if (!in) {
+		ofLogError("TerrainTiles") << "no tiles.txt in " << dir;
+		return false;
+	}
+	string line;
+	while (getline(in, line)) {
+		istringstream words(line);
+		string what;
+		if (!(words >> what) || what[0] == '#') continue;
+		if (what == "levels") words >> levels;
+		else if (what == "grid") words >> nx >> nz;
+		else if (what == "bounds") words >> minx >> minz >> maxx >> maxz;
+		else if (what == "height") words >> miny >> maxy;
+		else if (what == "tile") words >> tileW >> tileD;
+	}
+	if (levels < 1 || nx < 1 || nz < 1 || tileW <= 0 || tileD <= 0) {
+		ofLogError("TerrainTiles") << "bad manifest in " << dir;
+		return false;
+	}
+	// default: keep the 5x5 level 0 tiles around the lander
+	if (radius <= 0) radius = 2 * max(tileW, tileD);
+
+	opened = true;
+	quit = false;
+	for (int t = 0; t < max(loaderThreads, 1); t++)
+		loaders.push_back(std::thread(&TerrainTiles::loaderLoop, this));
+	return true;
+}
+
+void TerrainTiles::close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		requests.clear();
+	}
+	wake.notify_all();
+	for (std::thread &t : loaders) t.join();
+	loaders.clear();
+	done.clear();
+	inFlight.clear();
+	resident.clear();
+	lru.clear();
+	lruPos.clear();
+	subtree.clear();
+	wanted.clear();
+	residentBytes = 0;
+	opened = false;
+}
+
+void TerrainTiles::footprint(int level, int i, int j, float &x0, float &z0, float &x1, float &z1) const {
+	int span = 1 << level;
+	x0 = minx + i * span * tileW;
+	z0 = minz + j * span * tileD;
+	x1 = min(x0 + span * tileW, maxx);
+	z1 = min(z0 + span * tileD, maxz);
+}
+
+string TerrainTiles::tilePath(int level, int i, int j) const {
+	return ofFilePath::join(dir, "L" + ofToString(level) + "_" + ofToString(i) + "_" + ofToString(j) + ".tile");
+}
+
+// Read one tile.  A missing or unreadable file gives an empty tile, so the
+// area is not asked for again.
+shared_ptr<TerrainTile> TerrainTiles::loadTile(Key k) const {
+	shared_ptr<TerrainTile> tile = make_shared<TerrainTile>();
+	tile->level = keyLevel(k);
+	tile->i = keyI(k);
+	tile->j = keyJ(k);
+	footprint(tile->level, tile->i, tile->j, tile->minx, tile->minz, tile->maxx, tile->maxz);
+	tile->bytes = sizeof(TerrainTile);
+
+	ifstream in(tilePath(tile->level, tile->i, tile->j).c_str(), ios::binary);
+	if (!in) return tile;
+	char magic[4];
+	int32_t header[4];
+	uint32_t counts[4];
+	if (!in.read(magic, 4) || memcmp(magic, tileMagic, 4) != 0 || !in.read((char *) header, sizeof(header)) ||
+		header[0] != tileVersion || !in.read((char *) counts, sizeof(counts))) {
+		ofLogError("TerrainTiles") << "bad tile file " << tilePath(tile->level, tile->i, tile->j);
+		return tile;
+	}
+
+	ofMesh &mesh = tile->mesh;
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	mesh.getVertices().resize(counts[0]);
+	mesh.getNormals().resize(counts[1]);
+	mesh.getTexCoords().resize(counts[2]);
+	vector<uint32_t> indices(counts[3]);
+	for (ofVec3f &v : mesh.getVertices()) in.read((char *) &v.x, 3 * sizeof(float));
+	for (ofVec3f &n : mesh.getNormals()) in.read((char *) &n.x, 3 * sizeof(float));
+	for (ofVec2f &t : mesh.getTexCoords()) in.read((char *) &t.x, 2 * sizeof(float));
+	if (!indices.empty()) in.read((char *) indices.data(), indices.size() * sizeof(uint32_t));
+	mesh.getIndices().assign(indices.begin(), indices.end());
+	tile->meshMemory.setMesh(mesh);
+
+	char hasOctree = 0;
+	if (!in.read(&hasOctree, 1) || (hasOctree && !tile->octree.read(in, mesh))) {
+		ofLogError("TerrainTiles") << "truncated tile file " << tilePath(tile->level, tile->i, tile->j);
+		tile->mesh.clear();
+		tile->meshMemory.set(0);
+		tile->octree = Octree();
+		return tile;
+	}
+	tile->bytes += counts[0] * sizeof(ofVec3f) + counts[1] * sizeof(ofVec3f) +
+		counts[2] * sizeof(ofVec2f) + counts[3] * sizeof(ofIndexType) + nodeBytes(tile->octree.root);
+	return tile;
+}
+
+void TerrainTiles::loaderLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [&]() { return quit || !requests.empty(); });
+		if (quit) return;
+		Key k = requests.front();
+		requests.erase(requests.begin());
+		inFlight[k] = 1;
+
+		lock.unlock();
+		shared_ptr<TerrainTile> tile;
+		{
+			PROFILE_SCOPE("tile load");
+			tile = loadTile(k);
+		}
+		lock.lock();
+
+		inFlight.erase(k);
+		done.push_back(make_pair(k, tile));
+	}
+}
+
+TerrainTile *TerrainTiles::find(Key k) {
+	auto found = resident.find(k);
+	return found == resident.end() ? NULL : found->second.get();
+}
+
+void TerrainTiles::insert(Key k, const shared_ptr<TerrainTile> &tile) {
+	if (resident.count(k)) return;
+	resident[k] = tile;
+	residentBytes += tile->bytes;
+	lru.push_front(k);
+	lruPos[k] = lru.begin();
+	countResident(k, 1);
+	loads++;
+}
+
+void TerrainTiles::evict(Key k) {
+	residentBytes -= resident[k]->bytes;
+	resident.erase(k);
+	lru.erase(lruPos[k]);
+	lruPos.erase(k);
+	countResident(k, -1);
+	evictions++;
+}
+
+// keep the resident counts of k and its ancestors up to date
+void TerrainTiles::countResident(Key k, int delta) {
+	int i = keyI(k), j = keyJ(k);
+	for (int l = keyLevel(k); l < levels; l++, i /= 2, j /= 2) {
+		int &n = subtree[key(l, i, j)];
+		n += delta;
+		if (n == 0) subtree.erase(key(l, i, j));
+	}
+}
+
+void TerrainTiles::update(const vector<ofVec3f> &focus) {
+	if (!opened) return;
+
+	// what we want, best first: distance scaled down by the tile size, so
+	// each level fills in at about the same rate
+	unordered_map<Key, float> priority;
+	for (int l = 0; l < levels; l++) {
+		int span = 1 << l;
+		float r = radius * span;
+		for (const ofVec3f &f : focus) {
+			int i0 = ofClamp((int) floor((f.x - r - minx) / (span * tileW)), 0, tilesX(l) - 1);
+			int i1 = ofClamp((int) floor((f.x + r - minx) / (span * tileW)), 0, tilesX(l) - 1);
+			int j0 = ofClamp((int) floor((f.z - r - minz) / (span * tileD)), 0, tilesZ(l) - 1);
+			int j1 = ofClamp((int) floor((f.z + r - minz) / (span * tileD)), 0, tilesZ(l) - 1);
+			for (int j = j0; j <= j1; j++) {
+				for (int i = i0; i <= i1; i++) {
+					float x0, z0, x1, z1;
+					footprint(l, i, j, x0, z0, x1, z1);
+					float dx = max(max(x0 - f.x, f.x - x1), 0.0f), dz = max(max(z0 - f.z, f.z - z1), 0.0f);
+					float d = sqrtf(dx * dx + dz * dz);
+					if (d > r && l < levels - 1) continue;
+					float p = d / span + l * 1e-3;
+					Key k = key(l, i, j);
+					auto found = priority.find(k);
+					if (found == priority.end() || p < found->second) priority[k] = p;
+				}
+			}
+		}
+	}
+	vector<pair<float, Key> > want;
+	for (auto &p : priority) want.push_back(make_pair(p.second, p.first));
+	sort(want.begin(), want.end());
+
+	wanted.clear();
+	for (int w = want.size() - 1; w >= 0; w--) {
+		Key k = want[w].second;
+		wanted[k] = 1;
+		auto pos = lruPos.find(k);
+		if (pos != lruPos.end()) {
+			lru.erase(pos->second);
+			lru.push_front(k);
+			pos->second = lru.begin();
+		}
+	}
+
+	// take what the loaders finished
+	vector<pair<Key, shared_ptr<TerrainTile> > > arrived;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		arrived.swap(done);
+	}
+	for (auto &a : arrived) insert(a.first, a.second);
+
+	// evict unwanted tiles, least recently wanted first
+	while (residentBytes > budget && !lru.empty() && !wanted.count(lru.back())) evict(lru.back());
+
+	// request what is missing, as long as the wanted tiles fit the budget.
+	// The best tile is always asked for.
+	size_t average = resident.empty() ? (1 << 20) : max(residentBytes / resident.size(), (size_t) 1 << 16);
+	size_t projected = 0;
+	for (auto &w : want) {
+		TerrainTile *t = find(w.second);
+		if (t) projected += t->bytes;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	projected += inFlight.size() * average;
+	requests.clear();
+	for (int w = 0; w < want.size(); w++) {
+		Key k = want[w].second;
+		if (resident.count(k) || inFlight.count(k)) continue;
+		if (w > 0 && projected + average > budget) break;
+		projected += average;
+		requests.push_back(k);
+	}
+	if (!requests.empty()) wake.notify_all();
+}
+
+const TerrainTile *TerrainTiles::require(float x, float z) {
+	if (!opened || x < minx || x > maxx || z < minz || z > maxz) return NULL;
+	int i = ofClamp((int) ((x - minx) / tileW), 0, nx - 1);
+	int j = ofClamp((int) ((z - minz) / tileD), 0, nz - 1);
+	Key k = key(0, i, j);
+	TerrainTile *t = find(k);
+	if (t) return t;
+
+	// can't wait for the loaders: read it here, a late duplicate is dropped
+	insert(k, loadTile(k));
+	return find(k);
+}
+
+// resident level 0 tiles whose footprint holds (x, z), borders included
+int TerrainTiles::touching(float x, float z, TerrainTile *out[4]) {
+	if (!opened || x < minx || x > maxx || z < minz || z > maxz) return 0;
+	float ex = tileW * 1e-4, ez = tileD * 1e-4;
+	int i0 = ofClamp((int) ((x - ex - minx) / tileW), 0, nx - 1), i1 = ofClamp((int) ((x + ex - minx) / tileW), 0, nx - 1);
+	int j0 = ofClamp((int) ((z - ez - minz) / tileD), 0, nz - 1), j1 = ofClamp((int) ((z + ez - minz) / tileD), 0, nz - 1);
+	int n = 0;
+	for (int j = j0; j <= j1; j++) {
+		for (int i = i0; i <= i1; i++) {
+			TerrainTile *t = find(key(0, i, j));
+			if (t && !t->empty()) out[n++] = t;
+		}
+	}
+	return n;
+}
+
+bool TerrainTiles::collide(const ofVec3f &p, ofVec3f &vertex) {
+	TerrainTile *tiles[4];
+	int n = touching(p.x, p.z, tiles);
+	for (int k = 0; k < n; k++) {
+		Octree &octree = tiles[k]->octree;
+		vector<int> hit = octree.getCollision(octree.root, p);
+		if (!hit.empty()) {
+			vertex = tiles[k]->mesh.getVertex(hit[0]);
+			return true;
+		}
+	}
+	return false;
+}
+
+// highest vertex under the ray straight down, over all touching tiles
+bool TerrainTiles::altitude(const ofVec3f &p, float &agl) {
+	TerrainTile *tiles[4];
+	int n = touching(p.x, p.z, tiles);
+	bool found = false;
+	float ground = 0;
+	Ray ray(p, Vector3(0, -1, 0));
+	for (int k = 0; k < n; k++) {
+		Octree &octree = tiles[k]->octree;
+		for (int v : octree.getIntersectingVertices(octree.root, ray)) {
+			float y = tiles[k]->mesh.getVertex(v).y;
+			if (y <= p.y && (!found || y > ground)) {
+				ground = y;
+				found = true;
+			}
+		}
+	}
+	if (found) agl = p.y - ground;
+	return found;
+}
+
+bool TerrainTiles::surfaceAt(float x, float z, float &height, ofVec3f &normal) {
+	TerrainTile *tiles[4];
+	int n = touching(x, z, tiles);
+	for (int k = 0; k < n; k++)
+		if (tiles[k]->octree.surfaceAt(x, z, height, normal)) return true;
+
+	// nothing fine enough yet, try the coarser levels
+	for (int l = 1; l < levels; l++) {
+		int span = 1 << l;
+		int i = ofClamp((int) ((x - minx) / (span * tileW)), 0, tilesX(l) - 1);
+		int j = ofClamp((int) ((z - minz) / (span * tileD)), 0, tilesZ(l) - 1);
+		TerrainTile *t = find(key(l, i, j));
+		if (t && !t->empty() && t->octree.surfaceAt(x, z, height, normal)) return true;
+	}
+	return false;
+}
+
+const Octree *TerrainTiles::octreeAt(float x, float z) {
+	TerrainTile *tiles[4];
+	return touching(x, z, tiles) > 0 ? &tiles[0]->octree : NULL;
+}
+
+//--------------------------------------------------------------
+// drawing
+
+// resident tiles in (level, i, j) and below
+int TerrainTiles::residentIn(int level, int i, int j) const {
+	auto found = subtree.find(key(level, i, j));
+	return found == subtree.end() ? 0 : found->second;
+}
+
+// all of (level, i, j) can be drawn from resident tiles at this level or below
+bool TerrainTiles::covered(int level, int i, int j) {
+	if (find(key(level, i, j))) return true;
+	if (level == 0 || residentIn(level, i, j) == 0) return false;
+	return childrenCovered(level, i, j);
+}
+
+bool TerrainTiles::childrenCovered(int level, int i, int j) {
+	for (int c = 0; c < 4; c++) {
+		int ci = i * 2 + (c & 1), cj = j * 2 + (c >> 1);
+		if (ci < tilesX(level - 1) && cj < tilesZ(level - 1) && !covered(level - 1, ci, cj)) return false;
+	}
+	return true;
+}
+
+// Each area from the finest tiles that cover it completely.  Only
+// subtrees with resident tiles are visited, so this is cheap however many
+// tiles the world has.
+void TerrainTiles::drawListNode(int level, int i, int j, vector<shared_ptr<const TerrainTile> > &out) {
+	if (residentIn(level, i, j) == 0) return;
+	auto found = resident.find(key(level, i, j));
+	if (level > 0 && (found == resident.end() || childrenCovered(level, i, j))) {
+		for (int c = 0; c < 4; c++) {
+			int ci = i * 2 + (c & 1), cj = j * 2 + (c >> 1);
+			if (ci < tilesX(level - 1) && cj < tilesZ(level - 1)) drawListNode(level - 1, ci, cj, out);
+		}
+		return;
+	}
+	if (!found->second->empty()) out.push_back(found->second);
+}
+
+void TerrainTiles::drawList(vector<shared_ptr<const TerrainTile> > &out) {
+	out.clear();
+	if (!opened) return;
+	int top = levels - 1;
+	for (int j = 0; j < tilesZ(top); j++)
+		for (int i = 0; i < tilesX(top); i++) drawListNode(top, i, j, out);
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include "ofMain.h"
+#include "Octree.h"
+#include "TerrainGenerator.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <list>
+
+//  Tiled terrain store for worlds too big to hold as one mesh.
+//
+//  On disk a world is a pyramid of square tiles: level 0 at full resolution,
+//  each level above covering 2x2 tiles of the one below at about the same
+//  vertex count.  Every tile file holds the tile's mesh and its octree, so
+//  paging a tile in costs a read, not an octree build.  build() writes a
+//  pyramid from a TerrainGenerator (tile by tile, the whole world is never
+//  in memory) or from a mesh.
+//
+//  At run time update() is given the lander and camera positions once a
+//  frame.  Loader threads page in the tiles around them, nearest and finest
+//  first; tiles that are no longer wanted are evicted least recently used
+//  first once the resident bytes pass the budget, and no more tiles are
+//  requested than fit in it.  Collision and AGL queries run on the resident
+//  level 0 tiles and look at every tile touching the query point, so they
+//  work across tile borders.
+//
+//  Queries and drawList() are for the main thread; tiles are only ever
+//  created by the loaders and inserted or evicted in update() / require().
+//  Nothing here touches GL: the app keeps the tiles' vbos (ofApp::drawTiles).
+//
+
+struct TerrainTile {
+	int level, i, j;
+	float minx, minz, maxx, maxz;   // footprint
+	ofMesh mesh;
+	MemoryCharge meshMemory{MemTiles};   // the octree counts as octree memory
+	Octree octree;
+	size_t bytes;
+	bool empty() const { return mesh.getNumVertices() == 0; }
+};
+
+class TerrainTiles {
+public:
+	TerrainTiles();
+	~TerrainTiles();
+
+	// write a tile pyramid to "dir".  tileQuads is the level 0 tile edge in
+	// grid cells (generator), tileVertices the rough vertex count per tile (mesh).
+	static bool build(const string &dir, TerrainGenerator &generator, int tileQuads = 128, int maxDepth = 40);
+	static bool build(const string &dir, const ofMesh &mesh, int tileVertices = 16384, int maxDepth = 40);
+
+	bool open(const string &dir, int loaderThreads = 2);
+	void close();
+
+	// page around these points; call once per frame
+	void update(const vector<ofVec3f> &focus);
+
+	// the level 0 tile under (x, z), loaded right away if it isn't resident.
+	// NULL outside the world.
+	const TerrainTile *require(float x, float z);
+
+	// queries against resident level 0 tiles
+	bool collide(const ofVec3f &p, ofVec3f &vertex);
+	bool altitude(const ofVec3f &p, float &agl);
+	bool surfaceAt(float x, float z, float &height, ofVec3f &normal);  // coarser levels if need be
+	const Octree *octreeAt(float x, float z);
+
+	// the finest resident tiles that cover each area, to draw
+	void drawList(vector<shared_ptr<const TerrainTile> > &out);
+
+	// world, from the manifest
+	int levels;
+	int nx, nz;                     // level 0 tiles
+	float minx, minz, maxx, maxz;
+	float miny, maxy;
+	float tileW, tileD;             // level 0 tile footprint
+
+	// paging
+	size_t budget;                  // bytes of resident tiles
+	float radius;                   // level 0 tiles wanted within this distance,
+	                                // level n within radius * 2^n
+
+	// stats
+	size_t residentBytes;
+	int loads, evictions;
+	int residentCount() const { return resident.size(); }
+
+private:
+	typedef uint64_t Key;
+	static Key key(int level, int i, int j) { return ((Key) level << 48) | ((Key) i << 24) | (Key) j; }
+	static int keyLevel(Key k) { return (int) (k >> 48); }
+	static int keyI(Key k) { return (int) ((k >> 24) & 0xffffff); }
+	static int keyJ(Key k) { return (int) (k & 0xffffff); }
+
+	int tilesX(int level) const { return (nx + (1 << level) - 1) >> level; }
+	int tilesZ(int level) const { return (nz + (1 << level) - 1) >> level; }
+	void footprint(int level, int i, int j, float &x0, float &z0, float &x1, float &z1) const;
+	string tilePath(int level, int i, int j) const;
+
+	shared_ptr<TerrainTile> loadTile(Key k) const;
+	void loaderLoop();
+	void insert(Key k, const shared_ptr<TerrainTile> &tile);
+	void evict(Key k);
+	void countResident(Key k, int delta);
+	TerrainTile *find(Key k);
+	int touching(float x, float z, TerrainTile *out[4]);
+	int residentIn(int level, int i, int j) const;
+	bool covered(int level, int i, int j);
+	bool childrenCovered(int level, int i, int j);
+	void drawListNode(int level, int i, int j, vector<shared_ptr<const TerrainTile> > &out);
+
+	string dir;
+	bool opened;
+
+	unordered_map<Key, shared_ptr<TerrainTile> > resident;
+	list<Key> lru;                                  // front = most recently wanted
+	unordered_map<Key, list<Key>::iterator> lruPos;
+	unordered_map<Key, int> subtree;                // resident tiles at or below a key
+	unordered_map<Key, char> wanted;
+
+	// shared with the loader threads
+	std::mutex mutex;
+	std::condition_variable wake;
+	vector<Key> requests;                           // best first
+	unordered_map<Key, char> inFlight;
+	vector<pair<Key, shared_ptr<TerrainTile> > > done;
+	bool quit;
+	vector<std::thread> loaders;
+};
@@ -0,0 +1,195 @@
+
+#include "TrajectoryPredictor.h"
+#include "TerrainTiles.h"
+#include "Profiler.h"
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define PREDICT_SSE 1
+#endif
+
+// how one step advances a lane along one axis, as the ship's integrator
+struct StepRule {
+	IntegratorType type;
+	float h;            // step, sec
+	float drag;         // RK4 takes damping as drag
+	float damping;      // the others scale the velocity after the step
+};
+
+// x, v and the constant acceleration c of four lanes
+static inline void stepAxis(float *x, float *v, const float *c, const StepRule &r) {
+#ifdef PREDICT_SSE
+	__m128 px = _mm_loadu_ps(x), pv = _mm_loadu_ps(v), pc = _mm_loadu_ps(c);
+	__m128 h = _mm_set1_ps(r.h);
+	if (r.type == RK4Integrator) {
+		// a(v) = c - drag v, the evaluations of ParticleSystem::integrateRK4
+		__m128 k = _mm_set1_ps(r.drag), h2 = _mm_set1_ps(r.h / 2), h6 = _mm_set1_ps(r.h / 6), two = _mm_set1_ps(2);
+		__m128 a1 = _mm_sub_ps(pc, _mm_mul_ps(k, pv));
+		__m128 v2 = _mm_add_ps(pv, _mm_mul_ps(a1, h2));
+		__m128 a2 = _mm_sub_ps(pc, _mm_mul_ps(k, v2));
+		__m128 v3 = _mm_add_ps(pv, _mm_mul_ps(a2, h2));
+		__m128 a3 = _mm_sub_ps(pc, _mm_mul_ps(k, v3));
+		__m128 v4 = _mm_add_ps(pv, _mm_mul_ps(a3, h));
+		__m128 a4 = _mm_sub_ps(pc, _mm_mul_ps(k, v4));
+		px = _mm_add_ps(px, _mm_mul_ps(_mm_add_ps(_mm_add_ps(pv, v4), _mm_mul_ps(two, _mm_add_ps(v2, v3))), h6));
+		pv = _mm_add_ps(pv, _mm_mul_ps(_mm_add_ps(_mm_add_ps(a1, a4), _mm_mul_ps(two, _mm_add_ps(a2, a3))), h6));
+	}
+	else {
+		if (r.type == EulerIntegrator) {
+			px = _mm_add_ps(px, _mm_mul_ps(pv, h));
+			pv = _mm_add_ps(pv, _mm_mul_ps(pc, h));
+		}
+		else {
+			pv = _mm_add_ps(pv, _mm_mul_ps(pc, h));
+			px = _mm_add_ps(px, _mm_mul_ps(pv, h));
+		}
+		pv = _mm_mul_ps(pv, _mm_set1_ps(r.damping));
+	}
+	_mm_storeu_ps(x, px);
+	_mm_storeu_ps(v, pv);
+#else
+	for (int l = 0; l < 4; l++) {
+		if (r.type == RK4Integrator) {
+			float a1 = c[l] - r.drag * v[l];
+			float v2 = v[l] + a1 * (r.h / 2), a2 = c[l] - r.drag * v2;
+			float v3 = v[l] + a2 * (r.h / 2), a3 = c[l] - r.drag * v3;
+			float v4 = v[l] + a3 * r.h, a4 = c[l] - r.drag * v4;
+			x[l] += (v[l] + 2 * (v2 + v3) + v4) * (r.h / 6);
+			v[l] += (a1 + 2 * (a2 + a3) + a4) * (r.h / 6);
+			continue;
+		}
+		if (r.type == EulerIntegrator) {
+			x[l] += v[l] * r.h;
+			v[l] += c[l] * r.h;
+		}
+		else {
+			v[l] += c[l] * r.h;
+			x[l] += v[l] * r.h;
+		}
+		v[l] *= r.damping;
+	}
+#endif
+}
+
+TrajectoryPredictor::TrajectoryPredictor() {
+	// hold, and one to three more presses of the thruster (space)
+	offsets = { ofVec3f(0, 0, 0), ofVec3f(0, .5, 0), ofVec3f(0, 1, 0), ofVec3f(0, 1.5, 0) };
+	horizon = 8;
+	dt = 1.0 / 30;
+}
+
+// Height of the terrain under p, false if p is above the terrain's top or
+// there is none under it.  Each lane keeps its own cursor into the octree.
+bool TrajectoryPredictor::ground(LanderSim &sim, int lane, const ofVec3f &p, float &height) {
+	if (sim.tiles) {
+		const Octree *tile = sim.tiles->octreeAt(p.x, p.z);
+		if (tile == NULL || p.y > tile->root.parameters[1].y()) return false;
+		ofVec3f normal;
+		return sim.tiles->surfaceAt(p.x, p.z, height, normal);
+	}
+	if (sim.octree.mesh == NULL || p.y > sim.octree.root.parameters[1].y()) return false;
+	Ray ray(Vector3(p.x, p.y, p.z), Vector3(0, -1, 0));
+	vector<int> hits = cursors[lane].getIntersectingVertices(sim.octree, ray);
+	if (hits.empty()) return false;
+	height = sim.terrain.getVertex(hits[0]).y;
+	for (int i : hits) height = max(height, sim.terrain.getVertex(i).y);
+	return true;
+}
+
+void TrajectoryPredictor::predict(LanderSim &sim) {
+	PROFILE_SCOPE("trajectory prediction");
+	int lanes = offsets.size();
+	paths.resize(lanes);
+	cursors.resize(lanes);
+	for (PredictedPath &path : paths) {
+		path.points.clear();
+		path.touchdown = false;
+	}
+	if (lanes == 0 || sim.landed) return;
+
+	// the forces but the thruster, held over the look-ahead; gravity as the
+	// next step() sets it
+	const Particle &ship = sim.ship();
+	Particle probe = ship;
+	probe.forces = ofVec3f(0, -sim.gravity, 0) * ship.mass;
+	for (ParticleForce *f : sim.sys.forces) {
+		if (f != &sim.thruster && f != &sim.gravityForce && !f->applyOnce) f->updateForce(&probe);
+	}
+
+	StepRule rule;
+	rule.type = sim.sys.integrator;
+	rule.h = dt;
+	rule.drag = Particle::dragCoefficient(ship.damping);
+	rule.damping = Particle::dampingFactor(ship.damping, dt);
+	int steps = max(1, (int) ceil(horizon / dt));
+
+	for (int g = 0; g < lanes; g += 4) {
+		// lanes past the last one repeat it and are dropped
+		float x[4], y[4], z[4], vx[4], vy[4], vz[4], cx[4], cy[4], cz[4];
+		float lastHeight[4];
+		bool hadGround[4];
+		int running = 0;
+		for (int l = 0; l < 4; l++) {
+			int k = min(g + l, lanes - 1);
+			ofVec3f thrust = sim.thruster.get() + offsets[k];
+			ofVec3f c = ship.acceleration + (probe.forces + thrust) / ship.mass;
+			x[l] = ship.position.x;
+			y[l] = ship.position.y;
+			z[l] = ship.position.z;
+			vx[l] = ship.velocity.x;
+			vy[l] = ship.velocity.y;
+			vz[l] = ship.velocity.z;
+			cx[l] = c.x;
+			cy[l] = c.y;
+			cz[l] = c.z;
+			lastHeight[l] = 0;
+			hadGround[l] = false;
+			if (g + l >= lanes) continue;
+			paths[k].thrust = thrust;
+			paths[k].points.push_back(ship.position);
+			running |= 1 << l;
+		}
+
+		for (int s = 1; s <= steps && running; s++) {
+			float lastVx[4], lastVy[4], lastVz[4];
+			memcpy(lastVx, vx, sizeof(vx));
+			memcpy(lastVy, vy, sizeof(vy));
+			memcpy(lastVz, vz, sizeof(vz));
+			stepAxis(x, vx, cx, rule);
+			stepAxis(y, vy, cy, rule);
+			stepAxis(z, vz, cz, rule);
+
+			for (int l = 0; l < 4; l++) {
+				if (!(running & (1 << l))) continue;
+				PredictedPath &path = paths[g + l];
+				ofVec3f p(x[l], y[l], z[l]);
+				float height = 0;
+				bool found = ground(sim, g + l, p, height);
+				// the ray down misses once the step has gone under the
+				// surface; the ground under the last point stands in
+				if (!found && hadGround[l]) {
+					found = true;
+					height = lastHeight[l];
+				}
+				if (!found || p.y > height) {
+					path.points.push_back(p);
+					lastHeight[l] = height;
+					hadGround[l] = found;
+					continue;
+				}
+
+				// down: where along the step the clearance ran out
+				const ofVec3f &last = path.points.back();
+				float before = last.y - lastHeight[l], after = p.y - height;
+				float t = hadGround[l] && before > 0 ? before / (before - after) : 1;
+				ofVec3f v(vx[l], vy[l], vz[l]), lastV(lastVx[l], lastVy[l], lastVz[l]);
+				path.touchdown = true;
+				path.touchdownTime = (s - 1 + t) * dt;
+				path.touchdownPoint = last + (p - last) * t;
+				if (!hadGround[l] || before <= 0) path.touchdownPoint.y = height;
+				path.touchdownVelocity = lastV + (v - lastV) * t;
+				path.points.push_back(path.touchdownPoint);
+				running &= ~(1 << l);
+			}
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "ofMain.h"
+#include "LanderSim.h"
+
+//  Landing prediction: where the lander comes down if the pilot holds the
+//  current thrust, and if they add a few more presses of the thruster.
+//
+//  Each candidate thrust is one lane of a batch, four lanes to an SSE
+//  vector, integrated forward with the ship's integrator and step rules
+//  (see Particle::integrate and ParticleSystem::integrateRK4).  The forces
+//  other than the thruster are evaluated once on the ship and held over the
+//  look-ahead, which is exact for gravity; one-shot impulses are left out.
+//  Below the top of the terrain every step casts the ray straight down that
+//  the AGL uses, through one OctreeCursor per lane since consecutive steps
+//  are a short way apart, and the path ends where it meets the ground.
+//
+
+struct PredictedPath {
+	ofVec3f thrust;
+	vector<ofVec3f> points;         // from the ship, one per step
+	bool touchdown;                 // met the ground within the horizon
+	float touchdownTime;            // sec from now
+	ofVec3f touchdownPoint, touchdownVelocity;
+};
+
+class TrajectoryPredictor {
+public:
+	TrajectoryPredictor();
+
+	// fills paths, one per entry of offsets
+	void predict(LanderSim &sim);
+
+	// thrust settings tried, added to the ship's current thrust; the first
+	// is the current thrust itself
+	vector<ofVec3f> offsets;
+	float horizon;                  // sec
+	float dt;                       // sec per step
+	vector<PredictedPath> paths;
+
+private:
+	bool ground(LanderSim &sim, int lane, const ofVec3f &p, float &height);
+
+	vector<OctreeCursor> cursors;   // per lane
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+
+//  Latest-value handoff between one writer thread and one reader thread.
+//  The writer fills back() and publish()es it; the reader acquire()s the
+//  newest published slot and reads front() until its next acquire().
+//  Neither side ever waits: the writer always has a free slot, and a slot
+//  the reader skipped is simply written over.
+//
+
+template <class T>
+class TripleBuffer {
+public:
+	TripleBuffer() : backIndex(0), frontIndex(1), middle(2) {}
+
+	// writer
+	T &back() { return slots[backIndex]; }
+	void publish() {
+		backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// reader: true if a newer slot was published since the last acquire
+	bool acquire() {
+		if (!(middle.load(std::memory_order_relaxed) & freshBit)) return false;
+		frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+	const T &front() const { return slots[frontIndex]; }
+
+private:
+	static const int indexMask = 3, freshBit = 4;
+	T slots[3];
+	int backIndex, frontIndex;       // owned by the writer and the reader
+	std::atomic<int> middle;         // the slot in between, plus freshBit
+};
@@ -23,4 +23,45 @@ bool rayIntersectPlane(const ofVec3f &rayPoint, const ofVec3f &raydir, const ofV
 // Compute the reflection of a vector incident on a surface at the normal.
 ofVec3f reflectVector(const ofVec3f &v, const ofVec3f &n) {
 	return (v - 2 * v.dot(n) * n);
-}
\ No newline at end of file
+}
+
+// spread the low 16 bits of v out to the even bits
+static uint32_t spreadBits(uint32_t v) {
+	v &= 0x0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+uint32_t mortonKey2D(uint32_t x, uint32_t z) {
+	return spreadBits(x) | (spreadBits(z) << 1);
+}
+
+// four counting-sort passes of 8 bits each, O(n) regardless of the keys
+void radixSortByKey(vector<uint32_t> &keys, vector<int> &values,
+	vector<uint32_t> &keyScratch, vector<int> &valueScratch) {
+	size_t n = keys.size();
+	if (n == 0) return;
+	keyScratch.resize(n);
+	valueScratch.resize(n);
+	for (int shift = 0; shift < 32; shift += 8) {
+		size_t count[257] = { 0 };
+		for (size_t i = 0; i < n; i++)
+			count[((keys[i] >> shift) & 0xff) + 1]++;
+
+		// all keys share this digit, nothing to do for this pass
+		if (count[((keys[0] >> shift) & 0xff) + 1] == n) continue;
+
+		for (int d = 0; d < 256; d++)
+			count[d + 1] += count[d];
+		for (size_t i = 0; i < n; i++) {
+			size_t dst = count[(keys[i] >> shift) & 0xff]++;
+			keyScratch[dst] = keys[i];
+			valueScratch[dst] = values[i];
+		}
+		keys.swap(keyScratch);
+		values.swap(valueScratch);
+	}
+}
@@ -7,5 +7,10 @@ bool rayIntersectPlane(const ofVec3f &rayPoint, const ofVec3f &raydir, ofVec3f c
 
 ofVec3f reflectVector(const ofVec3f &v, const ofVec3f &normal);
 
+// interleave the low 16 bits of x and z into a 2D Morton (z-order) key
+uint32_t mortonKey2D(uint32_t x, uint32_t z);
 
-
+// sort "values" by their 32 bit "keys" (LSD radix sort, stable).  Both
+// vectors are reordered; scratch buffers are passed in so they can be reused.
+void radixSortByKey(vector<uint32_t> &keys, vector<int> &values,
+	vector<uint32_t> &keyScratch, vector<int> &valueScratch);
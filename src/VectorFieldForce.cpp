@@ -0,0 +1,212 @@
+
+#include "VectorFieldForce.h"
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FIELD_SSE 1
+#endif
+
+struct VectorFieldHeader {
+	char magic[4];                  // "VFLD"
+	uint32_t version;
+	uint32_t byteOrder;             // 0x01020304 as written
+	uint32_t nx, ny, nz;
+	float lower[3], upper[3];
+	uint32_t perMass;
+	uint32_t reserved[3];
+};
+
+static const uint32_t fieldVersion = 1;
+static const uint32_t byteOrderMark = 0x01020304;
+
+VectorFieldForce::VectorFieldForce() {
+	perMass = false;
+	setup(ofVec3f(-1, -1, -1), ofVec3f(1, 1, 1), 2, 2, 2);
+}
+
+void VectorFieldForce::setup(const ofVec3f &min, const ofVec3f &max, int nx, int ny, int nz) {
+	lower = min;
+	upper = max;
+	this->nx = std::max(nx, 2);
+	this->ny = std::max(ny, 2);
+	this->nz = std::max(nz, 2);
+	sx = (this->nx - 1) / std::max(max.x - min.x, 1e-6f);
+	sy = (this->ny - 1) / std::max(max.y - min.y, 1e-6f);
+	sz = (this->nz - 1) / std::max(max.z - min.z, 1e-6f);
+	nodes.assign(4 * numNodes(), 0);
+}
+
+ofVec3f VectorFieldForce::nodePosition(int i, int j, int k) const {
+	return ofVec3f(lower.x + i / sx, lower.y + j / sy, lower.z + k / sz);
+}
+
+void VectorFieldForce::bake(ParticleForce &force, bool perMass) {
+	Particle probe;
+	probe.mass = perMass ? 1 : probe.mass;
+	bake([&](const ofVec3f &p) {
+		probe.position = p;
+		probe.velocity.set(0, 0, 0);
+		probe.forces.set(0, 0, 0);
+		force.updateForce(&probe);
+		return probe.forces;
+	}, perMass);
+}
+
+void VectorFieldForce::bake(std::function<ofVec3f(const ofVec3f &)> field, bool perMass) {
+	this->perMass = perMass;
+	float *n = nodes.data();
+	for (int k = 0; k < nz; k++) {
+		for (int j = 0; j < ny; j++) {
+			for (int i = 0; i < nx; i++, n += 4) {
+				ofVec3f f = field(nodePosition(i, j, k));
+				n[0] = f.x;
+				n[1] = f.y;
+				n[2] = f.z;
+				n[3] = 0;
+			}
+		}
+	}
+}
+
+bool VectorFieldForce::save(const string &path) const {
+	VectorFieldHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "VFLD", 4);
+	h.version = fieldVersion;
+	h.byteOrder = byteOrderMark;
+	h.nx = nx;
+	h.ny = ny;
+	h.nz = nz;
+	h.lower[0] = lower.x;
+	h.lower[1] = lower.y;
+	h.lower[2] = lower.z;
+	h.upper[0] = upper.x;
+	h.upper[1] = upper.y;
+	h.upper[2] = upper.z;
+	h.perMass = perMass;
+
+	ofstream out(path.c_str(), ios::binary);
+	out.write((const char *) &h, sizeof(h));
+	out.write((const char *) nodes.data(), nodes.size() * sizeof(float));
+	if (!out) {
+		ofLogError("VectorFieldForce") << "can't write " << path;
+		return false;
+	}
+	return true;
+}
+
+bool VectorFieldForce::load(const string &path) {
+	ifstream in(path.c_str(), ios::binary);
+	if (!in) {
+		ofLogError("VectorFieldForce") << "can't open " << path;
+		return false;
+	}
+	VectorFieldHeader h;
+	in.read((char *) &h, sizeof(h));
+	uint64_t count = (uint64_t) h.nx * h.ny * h.nz;
+	if (!in || memcmp(h.magic, "VFLD", 4) != 0 || h.version != fieldVersion || h.byteOrder != byteOrderMark ||
+		h.nx < 2 || h.ny < 2 || h.nz < 2 || count > (1u << 28)) {
+		ofLogError("VectorFieldForce") << path << " is damaged or from another version";
+		return false;
+	}
+	setup(ofVec3f(h.lower[0], h.lower[1], h.lower[2]), ofVec3f(h.upper[0], h.upper[1], h.upper[2]), h.nx, h.ny, h.nz);
+	perMass = h.perMass != 0;
+	in.read((char *) nodes.data(), nodes.size() * sizeof(float));
+	if (!in) {
+		ofLogError("VectorFieldForce") << "truncated field file " << path;
+		setup(lower, upper, 2, 2, 2);
+		return false;
+	}
+	return true;
+}
+
+// the eight nodes from c, c + 4 (x), c + dy, c + dz on, weighted by t
+static inline ofVec3f trilinear(const float *c, int dy, int dz, float tx, float ty, float tz) {
+#ifdef FIELD_SSE
+	auto lerp = [](__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); };
+	__m128 fx = _mm_set1_ps(tx);
+	__m128 c00 = lerp(_mm_loadu_ps(c), _mm_loadu_ps(c + 4), fx);
+	__m128 c10 = lerp(_mm_loadu_ps(c + dy), _mm_loadu_ps(c + dy + 4), fx);
+	__m128 c01 = lerp(_mm_loadu_ps(c + dz), _mm_loadu_ps(c + dz + 4), fx);
+	__m128 c11 = lerp(_mm_loadu_ps(c + dz + dy), _mm_loadu_ps(c + dz + dy + 4), fx);
+	__m128 fy = _mm_set1_ps(ty);
+	__m128 r = lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), _mm_set1_ps(tz));
+	float out[4];
+	_mm_storeu_ps(out, r);
+	return ofVec3f(out[0], out[1], out[2]);
+#else
+	float out[3];
+	for (int a = 0; a < 3; a++) {
+		float c00 = c[a] + (c[a + 4] - c[a]) * tx;
+		float c10 = c[dy + a] + (c[dy + a + 4] - c[dy + a]) * tx;
+		float c01 = c[dz + a] + (c[dz + a + 4] - c[dz + a]) * tx;
+		float c11 = c[dz + dy + a] + (c[dz + dy + a + 4] - c[dz + dy + a]) * tx;
+		float c0 = c00 + (c10 - c00) * ty;
+		float c1 = c01 + (c11 - c01) * ty;
+		out[a] = c0 + (c1 - c0) * tz;
+	}
+	return ofVec3f(out[0], out[1], out[2]);
+#endif
+}
+
+// Trilinear over the cell holding p.  The lower node of the cell is kept
+// one short of the last so the upper face of the grid is still inside.
+ofVec3f VectorFieldForce::sample(const ofVec3f &p) const {
+	float gx = (p.x - lower.x) * sx;
+	float gy = (p.y - lower.y) * sy;
+	float gz = (p.z - lower.z) * sz;
+	// written so NaN is outside too
+	if (!(gx >= 0 && gy >= 0 && gz >= 0 && gx <= nx - 1 && gy <= ny - 1 && gz <= nz - 1)) return ofVec3f(0, 0, 0);
+	int i = std::min((int) gx, nx - 2);
+	int j = std::min((int) gy, ny - 2);
+	int k = std::min((int) gz, nz - 2);
+	return trilinear(&nodes[4 * (i + nx * (j + ny * k))], 4 * nx, 4 * nx * ny, gx - i, gy - j, gz - k);
+}
+
+void VectorFieldForce::updateForce(Particle *particle) {
+	ofVec3f f = sample(particle->position);
+	particle->forces += perMass ? f * particle->mass : f;
+}
+
+// Four particles at a time: the cells and weights are worked out side by
+// side with SSE, then each particle interpolates its own cell.
+void VectorFieldForce::updateForces(Particle *particles, int n) {
+	int i = 0;
+#ifdef FIELD_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lx = _mm_set1_ps(lower.x), ly = _mm_set1_ps(lower.y), lz = _mm_set1_ps(lower.z);
+	const __m128 scx = _mm_set1_ps(sx), scy = _mm_set1_ps(sy), scz = _mm_set1_ps(sz);
+	const __m128 lastx = _mm_set1_ps(nx - 1), lasty = _mm_set1_ps(ny - 1), lastz = _mm_set1_ps(nz - 1);
+	const __m128 cellx = _mm_set1_ps(nx - 2), celly = _mm_set1_ps(ny - 2), cellz = _mm_set1_ps(nz - 2);
+	const float *data = nodes.data();
+	int dy = 4 * nx, dz = 4 * nx * ny;
+	alignas(16) int ix[4], iy[4], iz[4];
+	alignas(16) float tx[4], ty[4], tz[4];
+	for (; i + 4 <= n; i += 4) {
+		Particle *p = particles + i;
+		__m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(p[0].position.x, p[1].position.x, p[2].position.x, p[3].position.x), lx), scx);
+		__m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(p[0].position.y, p[1].position.y, p[2].position.y, p[3].position.y), ly), scy);
+		__m128 gz = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(p[0].position.z, p[1].position.z, p[2].position.z, p[3].position.z), lz), scz);
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(gx, zero), _mm_cmple_ps(gx, lastx)),
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(gy, zero), _mm_cmple_ps(gy, lasty)),
+				_mm_and_ps(_mm_cmpge_ps(gz, zero), _mm_cmple_ps(gz, lastz))));
+		int mask = _mm_movemask_ps(inside);
+		if (mask == 0) continue;
+
+		__m128i cx = _mm_cvttps_epi32(_mm_min_ps(gx, cellx));
+		__m128i cy = _mm_cvttps_epi32(_mm_min_ps(gy, celly));
+		__m128i cz = _mm_cvttps_epi32(_mm_min_ps(gz, cellz));
+		_mm_store_si128((__m128i *) ix, cx);
+		_mm_store_si128((__m128i *) iy, cy);
+		_mm_store_si128((__m128i *) iz, cz);
+		_mm_store_ps(tx, _mm_sub_ps(gx, _mm_cvtepi32_ps(cx)));
+		_mm_store_ps(ty, _mm_sub_ps(gy, _mm_cvtepi32_ps(cy)));
+		_mm_store_ps(tz, _mm_sub_ps(gz, _mm_cvtepi32_ps(cz)));
+		for (int l = 0; l < 4; l++) {
+			if (!(mask & (1 << l))) continue;
+			ofVec3f f = trilinear(data + 4 * (ix[l] + nx * (iy[l] + ny * iz[l])), dy, dz, tx[l], ty[l], tz[l]);
+			p[l].forces += perMass ? f * p[l].mass : f;
+		}
+	}
+#endif
+	for (; i < n; i++) updateForce(&particles[i]);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "ofMain.h"
+#include "ParticleSystem.h"
+#include <functional>
+
+//  Force field baked into a 3D grid.
+//
+//  The force at each grid node is worked out once, by bake() from any
+//  ParticleForce or function at load time, or by load() from a file that
+//  save() wrote offline.  A particle then takes the trilinear interpolation
+//  of the eight nodes around it, so a field costs about what GravityForce
+//  does per particle however expensive it was to compute.  Nodes are 16
+//  bytes (x, y, z and padding); updateForces() finds the cells of four
+//  particles at a time and interpolates the three components at once, with
+//  SSE.
+//
+//  Baking a ParticleForce calls it on a probe particle at rest on each node:
+//  forces that depend on velocity bake as they are at rest, and random ones
+//  (TurbulenceForce) freeze into a fixed pattern.  With perMass the probe
+//  has unit mass and samples are scaled by each particle's mass, for fields
+//  that are accelerations, like gravity.  Outside the grid the force is zero.
+//
+
+class VectorFieldForce : public ParticleForce {
+public:
+	VectorFieldForce();
+
+	// nx * ny * nz nodes (2 or more each way) spanning min .. max, zeroed
+	void setup(const ofVec3f &min, const ofVec3f &max, int nx, int ny, int nz);
+	void bake(ParticleForce &force, bool perMass = false);
+	void bake(std::function<ofVec3f(const ofVec3f &)> field, bool perMass = false);
+
+	// binary, 64 byte header then the nodes
+	bool save(const string &path) const;
+	bool load(const string &path);
+
+	ofVec3f sample(const ofVec3f &p) const;
+	void updateForce(Particle *);
+	void updateForces(Particle *particles, int n);
+
+	ofVec3f getMin() const { return lower; }
+	ofVec3f getMax() const { return upper; }
+	int numNodes() const { return nx * ny * nz; }
+
+	bool perMass;
+
+private:
+	ofVec3f nodePosition(int i, int j, int k) const;
+
+	ofVec3f lower, upper;           // grid corners
+	int nx, ny, nz;
+	float sx, sy, sz;               // grid steps per world unit
+	TaggedVector<float, MemParticles> nodes;   // x fastest, then y, then z
+};
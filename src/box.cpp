@@ -1,6 +1,10 @@
 #include "vector3.h"
 #include "ray.h"
 #include "box.h"
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BOX_SSE 1
+#endif
   
 /*
  * Ray-box intersection using IEEE numerical properties to ensure that the
@@ -44,3 +48,79 @@ bool Box::contains(const ofVec3f &point) const {
             parameters[1].y() > point.y &&
             parameters[1].z() > point.z);
 }
+
+#ifdef BOX_SSE
+// mask ? a : b per lane
+static inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+// Four boxes per step, lane for lane the same comparisons as intersect()
+// above, so a NaN slab (ray in the plane of a face) gives the same answer.
+unsigned Box::intersect(const Box *boxes, int n, const Ray &r, float t0, float t1) {
+  unsigned hits = 0;
+#ifdef BOX_SSE
+  const int sx = r.sign[0], sy = r.sign[1], sz = r.sign[2];
+  const __m128 ox = _mm_set1_ps(r.origin.x()), oy = _mm_set1_ps(r.origin.y()), oz = _mm_set1_ps(r.origin.z());
+  const __m128 ix = _mm_set1_ps(r.inv_direction.x()), iy = _mm_set1_ps(r.inv_direction.y()),
+    iz = _mm_set1_ps(r.inv_direction.z());
+  for (int i = 0; i < n; i += 4) {
+    // a short last group repeats its last box, the extra lanes are masked off
+    const Box &a = boxes[i], &b = boxes[std::min(i + 1, n - 1)], &c = boxes[std::min(i + 2, n - 1)], &d = boxes[std::min(i + 3, n - 1)];
+    __m128 tmin = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a.parameters[sx].x(), b.parameters[sx].x(),
+      c.parameters[sx].x(), d.parameters[sx].x()), ox), ix);
+    __m128 tmax = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a.parameters[1-sx].x(), b.parameters[1-sx].x(),
+      c.parameters[1-sx].x(), d.parameters[1-sx].x()), ox), ix);
+    __m128 tymin = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a.parameters[sy].y(), b.parameters[sy].y(),
+      c.parameters[sy].y(), d.parameters[sy].y()), oy), iy);
+    __m128 tymax = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a.parameters[1-sy].y(), b.parameters[1-sy].y(),
+      c.parameters[1-sy].y(), d.parameters[1-sy].y()), oy), iy);
+    __m128 miss = _mm_or_ps(_mm_cmpgt_ps(tmin, tymax), _mm_cmpgt_ps(tymin, tmax));
+    tmin = select(_mm_cmpgt_ps(tymin, tmin), tymin, tmin);
+    tmax = select(_mm_cmplt_ps(tymax, tmax), tymax, tmax);
+    __m128 tzmin = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a.parameters[sz].z(), b.parameters[sz].z(),
+      c.parameters[sz].z(), d.parameters[sz].z()), oz), iz);
+    __m128 tzmax = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(a.parameters[1-sz].z(), b.parameters[1-sz].z(),
+      c.parameters[1-sz].z(), d.parameters[1-sz].z()), oz), iz);
+    miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmpgt_ps(tmin, tzmax), _mm_cmpgt_ps(tzmin, tmax)));
+    tmin = select(_mm_cmpgt_ps(tzmin, tmin), tzmin, tmin);
+    tmax = select(_mm_cmplt_ps(tzmax, tmax), tzmax, tmax);
+    __m128 hit = _mm_andnot_ps(miss, _mm_and_ps(_mm_cmplt_ps(tmin, _mm_set1_ps(t1)),
+      _mm_cmpgt_ps(tmax, _mm_set1_ps(t0))));
+    unsigned lanes = (1u << std::min(4, n - i)) - 1;
+    hits |= (_mm_movemask_ps(hit) & lanes) << i;
+  }
+#else
+  for (int i = 0; i < n; i++)
+    if (boxes[i].intersect(r, t0, t1)) hits |= 1u << i;
+#endif
+  return hits;
+}
+
+int Box::contains(const float *x, const float *y, const float *z, int n, uint8_t *inside) const {
+  const float lx = parameters[0].x(), ly = parameters[0].y(), lz = parameters[0].z();
+  const float hx = parameters[1].x(), hy = parameters[1].y(), hz = parameters[1].z();
+  int count = 0, i = 0;
+#ifdef BOX_SSE
+  const __m128 vlx = _mm_set1_ps(lx), vly = _mm_set1_ps(ly), vlz = _mm_set1_ps(lz);
+  const __m128 vhx = _mm_set1_ps(hx), vhy = _mm_set1_ps(hy), vhz = _mm_set1_ps(hz);
+  for (; i + 4 <= n; i += 4) {
+    __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+    __m128 in = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(vlx, px), _mm_cmpgt_ps(vhx, px)),
+      _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(vly, py), _mm_cmpgt_ps(vhy, py)),
+        _mm_and_ps(_mm_cmplt_ps(vlz, pz), _mm_cmpgt_ps(vhz, pz))));
+    int m = _mm_movemask_ps(in);
+    inside[i] = m & 1;
+    inside[i + 1] = (m >> 1) & 1;
+    inside[i + 2] = (m >> 2) & 1;
+    inside[i + 3] = m >> 3;
+    count += inside[i] + inside[i + 1] + inside[i + 2] + inside[i + 3];
+  }
+#endif
+  for (; i < n; i++) {
+    inside[i] = lx < x[i] && ly < y[i] && lz < z[i] && hx > x[i] && hy > y[i] && hz > z[i];
+    count += inside[i];
+  }
+  return count;
+}
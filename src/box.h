@@ -5,6 +5,7 @@
 #include "vector3.h"
 #include "ray.h"
 #include "ofMain.h"
+#include "MemoryTags.h"
 
 #include <vector>
 
@@ -18,6 +19,9 @@
  *
  */
 
+class Box;
+typedef TaggedVector<Box, MemOctree> BoxList;    // octree nodes count as octree memory
+
 class Box {
   public:
     Box() { }
@@ -36,8 +40,14 @@ class Box {
     }
     // (t0, t1) is the interval for valid hits
     bool intersect(const Ray &, float t0, float t1) const;
+    // the same test against n (up to 32) boxes, four at a time with SSE;
+    // bit i of the result is set if boxes[i] is hit
+    static unsigned intersect(const Box *boxes, int n, const Ray &, float t0, float t1);
     // returns true if the box contains the point
     bool contains(const ofVec3f &point) const;
+    // batch form for points split into x, y and z arrays: sets inside[i]
+    // for each point and returns how many are inside
+    int contains(const float *x, const float *y, const float *z, int n, uint8_t *inside) const;
     
     // corners
     Vector3 parameters[2];
@@ -45,8 +55,8 @@ class Box {
 	Vector3 max() { return parameters[1]; }
     
     // octree children
-    std::vector<Box> children;
-    std::vector<int> vertexIndices;
+    BoxList children;
+    TaggedVector<int, MemOctree> vertexIndices;
     int level;
     bool containsSelectedVertex;
 };
@@ -2,12 +2,15 @@
 #include "ofApp.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
 	ofSetupOpenGL(1024,768,OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	// optional terrain: an OBJ path or a "procedural:..." spec
+	ofApp *app = new ofApp();
+	if (argc > 1) app->terrainSource = argv[1];
+	ofRunApp(app);
 
 }
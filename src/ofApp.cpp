@@ -4,6 +4,9 @@
 
 #include "ofApp.h"
 #include "Util.h"
+#include "TerrainGenerator.h"
+#include "MeshCache.h"
+#include "Profiler.h"
 #include <vector>
 #include <map>
 
@@ -21,22 +24,16 @@ void ofApp::setup() {
 	bTerrainSelected = true;
 	bHide = true;
 	bPointSelectedOctree = false;
-	landed = false; // Landing flag default set to false
+	bShowProfiler = false;
+	bShowPrediction = true;
+	maxTileUploadsPerFrame = 4;
+	predictionStrip.setMode(OF_PRIMITIVE_LINE_STRIP);
 
-	// texture loading
 	ofDisableArbTex();     // disable rectangular textures
-	if (!ofLoadImage(particleTex, "images/dot.png")) {
-		cout << "Particle Texture File: images/dot.png not found" << endl;
-		ofExit();
-	}
-    
-    background.load("images/stars.jpg");
 
-    #ifdef TARGET_OPENGLES
-        shader.load("shaders_gles/shader");
-    #else
-        shader.load("shaders/shader");
-    #endif
+	// room for this many live exhaust particles, extra ones are not drawn
+	particleStream.setup(1 << 18);
+	particlePointSize = 5;
 
 	ofSetVerticalSync(true);
 	ofEnableSmoothing();
@@ -49,18 +46,117 @@ void ofApp::setup() {
 	//
 	initLightingAndMaterials();
 
-	mars.loadModel("geo/marssurface.obj");
-	mars.setScaleNormalization(false);
-	marsMesh = mars.getMesh(0);
+	// Assets load in stages on worker threads (see AssetLoader), GL uploads
+	// happen in update() and a loading screen is drawn until all are in.
+	// Terrain: the Mars model unless another was given on the command line,
+	// drawn from a static vbo; a tile pyramid is paged in as the lander moves.
+	if (terrainSource == "") terrainSource = "geo/marssurface.obj";
+	bProceduralTerrain = TerrainGenerator::isSpec(terrainSource);
+	bTiledTerrain = terrainSource.compare(0, 6, "tiles:") == 0;
+	bLoaded = false;
+
+	loader.add("particle texture",
+		[this]() { return ofLoadImage(particlePixels, "images/dot.png"); },
+		[this]() { particleTex.loadData(particlePixels); particlePixels.clear(); return true; });
+	loader.add("background",
+		[this]() { return ofLoadImage(backgroundPixels, "images/stars.jpg"); },
+		[this]() { background.setFromPixels(backgroundPixels); backgroundPixels.clear(); return true; });
+	loader.add("shaders", nullptr, [this]() {
+#ifdef TARGET_OPENGLES
+		return shader.load("shaders_gles/shader");
+#else
+		return shader.load("shaders/shader");
+#endif
+	});
+
+	int terrain;
+	if (bTiledTerrain) {
+		terrain = loader.add("terrain tiles", [this]() {
+			if (!tiles.open(terrainSource.substr(6))) return false;
+			boundingBox = Box(Vector3(tiles.minx, tiles.miny, tiles.minz), Vector3(tiles.maxx, tiles.maxy, tiles.maxz));
+			return true;
+		}, [this]() { sim.tiles = &tiles; return true; });
+	}
+	else {
+		// parse or generate, then the octree; drawn from terrainVbo either way
+		int mesh = loader.add("terrain", [this]() {
+			if (bProceduralTerrain) {
+				TerrainGenerator generator;
+				if (!TerrainGenerator::parseSpec(terrainSource, generator.params)) return false;
+				generator.generate(sim.terrain);
+				return true;
+			}
+			// through the binary cache, mapped until the upload
+			if (!openCachedObj(terrainSource, terrainCache)) return loadObjMesh(terrainSource, sim.terrain);
+			terrainCache.toMesh(sim.terrain);
+			return true;
+		}, [this]() {
+			if (terrainCache.isOpen()) terrainCache.upload(terrainVbo);
+			else terrainVbo.setMesh(sim.terrain, GL_STATIC_DRAW);
+			terrainCache.close();
+			return true;
+		}, {}, 4);
+		terrain = loader.add("terrain octree", [this]() {
+			sim.terrainMemory.setMesh(sim.terrain);
+			sim.octree.create(sim.terrain, sim.octreeMaxDepth);
+			boundingBox = Octree::meshBounds(sim.terrain);
+			return true;
+		}, nullptr, { mesh }, 8);
+	}
 
-	rover.loadModel("geo/lander.obj");
-	rover.setScaleNormalization(false);
-	roverMesh = rover.getMesh(0);
-	bRoverLoaded = true;
+	// the lander's bounds come from our own OBJ reader off the main thread;
+	// the Assimp model (materials and GL buffers) has to load on the main thread
+	int lander = loader.add("lander", [this]() {
+		if (!loadCachedObjMesh("geo/lander.obj", roverMesh)) return false;
+		roverMemory.setMesh(roverMesh);
+		roverBox = Octree::meshBounds(roverMesh);
+		return true;
+	}, [this]() {
+		rover.loadModel("geo/lander.obj");
+		rover.setScaleNormalization(false);
+		bRoverLoaded = true;
+		return true;
+	});
+	loader.add("sound", nullptr, [this]() {
+		soundPlayer.load("sounds/thruster.mp3");
+		soundPlayer.setLoop(true);
+		return true;
+	});
+	loader.add("scene", nullptr, [this]() { setupScene(); return true; }, { terrain, lander });
+	loader.start();
 
-	roverBox = meshBounds(roverMesh);
-	boundingBox = meshBounds(marsMesh);
+	gui.setup();
+	gui.add(sliderOctreeDepth.setup("Octree depth", 0, 0, 1));
+	gui.add(gravity.setup("Gravity", 0.2, 0, 2)); // Need to connect gui slider to actual slider and update in-app
 
+	// setup thruster emission effect
+	thruster_emitter.setVelocity(ofVec3f(0, -5, 0));
+	thruster_emitter.setGroupSize(100);
+	thruster_emitter.setEmitterType(DiscEmitter);
+	thruster_emitter.setColor(ofColor(255, 0, 0));
+	thruster_emitter.setPosition(ofVec3f(0, 10, 0));
+	thruster_emitter.setLifespan(0.5);
+	thruster_emitter.setRate(60);           // groups of 100 per sec
+	thruster_emitter.setParticleRadius(.1);
+	thruster_emitter.setMass(10);
+	thruster_emitter.discradius = 0.4;
+	thruster_emitter.sys->setIntegrator(SemiImplicitEulerIntegrator);
+	thruster_emitter.sys->setCollisionResponse(BounceCollision, 0.3, 0.4);
+
+	fixedDt = 1.0 / 60;
+	accumulator = 0;
+	tick = 0;
+	bReplaying = false;
+	bReplayMaxSpeed = false;
+	gravitySetting = 0.2;
+	simThreadRunning = false;
+	exhaustQuality = exhaustQualityApplied = 0;
+	frameStart = 0;
+}
+
+// Last loading stage, once the terrain and the lander are in: place the
+// lander and hook up everything that needs both.
+void ofApp::setupScene() {
 	// compute and calculate center vector
 	roverX = (roverBox.max().x() + roverBox.min().x()) / 2;
 	roverY = (roverBox.max().y() + roverBox.min().y()) / 2;
@@ -74,70 +170,36 @@ void ofApp::setup() {
 	bottom = ofVec3f(roverX, roverBox.min().y(), roverZ);
 	// cout << "Bottom point is: " << bottom << endl;
 
-	// generate octree
-	octreeHighestDepth = 0;
-	generateTree(boundingBox, marsMesh, octreeMaxDepth, octree);
-
-	gui.setup();
-	gui.add(sliderOctreeDepth.setup("Octree depth", 0, 0, octreeHighestDepth));
-	gui.add(gravity.setup("Gravity", 0.2, 0, 2)); // Need to connect gui slider to actual slider and update in-app
-
-	// setup thruster emission effect
-	thruster_emitter.setVelocity(ofVec3f(0, -5, 0));
-	thruster_emitter.setGroupSize(100);
-	thruster_emitter.setEmitterType(DiscEmitter);
-	thruster_emitter.setColor(ofColor(255, 0, 0));
-	thruster_emitter.setPosition(ofVec3f(0, 10, 0));
-	thruster_emitter.setLifespan(0.5);
-	thruster_emitter.setRate(10000000.0);
-	thruster_emitter.setParticleRadius(.1);
-	thruster_emitter.setMass(10);
-	thruster_emitter.discradius = 0.4;
-    
-    soundPlayer.load("sounds/thruster.mp3");
-    soundPlayer.setLoop(true);
+	sliderOctreeDepth.setMax(sim.octree.highestDepth);
+	thruster_emitter.sys->setTerrain(&sim.octree);
 
 	// "Ship" is the particle that the lander is mapped to
-	ship.color = ofColor::green;
-	ship.lifespan = 10000;
-	ship.position.set(roverX, roverY + 10, roverZ);
-	sys.add(ship);
+	sim.reset(ofVec3f(roverX, roverY + 10, roverZ));
+	sim.gravity = gravitySetting = gravity;
+	agl = sim.altitude();
 
-	sys.addForce(&thruster);
-	sys.addForce(&impulseForce);
-	//sys.addForce(new TurbulenceForce(ofVec3f(-0.2, -0.1, -0.3), ofVec3f(0.1, 0.2, 0.5)));
-	sys.addForce(new GravityForce(ofVec3f(0, -gravity, 0)));
+	setupFrameGraph();
+	setupGovernor();
 }
 
-// load vertex buffer in preparation for rendering
+// load vertex buffer in preparation for rendering.  Vertices are written
+// straight into the streaming buffer, nothing is allocated per frame.
+// Only position and birth time go up, the shader does the colour ramp.
 void ofApp::loadVbo() {
-	if (thruster_emitter.sys->particles.size() < 1) return;
-
-	vector<ofVec3f> sizes;
-	vector<ofVec3f> points;
-    vector<ofFloatColor> colors;
-	for (int i = 0; i < thruster_emitter.sys->particles.size(); i++) {
-		points.push_back(thruster_emitter.sys->particles[i].position);
-		sizes.push_back(ofVec3f(5));
-        
-        ofFloatColor color = ofColor::red;
-        
-        float newHue = 0 + (0.098 / (1000.0)) * (ofGetElapsedTimeMillis() - thruster_emitter.sys->particles[i].birthtime);
-        float newSaturation = 1.0 - (1.0 / (1000.0)) * (ofGetElapsedTimeMillis() - thruster_emitter.sys->particles[i].birthtime);
-        float newBrightness = 0.5 - (0.5 / (1000.0)) * (ofGetElapsedTimeMillis() - thruster_emitter.sys->particles[i].birthtime);
-        float newAlpha = 0.196 - (0.196 / (1000.0)) * (ofGetElapsedTimeMillis() - thruster_emitter.sys->particles[i].birthtime);
-        
-        color.setHsb(newHue, newSaturation, newBrightness, newAlpha);
-        
-        colors.push_back(color);
-	}
-	// upload the data to the vbo
-	//
-	int total = (int)points.size();
-	vbo.clear();
-	vbo.setVertexData(&points[0], total, GL_STATIC_DRAW);
-	vbo.setNormalData(&sizes[0], total, GL_STATIC_DRAW);
-    vbo.setColorData(&colors[0], total, GL_STATIC_DRAW);
+	PROFILE_SCOPE("loadVbo");
+	int total = pipelined() ? (int) snapshots.front().exhaust.size() : thruster_emitter.particleCount();
+	ParticleVertex *v = particleStream.begin(total);
+	if (v == NULL) return;
+	// pipelined, the sim thread has packed them already
+	if (pipelined()) memcpy(v, snapshots.front().exhaust.data(), sizeof(ParticleVertex) * total);
+	else packExhaust(v, total);
+	particleStream.end(total);
+}
+
+// the first "count" exhaust particles, from whichever store holds them
+void ofApp::packExhaust(ParticleVertex *out, int count) {
+	if (thruster_emitter.compact) thruster_emitter.compact->pack(out, count);
+	else packParticleVertices(thruster_emitter.sys->particles, out, count);
 }
 
 
@@ -145,43 +207,370 @@ void ofApp::loadVbo() {
 // incrementally update scene (animation)
 //
 void ofApp::update() {
-	if (!landed) {
-		GravityForce *grav = (GravityForce*)sys.forces.at(2);
-		grav->set(ofVec3f(0, -gravity, 0));
-		sys.update();
+	frameStart = ofGetElapsedTimeMicros();
+	Profiler::nextFrame();
+	MemoryTags::nextFrame();
+	PROFILE_SCOPE("update");
+	if (!bLoaded) {
+		bLoaded = loader.update();
+		if (loader.failed()) {
+			cout << "loading: " << loader.status() << endl;
+			ofExit();
+		}
+		if (bLoaded) cout << loader.report() << endl;
+		return;
+	}
+	gravitySetting = gravity;
+
+	if (pipelined()) {
+		// the sim thread steps on its own, take the newest snapshot
+		SimInput e;
+		while (simEffects.pop(e)) soundEffects(e.key, e.pressed, snapshots.front().landed);
+		snapshots.acquire();
+		const ofVec3f &p = snapshots.front().shipPosition;
+		rover.setPosition(p.x, p.y, p.z);
+		camera->spacecraft = rover.getPosition();
+		loadVbo();
+		return;
+	}
+
+	frameGraph.run(taskPool);
+}
 
+// The serial frame as a task graph, stages in their sequential order with
+// the data they touch.  The AGL ray, the exhaust and the camera only share
+// the ship they read, so they run at the same time.  Simulation (replays
+// play sounds), tile paging and the particle vbo need the main thread.
+void ofApp::setupFrameGraph() {
+	frameGraph.add("simulate", [this]() { advance(ofGetLastFrameTime()); },
+		{ "controls" }, { "ship", "octree marks", "tiles" }, true);
+	frameGraph.add("exhaust", [this]() {
+		applyExhaustQuality();
+		if (sim.landed) return;
 		thruster_emitter.update();
-		thruster_emitter.setPosition(sys.particles[0].position + ofVec3f(0, 0.5, 0));
-
-		rover.setPosition(sys.particles[0].position.x, sys.particles[0].position.y, sys.particles[0].position.z);
-		// check if rover point intersects with terrain mesh
-		// if list is not empty, print out first point collided
-		vector<int> selectedPoint = getCollision(octree.root, sys.particles[0].position);
-		// If list of collisions is not empty
-		if (selectedPoint.size() != 0) {
-			// Find the closest vertex
-			int closestVertex = selectedPoint[0];
-			ofVec3f selected = marsMesh.getVertex(closestVertex);
-			if (sys.particles[0].position.y > 20) { // rover is too high
-				landed = false;
-			}
+		thruster_emitter.setPosition(sim.ship().position + ofVec3f(0, 0.5, 0));
+	}, { "ship", "tiles" }, { "exhaust" });
+	frameGraph.add("camera", [this]() {
+		rover.setPosition(sim.ship().position.x, sim.ship().position.y, sim.ship().position.z);
+		camera->spacecraft = rover.getPosition();
+	}, { "ship" }, { "camera" });
+
+	// page terrain around the lander and the free camera; the exhaust
+	// bounces off the tile under the lander
+	if (bTiledTerrain) frameGraph.add("tile paging", [this]() {
+		tiles.update({ sim.ship().position, camera->cam.getPosition() });
+		const Octree *under = tiles.octreeAt(sim.ship().position.x, sim.ship().position.z);
+		thruster_emitter.sys->setTerrain(under ? under : &sim.octree);
+	}, { "ship", "camera" }, { "tiles", "exhaust" }, true);
+
+	// getIntersectingVertices marks the octree, like the collision test
+	frameGraph.add("AGL", [this]() { agl = sim.altitude(); }, { "ship", "tiles" }, { "agl", "octree marks" });
+	frameGraph.add("prediction", [this]() {
+		if (bShowPrediction) predictor.predict(sim);
+		else predictor.paths.clear();
+	}, { "ship", "tiles" }, { "prediction", "octree marks" });
+	frameGraph.add("exhaust vbo", [this]() { loadVbo(); }, { "exhaust" }, { "exhaust vbo" }, true);
+}
+
+// exhaust settings by quality level, full quality first
+static const int exhaustGroupSizes[] = { 100, 75, 50, 35, 25 };
+static const float exhaustRates[] = { 60, 50, 40, 30, 20 };
+static const float pointSizes[] = { 5, 4.5, 4, 3.5, 3 };
+static const float tileDetail[] = { 1, 0.8, 0.6, 0.45, 0.35 };
+
+void ofApp::setupGovernor() {
+	governor.budgetMs = 1000.0 / 60;
+	governor.maxLevel = 4;
+	governor.addKnob("exhaust", [this](int level) {
+		exhaustQuality = level;
+		return ofToString(exhaustGroupSizes[level]) + " x " + ofToString(exhaustRates[level]) + "/s";
+	});
+	governor.addKnob("point size", [this](int level) {
+		particlePointSize = pointSizes[level];
+		return ofToString(particlePointSize);
+	});
+	if (bTiledTerrain) {
+		float radius = tiles.radius;
+		governor.addKnob("tile radius", [this, radius](int level) {
+			tiles.radius = radius * tileDetail[level];
+			return ofToString(tiles.radius, 0);
+		});
+	}
+	// the slider's range, the current depth is clamped to it
+	governor.addKnob("octree depth", [this](int level) {
+		int depth = max(sim.octree.highestDepth - 2 * level, 1);
+		sliderOctreeDepth.setMax(depth);
+		if (sliderOctreeDepth > depth) sliderOctreeDepth = depth;
+		return ofToString(depth);
+	});
+}
+
+// on the thread that runs the exhaust: the frame graph or the sim thread
+void ofApp::applyExhaustQuality() {
+	int level = exhaustQuality;
+	if (level == exhaustQualityApplied) return;
+	thruster_emitter.setGroupSize(exhaustGroupSizes[level]);
+	thruster_emitter.setRate(exhaustRates[level]);
+	exhaustQualityApplied = level;
+}
+
+// Simulate "elapsed" sec of real time in fixed ticks, at most 8 at a time
+// so a stall drops time instead of spiralling.  A max speed replay runs as
+// many ticks as fit in 12 ms instead.
+void ofApp::advance(double elapsed) {
+	if (bReplaying && bReplayMaxSpeed) {
+		uint64_t start = ofGetElapsedTimeMicros();
+		while (bReplaying && ofGetElapsedTimeMicros() - start < 12000) simTick();
+		return;
+	}
+	accumulator += elapsed;
+	int ticks = 0;
+	while (accumulator >= fixedDt && ticks < 8) {
+		simTick();
+		accumulator -= fixedDt;
+		ticks++;
+	}
+	if (ticks == 8) accumulator = 0;
+}
+
+// One simulation step.  Everything that changes the lander goes through
+// here, in tick order, so a recording replays exactly: checkpoint first,
+// then the inputs for this tick, then the physics.
+void ofApp::simTick() {
+	PROFILE_SCOPE("sim tick");
+	if (bReplaying) {
+		if (!replay.verify(tick, sim.saveState()))
+			cout << "replay diverged from the recording at tick " << tick << endl;
+		InputEvent e;
+		while (replay.next(tick, e)) {
+			if (e.tag == LogGravity) sim.gravity = e.value;
 			else {
-				landed = true;
-				cout << "Collision detected at: " << selected << endl;
+				sim.control(e.key, e.tag == LogKeyDown);
+				exhaustEffects(e.key, e.tag == LogKeyDown);
+				if (pipelined()) simEffects.push({ e.key, e.tag == LogKeyDown });
+				else soundEffects(e.key, e.tag == LogKeyDown, sim.landed);
 			}
-			sys.particles[0].forces = ofVec3f(0, 0, 0);
 		}
+		if (replay.finished(tick)) {
+			bReplaying = false;
+			cout << "replay finished at tick " << tick << endl;
+		}
+	}
+	else {
+		if (recorder.due(tick)) recorder.checkpoint(tick, sim.saveState(), thruster_emitter.seed);
+		if (sim.gravity != gravitySetting) {
+			sim.gravity = gravitySetting;
+			recorder.gravity(tick, sim.gravity);
+		}
+		for (int i = 0; i < pendingControls.size(); i++) {
+			sim.control(pendingControls[i].first, pendingControls[i].second);
+			recorder.key(tick, pendingControls[i].first, pendingControls[i].second);
+		}
+		pendingControls.clear();
+	}
+
+	bool wasLanded = sim.landed;
+	sim.step(fixedDt);
+	tick++;
+	if (sim.landed && !wasLanded) {
+		cout << "Collision detected at: " << sim.touchdownPoint << endl;
 	}
-	camera->spacecraft = rover.getPosition();
+}
+
+// Flight keys reach the simulation on the next tick.  Sound and exhaust
+// follow straight away, they don't affect the flight.  Pipelined, the key
+// goes through simInputs and the sim thread starts the exhaust.
+void ofApp::queueControl(int key, bool pressed) {
+	if (bReplaying) return;
+	if (pipelined()) {
+		if (!simInputs.push({ key, pressed })) return;
+		soundEffects(key, pressed, snapshots.front().landed);
+		return;
+	}
+	pendingControls.push_back(make_pair(key, pressed));
+	controlEffects(key, pressed);
+}
+
+void ofApp::controlEffects(int key, bool pressed) {
+	exhaustEffects(key, pressed);
+	soundEffects(key, pressed, sim.landed);
+}
+
+void ofApp::exhaustEffects(int key, bool pressed) {
+	if (key != ' ') return;
+	if (!pressed) thruster_emitter.stop();
+	else if (!sim.landed && !thruster_emitter.started) thruster_emitter.start();
+}
+
+void ofApp::soundEffects(int key, bool pressed, bool landed) {
+	if (pressed) {
+		if (landed) return;
+		if (key == ' ' && !soundPlayer.isPlaying()) soundPlayer.play();
+		if (key == OF_KEY_RIGHT) soundPlayer.play();
+	}
+	else if (key == ' ') soundPlayer.stop();
+}
+
+//--------------------------------------------------------------
+// Pipelined mode.  The sim thread owns sim, tick, the exhaust, the recorder
+// and the replay while it runs; the main thread only reads snapshots and
+// sends keys, so the frame time is the slower of the two, not their sum.
+// Anything else that touches the flight stops the thread first.
+
+bool ofApp::startSimThread() {
+	if (pipelined()) return true;
+	if (bTiledTerrain) {
+		// tiles page and upload on the main thread, next to the collisions
+		cout << "pipelined simulation needs a single terrain mesh" << endl;
+		return false;
+	}
+	publishSnapshot();
+	snapshots.acquire();
+	simThreadRunning = true;
+	simThread = std::thread(&ofApp::simThreadLoop, this);
+	return true;
+}
+
+bool ofApp::stopSimThread() {
+	if (!pipelined()) return false;
+	simThreadRunning = false;
+	simThread.join();
+	// keys sent after its last step
+	applySimInputs();
+	SimInput e;
+	while (simEffects.pop(e)) soundEffects(e.key, e.pressed, sim.landed);
+	return true;
+}
+
+// Steps on its own clock the way update() does, then sleeps until the next
+// tick is due.
+void ofApp::simThreadLoop() {
+	uint64_t last = ofGetElapsedTimeMicros();
+	while (simThreadRunning) {
+		uint64_t now = ofGetElapsedTimeMicros();
+		float elapsed = (now - last) / 1e6;
+		last = now;
+		{
+			PROFILE_SCOPE("sim thread");
+			applySimInputs();
+			applyExhaustQuality();
+			advance(elapsed);
+			if (!sim.landed) {
+				thruster_emitter.update(elapsed);
+				thruster_emitter.setPosition(sim.ship().position + ofVec3f(0, 0.5, 0));
+			}
+			publishSnapshot();
+		}
+		double wait = fixedDt - accumulator;
+		if (!(bReplaying && bReplayMaxSpeed) && wait > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds((int64_t) (wait * 1e6)));
+	}
+}
+
+void ofApp::applySimInputs() {
+	SimInput e;
+	while (simInputs.pop(e)) {
+		pendingControls.push_back(make_pair(e.key, e.pressed));
+		exhaustEffects(e.key, e.pressed);
+	}
+}
+
+void ofApp::publishSnapshot() {
+	SimSnapshot &s = snapshots.back();
+	s.tick = tick;
+	s.shipPosition = sim.ship().position;
+	s.altitude = sim.altitude();
+	s.landed = sim.landed;
+	if (bShowPrediction) predictor.predict(sim);
+	else predictor.paths.clear();
+	s.prediction = predictor.paths;
+	s.exhaust.resize(thruster_emitter.particleCount());
+	packExhaust(s.exhaust.data(), s.exhaust.size());
+	snapshots.publish();
+}
+
+// Record from here on.  The first checkpoint holds the current state, so a
+// recording can start mid-flight.
+void ofApp::toggleRecording() {
+	bool resume = stopSimThread();
+	if (recorder.recording) {
+		recorder.end(tick);
+		cout << "recorded " << tick << " ticks to " << recorder.path << endl;
+	}
+	else if (!bReplaying) beginRecording();
+	if (resume) startSimThread();
+}
+
+void ofApp::beginRecording() {
+	SessionHeader h;
+	h.dt = fixedDt;
+	h.start = sim.ship().position;
+	h.seed = thruster_emitter.seed;
+	lastSession = "session-" + ofGetTimestampString() + ".llog";
+	tick = 0;
+	if (recorder.begin(lastSession, h)) {
+		recorder.checkpoint(tick, sim.saveState(), thruster_emitter.seed);
+		recorder.gravity(tick, sim.gravity);
+		cout << "recording to " << lastSession << endl;
+	}
+}
+
+// memory use by subsystem over the whole run
+void ofApp::exit() {
+	stopSimThread();
+	cout << MemoryTags::report();
+}
+
+// the profile captured so far, as Chrome trace JSON and CSV
+void ofApp::exportProfile() {
+	string name = "profile-" + ofGetTimestampString();
+	if (Profiler::writeChromeTrace(name + ".json") && Profiler::writeCsv(name + ".csv") &&
+		frameGraph.writeCriticalPaths(name + "-critical.csv"))
+		cout << "wrote " << name << ".json, .csv and -critical.csv" << endl;
+}
+
+void ofApp::startReplay(const string &path, bool maxSpeed) {
+	bool resume = stopSimThread();
+	if (recorder.recording) recorder.end(tick);
+	if (replay.load(path)) beginReplay(path, maxSpeed);
+	if (resume) startSimThread();
+}
+
+void ofApp::beginReplay(const string &path, bool maxSpeed) {
+	fixedDt = replay.header.dt;
+	bReplayMaxSpeed = maxSpeed;
+	bReplaying = true;
+	pendingControls.clear();
+	seekReplay(-(int) replay.checkpoints.size());
+	cout << "replaying " << path << ", " << replay.endTick << " ticks, "
+		<< replay.checkpoints.size() << " checkpoints" << endl;
+}
+
+// jump "checkpoints" checkpoints forward (or back) from the current tick
+void ofApp::seekReplay(int checkpoints) {
+	bool resume = stopSimThread();
+	if (bReplaying) {
+		const Checkpoint &c = replay.seek(replay.checkpointBefore(tick) + checkpoints);
+		sim.loadState(c.state);
+		thruster_emitter.setSeed(c.seed);
+		thruster_emitter.stop();
+		tick = c.tick;
+		accumulator = 0;
+	}
+	if (resume) startSimThread();
 }
 
 //--------------------------------------------------------------
 void ofApp::draw() {
+	PROFILE_SCOPE("draw");
+	if (!bLoaded) {
+		drawLoadingScreen();
+		return;
+	}
     background.draw(0, 0, ofGetWindowWidth(), ofGetWindowHeight());
 	//    cout << ofGetFrameRate() << endl;
 
 	ofEnableDepthTest();
-	loadVbo();
 
 	//start camera
 	camera->camera_begin();
@@ -195,7 +584,7 @@ void ofApp::draw() {
 	if (bWireframe) {                    // wireframe mode  (include axis)
 		ofDisableLighting();
 		ofSetColor(ofColor::slateGray);
-		mars.drawWireframe();
+		drawTerrain(OF_MESH_WIREFRAME);
 		if (bRoverLoaded) {
 			rover.drawWireframe();
 			// ofSetColor(ofColor::green);
@@ -206,7 +595,7 @@ void ofApp::draw() {
 	}
 	else {
 		ofEnableLighting();              // shaded mode
-		mars.drawFaces();
+		drawTerrain(OF_MESH_FILL);
 
 		if (bRoverLoaded) {
 			rover.drawFaces();
@@ -214,13 +603,16 @@ void ofApp::draw() {
 
 			// this makes everything look glowy :)
 			//
+			PROFILE_SCOPE("draw exhaust");
 			ofEnableBlendMode(OF_BLENDMODE_ADD);
 			ofEnablePointSprites();
 			glDepthMask(GL_FALSE);
 			//draw emission
 			shader.begin();
+			shader.setUniform1f("time", ofGetElapsedTimeMillis() / 1000.0);
+			shader.setUniform1f("pointSize", particlePointSize);
 			particleTex.bind();
-			vbo.draw(GL_POINTS, 0, (int) thruster_emitter.sys->particles.size());
+			particleStream.draw(GL_POINTS);
 			particleTex.unbind();
 			//thruster_emitter.draw();
 			shader.end();
@@ -236,7 +628,7 @@ void ofApp::draw() {
 	if (bDisplayPoints) {                // display points as an option
 		glPointSize(3);
 		ofSetColor(ofColor::green);
-		mars.drawVertices();
+		drawTerrain(OF_MESH_POINTS);
 	}
 
 	// highlight selected point (draw sphere around selected point)
@@ -246,6 +638,8 @@ void ofApp::draw() {
 		ofDrawSphere(selectedPoint, .1);
 	}
 
+	drawPrediction();
+
 	ofNoFill();
 	//ofSetColor(ofColor::red);
 	//drawBox(boundingBox);
@@ -273,6 +667,95 @@ void ofApp::draw() {
 	ofFill();
 	ofSetColor(255, 255, 255, 255);
 	ofDrawBitmapString(AGL, 10, 85);
+
+	if (bShowProfiler) {
+		Profiler::drawHud(10, ofGetHeight() - 170, 360, 160);
+		MemoryTags::drawHud(380, ofGetHeight() - 170);
+		if (!pipelined()) ofDrawBitmapString("critical path: " + frameGraph.criticalPathReport(), 10, ofGetHeight() - 176);
+		ofDrawBitmapString("quality " + ofToString(governor.level) + (governor.isEnabled() ? "" : " (fixed)") + ", " +
+			ofToString(governor.averageMs, 1) + " ms update + draw", 10, ofGetHeight() - 190);
+	}
+
+	// CPU side of the frame; the wait for vsync comes after draw()
+	governor.frame((ofGetElapsedTimeMicros() - frameStart) / 1000.0);
+}
+
+// The path ahead at the current thrust as one line strip, and where each
+// thrust setting tried touches down: green if slow enough to land, red if
+// it would crash.  The current thrust's marker is the larger one.
+void ofApp::drawPrediction() {
+	const vector<PredictedPath> &paths = pipelined() ? snapshots.front().prediction : predictor.paths;
+	if (!bShowPrediction || paths.empty()) return;
+	ofDisableLighting();
+	predictionStrip.clear();
+	predictionStrip.addVertices(paths[0].points);
+	ofSetColor(ofColor::yellow);
+	predictionStrip.draw();
+	for (int i = paths.size() - 1; i >= 0; i--) {
+		if (!paths[i].touchdown) continue;
+		ofSetColor(paths[i].touchdownVelocity.length() > sim.crashSpeed ? ofColor::red : ofColor::green);
+		ofDrawSphere(paths[i].touchdownPoint, i == 0 ? 0.3 : 0.12);
+	}
+}
+
+// a static terrain vbo (mesh or tile) as the render mode asks
+static void drawTerrainVbo(ofVbo &vbo, ofPolyRenderMode mode) {
+	if (mode == OF_MESH_POINTS) {
+		vbo.draw(GL_POINTS, 0, vbo.getNumVertices());
+		return;
+	}
+#ifndef TARGET_OPENGLES
+	if (mode == OF_MESH_WIREFRAME) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+#endif
+	vbo.drawElements(GL_TRIANGLES, vbo.getNumIndices());
+#ifndef TARGET_OPENGLES
+	if (mode == OF_MESH_WIREFRAME) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+#endif
+}
+
+// terrain mesh or resident tiles
+void ofApp::drawTerrain(ofPolyRenderMode mode) {
+	PROFILE_SCOPE("draw terrain");
+	if (bTiledTerrain) drawTiles(mode);
+	else drawTerrainVbo(terrainVbo, mode);
+}
+
+// The tiles TerrainTiles picks, each uploaded to a vbo the first time it is
+// drawn, at most maxTileUploadsPerFrame a frame; the vbo goes when the tile
+// is evicted.
+void ofApp::drawTiles(ofPolyRenderMode mode) {
+	PROFILE_SCOPE("draw tiles");
+	for (auto it = tileVbos.begin(); it != tileVbos.end();) {
+		if (it->second.tile.expired()) it = tileVbos.erase(it);
+		else ++it;
+	}
+	tiles.drawList(drawnTiles);
+	int uploads = 0;
+	for (const shared_ptr<const TerrainTile> &t : drawnTiles) {
+		auto found = tileVbos.find(t.get());
+		if (found == tileVbos.end()) {
+			if (uploads >= maxTileUploadsPerFrame) continue;
+			found = tileVbos.emplace(t.get(), TileVbo()).first;
+			found->second.tile = t;
+			found->second.vbo.setMesh(t->mesh, GL_STATIC_DRAW);
+			uploads++;
+		}
+		drawTerrainVbo(found->second.vbo, mode);
+	}
+	drawnTiles.clear();
+}
+
+// progress bar and the stages still loading
+void ofApp::drawLoadingScreen() {
+	ofBackground(0);
+	float w = ofGetWidth() * 0.5, x = (ofGetWidth() - w) / 2, y = ofGetHeight() / 2;
+	ofSetColor(ofColor::darkGray);
+	ofNoFill();
+	ofDrawRectangle(x, y, w, 12);
+	ofFill();
+	ofSetColor(ofColor::white);
+	ofDrawRectangle(x, y, w * loader.progress(), 12);
+	ofDrawBitmapString("loading " + loader.status(), x, y + 32);
 }
 
 // Draw an XYZ axis in RGB at world (0,0,0) for reference.
@@ -344,6 +827,7 @@ void ofApp::drawOctree(const Box &node, const bool onlySelectedVertexTree) {
 }
 
 void ofApp::keyPressed(int key) {
+	if (!bLoaded) return;
 
 	switch (key) {
 	case '1':
@@ -371,34 +855,55 @@ void ofApp::keyPressed(int key) {
 		ofToggleFullscreen();
 		break;
 	case OF_KEY_DOWN:
-		if (!landed) {
-			thruster.add(ofVec3f(0, 0, 0.5)); // was 0, 0.5, 0
-		}
-		break;
 	case ' ':
-		if (!landed) {
-			if (!thruster_emitter.started) thruster_emitter.start();
-            if (!soundPlayer.isPlaying()) soundPlayer.play();
-			thruster.add(ofVec3f(0, .5, 0));
-		}
-
-		break;
 	case OF_KEY_UP:
-		if (!landed) {
-			thruster.add(ofVec3f(0, 0, -0.5));
-		}
-		break;
 	case OF_KEY_LEFT:
-		if (!landed) {
-			thruster.add(ofVec3f(-.5, 0, 0));
-		}
-
-		break;
 	case OF_KEY_RIGHT:
-		if (!landed) {
-            soundPlayer.play();
-			thruster.add(ofVec3f(.5, 0, 0));
-        }
+		queueControl(key, true);
+		break;
+	case 'm':
+		// frame time graph; zones are only recorded while it's up
+		bShowProfiler = !bShowProfiler;
+		Profiler::enabled = bShowProfiler;
+		break;
+	case 'x':
+		exportProfile();
+		break;
+	case 'q':
+		// adaptive quality on / off
+		governor.setEnabled(!governor.isEnabled());
+		cout << "quality governor " << (governor.isEnabled() ? "on" : "off") << endl;
+		break;
+	case 'e':
+	{
+		// exhaust particles compressed (fp16) or full size; the sim
+		// thread steps them in pipelined mode, so it is paused
+		bool wasPipelined = stopSimThread();
+		thruster_emitter.setCompact(thruster_emitter.compact ? NULL : &compactExhaust);
+		if (wasPipelined) startSimThread();
+		cout << (thruster_emitter.compact ? "compact" : "full") << " exhaust particles" << endl;
+		break;
+	}
+	case 'l':
+		bShowPrediction = !bShowPrediction;
+		break;
+	case 'T':
+		// simulation on its own thread, or back in update()
+		if (!stopSimThread()) startSimThread();
+		cout << (pipelined() ? "pipelined" : "serial") << " simulation" << endl;
+		break;
+	case 'o':
+		toggleRecording();
+		break;
+	case 'p':
+	case 'P':
+		if (lastSession != "") startReplay(lastSession, key == 'P');
+		break;
+	case '[':
+		seekReplay(-1);
+		break;
+	case ']':
+		seekReplay(1);
 		break;
 	case 'H':
 	case 'h':
@@ -470,15 +975,14 @@ void ofApp::togglePointSelectedOctree() {
 }
 
 void ofApp::keyReleased(int key) {
+	if (!bLoaded) return;
 	switch (key) {
 	case ' ':
-		thruster_emitter.stop();
-        soundPlayer.stop();
 	case OF_KEY_RIGHT:
 	case OF_KEY_LEFT:
 	case OF_KEY_UP:
 	case OF_KEY_DOWN:
-		thruster.set(ofVec3f(0, 0, 0));
+		queueControl(key, false);
 		break;
 	case OF_KEY_ALT:
 		cam.disableMouseInput();
@@ -499,195 +1003,26 @@ void ofApp::mouseMoved(int x, int y) {
 
 // AGL displayed on top right
 float ofApp::displayAGL() {
-	float result = 0;
-	ofVec3f selected = ofVec3f(0, 0, 0);
-
-	Ray ray = Ray(Vector3(sys.particles[0].position.x, sys.particles[0].position.y, sys.particles[0].position.z),
-		Vector3(0, -1, 0));
-	vector<int> selectedVertices = getIntersectingVertices(octree.root, ray);
-
-	if (selectedVertices.size() != 0) {
-		// Find the closest vertex
-		int closestVertex = selectedVertices[0];
-		for (int i : selectedVertices) {
-			if (marsMesh.getVertex(i).y > marsMesh.getVertex(closestVertex).y
-				&& marsMesh.getVertex(closestVertex).y > 20)
-				closestVertex = i;
-
-		}
-		selected = marsMesh.getVertex(closestVertex);
-	}
-
-	result = sys.particles[0].position.y - selected.y;
-	return result;
+	return pipelined() ? snapshots.front().altitude : agl;
 }
 
 void ofApp::mousePressed(int x, int y, int button) {
 
 }
 
-// Checks which vetices intersect with ray; returns vertex indices of intersection,
-// empty vector if no leaf found with vertices.
-vector<int> ofApp::getIntersectingVertices(Box &box, const Ray &ray) {
-	if (box.intersect(ray, 0, 100)) {
-		// if only one vertex in leaf, we've found the lowest depth
-		if (box.vertexIndices.size() == 1) return { box.vertexIndices[0] };
-
-		// accumulate growing vector of intersected vertices
-		vector<int> selectedVertices;
-		for (Box &child : box.children) {
-			vector<int> vertices = getIntersectingVertices(child, ray);
-			for (int vertex : vertices) {
-				selectedVertices.push_back(vertex);
-			}
-		}
-		if (selectedVertices.size() == 0) return { };
-
-		box.containsSelectedVertex = true;
-
-		return selectedVertices;
-	}
-	else {
-		box.containsSelectedVertex = false;
-		return { };
-	}
-}
-
-// Checks if rover point intersects with bounding box
-// return a list of points that the rover point collides with
-vector<int> ofApp::getCollision(Box &box, const ofPoint &point) {
-	if (box.contains(point)) {
-		// if only one vertex in leaf, we've found the lowest depth
-		if (box.vertexIndices.size() == 1) return { box.vertexIndices[0] };
-		// accumulate growing vector of intersected vertices
-		vector<int> selectedVertices;
-		for (Box &child : box.children) {
-			vector<int> vertices = getCollision(child, point);
-			for (int vertex : vertices) {
-				selectedVertices.push_back(vertex);
-			}
-		}
-		if (selectedVertices.size() == 0) return { };
-		box.containsSelectedVertex = true;
-		return selectedVertices;
-	}
-	else {
-		box.containsSelectedVertex = false;
-		return { };
-	}
-}
-
-
 //draw a box from a "Box" class
 void ofApp::drawBox(const Box &box) {
 	Vector3 min = box.parameters[0];
 	Vector3 max = box.parameters[1];
 	Vector3 size = max - min;
 	Vector3 center = size / 2 + min;
-	ofVec3f p = ofVec3f(center.x(), center.y(), center.z());
+	ofVec3f p = center;
 	float w = size.x();
 	float h = size.y();
 	float d = size.z();
 	ofDrawBox(p, w, h, d);
 }
 
-// return a Mesh Bounding Box for the entire Mesh
-Box ofApp::meshBounds(const ofMesh & mesh) {
-	int n = mesh.getNumVertices();
-	ofVec3f v = mesh.getVertex(0);
-	ofVec3f max = v;
-	ofVec3f min = v;
-	for (int i = 1; i < n; i++) {
-		ofVec3f v = mesh.getVertex(i);
-
-		if (v.x > max.x) max.x = v.x;
-		else if (v.x < min.x) min.x = v.x;
-
-		if (v.y > max.y) max.y = v.y;
-		else if (v.y < min.y) min.y = v.y;
-
-		if (v.z > max.z) max.z = v.z;
-		else if (v.z < min.z) min.z = v.z;
-	}
-	return Box(Vector3(min.x, min.y, min.z), Vector3(max.x, max.y, max.z));
-}
-
-//  Subdivide a Box into eight(8) equal size boxes, return them in boxList;
-void ofApp::subDivideBox8(const Box &box, vector<Box> & boxList) {
-	Vector3 min = box.parameters[0];
-	Vector3 max = box.parameters[1];
-	Vector3 size = max - min;
-	Vector3 center = size / 2 + min;
-	float xdist = (max.x() - min.x()) / 2;
-	float ydist = (max.y() - min.y()) / 2;
-	float zdist = (max.z() - min.z()) / 2;
-	Vector3 h = Vector3(0, ydist, 0);
-
-	//  generate ground floor
-	Box b[8];
-	b[0] = Box(min, center);
-	b[1] = Box(b[0].min() + Vector3(xdist, 0, 0), b[0].max() + Vector3(xdist, 0, 0));
-	b[2] = Box(b[1].min() + Vector3(0, 0, zdist), b[1].max() + Vector3(0, 0, zdist));
-	b[3] = Box(b[2].min() + Vector3(-xdist, 0, 0), b[2].max() + Vector3(-xdist, 0, 0));
-
-	boxList.clear();
-	for (int i = 0; i < 4; i++)
-		boxList.push_back(b[i]);
-
-	// generate second story
-	for (int i = 4; i < 8; i++) {
-		b[i] = Box(b[i - 4].min() + h, b[i - 4].max() + h);
-		boxList.push_back(b[i]);
-	}
-}
-
-// Recursive function for ofApp:generateTree(), generates an octree
-void ofApp::generateTreeNodes(Box &node, const map<int, ofVec3f> &vertexList, int currentDepth, int maxDepth) {
-	// Set node level
-	node.level = currentDepth;
-	if (currentDepth > octreeHighestDepth)
-		octreeHighestDepth = currentDepth;
-
-	// divide current node into 8 leaves
-	subDivideBox8(node, node.children);
-
-	for (int i = 0; i < node.children.size(); i++) {
-		node.children[i].level = currentDepth + 1;
-
-		map<int, ofVec3f> innerVertices;
-		for (auto &pair : vertexList) {
-			if (node.children[i].contains(pair.second)) {
-				// if current leaf contains a vertex, add it to vertex index list
-				node.children[i].vertexIndices.push_back(pair.first);
-				// also add vertex to inner vector from which leaves will search through
-				innerVertices.insert(pair);
-			}
-		}
-		// delete any leaves with no vertices
-		if (innerVertices.size() == 0) {
-			node.children.erase(node.children.begin() + i);
-			i--;
-		}
-		// recursively generate more leaves if more than one inner vertex
-		else if (currentDepth < maxDepth && innerVertices.size() > 1)
-			generateTreeNodes(node.children[i], innerVertices, node.children[i].level, maxDepth);
-	}
-}
-
-// Given a bounding box & a mesh, generate an octree of a specified depth
-void ofApp::generateTree(const Box &boundingBox, const ofMesh &mesh, int maxDepth, Octree &octree) {
-	// Initialize list of vertices and corresponding indexes
-	map<int, ofVec3f> vertexList;
-	vector<ofVec3f> vertices = mesh.getVertices();
-	for (int i = 0; i < vertices.size(); i++) {
-		vertexList.emplace(i, vertices[i]);
-	}
-
-	octree.root = boundingBox;
-
-	generateTreeNodes(octree.root, vertexList, 0, maxDepth);
-}
-
 void ofApp::mouseDragged(int x, int y, int button) {
 }
 
@@ -700,7 +1035,7 @@ void ofApp::mouseReleased(int x, int y, int button) {
 //  if a point is selected, return true, else return false;
 bool ofApp::doPointSelection() {
 
-	ofMesh mesh = mars.getMesh(0);
+	const ofMesh &mesh = sim.terrain;
 	int n = mesh.getNumVertices();
 	float nearestDistance = 0;
 	int nearestIndex = 0;
@@ -805,6 +1140,13 @@ void ofApp::savePicture() {
 // support drag-and-drop of model (.obj) file loading.  when
 // model is dropped in viewport, place origin under cursor
 void ofApp::dragEvent(ofDragInfo dragInfo) {
+	if (!bLoaded) return;
+
+	// a dropped session log is replayed in real time
+	if (ofToLower(ofFilePath::getFileExt(dragInfo.files[0])) == "llog") {
+		startReplay(dragInfo.files[0], false);
+		return;
+	}
 
 	ofVec3f point;
 	mouseIntersectPlane(ofVec3f(0, 0, 0), cam.getZAxis(), point);
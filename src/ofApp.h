@@ -9,6 +9,36 @@
 #include  "ParticleSystem.h"
 #include  "ParticleEmitter.h"
 #include "Camera.h"
+#include "LanderSim.h"
+#include "ParticleStream.h"
+#include "InputLog.h"
+#include "TerrainTiles.h"
+#include "AssetLoader.h"
+#include "MeshCache.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "TaskGraph.h"
+#include "QualityGovernor.h"
+#include "TrajectoryPredictor.h"
+#include <atomic>
+#include <thread>
+
+// what draw() needs from the simulation, published by the sim thread after
+// every batch of ticks in pipelined mode
+struct SimSnapshot {
+	uint32_t tick;
+	ofVec3f shipPosition;
+	float altitude;
+	bool landed;
+	TaggedVector<ParticleVertex, MemStaging> exhaust;   // packed for the particle stream
+	vector<PredictedPath> prediction;
+};
+
+// a flight key, main -> sim thread, or a replayed one on its way back for sound
+struct SimInput {
+	int key;
+	bool pressed;
+};
 
 class ofApp : public ofBaseApp{
     
@@ -16,6 +46,7 @@ public:
     void setup();
     void update();
     void draw();
+    void exit();
     
     void keyPressed(int key);
     void keyReleased(int key);
@@ -40,28 +71,65 @@ public:
     void setCameraTarget();
     bool doPointSelection();
 	void loadVbo();
-    vector<int> getIntersectingVertices(Box &box, const Ray &ray);
-    vector<int> getCollision(Box &box, const ofVec3f &point);
+	void packExhaust(ParticleVertex *out, int count);
     void drawBox(const Box &box);
     ofVec3f getCenter(const ofMesh &);
-    Box meshBounds(const ofMesh &);
-    void subDivideBox8(const Box &b, vector<Box> &boxList);
-    void generateTree(const Box &boundingBox, const ofMesh &mesh, int maxDepth, Octree &octree);
-    void generateTreeNodes(Box &node, const std::map<int, ofVec3f> &vertexList, int currentDepth, int maxDepth);
     float displayAGL();
+	void drawTerrain(ofPolyRenderMode mode);
+	void drawTiles(ofPolyRenderMode mode);
+	void setupScene();
+	void drawLoadingScreen();
+	void drawPrediction();
+
+	// fixed-step simulation with session recording and replay
+	void simTick();
+	void advance(double elapsed);
+	void setupFrameGraph();
+	void setupGovernor();
+	void applyExhaustQuality();
+	void queueControl(int key, bool pressed);
+	void controlEffects(int key, bool pressed);
+	void exhaustEffects(int key, bool pressed);
+	void soundEffects(int key, bool pressed, bool landed);
+	void toggleRecording();
+	void beginRecording();
+	void startReplay(const string &path, bool maxSpeed);
+	void beginReplay(const string &path, bool maxSpeed);
+	void seekReplay(int checkpoints);
+	void exportProfile();
+
+	// pipelined mode: the simulation and the exhaust step on simThread while
+	// draw() works from the latest snapshot
+	bool pipelined() const { return simThread.joinable(); }
+	bool startSimThread();
+	bool stopSimThread();           // true if it was running
+	void simThreadLoop();
+	void applySimInputs();
+	void publishSnapshot();
     
     bool mouseIntersectPlane(ofVec3f planePoint, ofVec3f planeNorm, ofVec3f &point);
     
     ofVec3f center, bottom;
     float roverX,roverY,roverZ;
     ofEasyCam cam;
-    ofxAssimpModelLoader mars, rover;
-    ofMesh marsMesh;
+    ofxAssimpModelLoader rover;
+	string terrainSource;           // OBJ path, "procedural:..." spec or "tiles:<dir>"
+	bool bProceduralTerrain;
+	ofVbo terrainVbo;               // terrain mesh, static
+	MeshCacheFile terrainCache;     // mapped while loading, uploaded from directly
+	bool bTiledTerrain;
+	TerrainTiles tiles;             // paged around the lander and camera
+	struct TileVbo {
+		weak_ptr<const TerrainTile> tile;   // expired once the tile is evicted
+		ofVbo vbo;
+	};
+	unordered_map<const TerrainTile *, TileVbo> tileVbos;
+	vector<shared_ptr<const TerrainTile> > drawnTiles;
+	int maxTileUploadsPerFrame;
     ofMesh roverMesh;
+	MemoryCharge roverMemory{MemMeshes};
     ofLight light;
     Box boundingBox, roverBox;
-    Octree octree;
-    int octreeHighestDepth; // contains the highest depth of leaves, updated within generateTree()
     
     bool bAltKeyDown;
     bool bCtrlKeyDown;
@@ -73,8 +141,8 @@ public:
     bool bHide;
     
     bool bRoverLoaded;
+	bool bShowProfiler;
     bool bTerrainSelected;
-    bool landed;
     
 	//thurster emission
 	ofxPanel gui;
@@ -87,17 +155,54 @@ public:
     ofxFloatSlider gravity;
     
     const float selectionRange = 4.0;
-    const int octreeMaxDepth = 40;
     
-    ParticleSystem sys;
 	ParticleEmitter thruster_emitter;
-    ThrusterForce thruster;
-    Particle ship;
+	CompactParticleSystem compactExhaust;   // the exhaust's store when compressed
+
+	// lander physics, terrain and octree
+	LanderSim sim;
+	float fixedDt;                  // sec per simulation tick
+	double accumulator;             // sec of frame time not yet simulated
+	uint32_t tick;
+	vector<pair<int, bool> > pendingControls;   // applied on the next tick
+	float agl;                                  // from the last frame's AGL stage
+
+	// touchdown point and path ahead, worked out where the ship is stepped
+	TrajectoryPredictor predictor;
+	std::atomic<bool> bShowPrediction;
+	ofVboMesh predictionStrip;
+
+	// update() runs the serial frame as a graph of stages on the pool
+	TaskPool taskPool;
+	TaskGraph frameGraph;
+
+	// scales the exhaust, point size, tile detail and octree depth to hold
+	// the frame time; the exhaust level is applied by whoever runs the exhaust
+	QualityGovernor governor;
+	std::atomic<int> exhaustQuality;
+	int exhaustQualityApplied;
+	uint64_t frameStart;            // us, top of update()
+	std::atomic<float> gravitySetting;          // the slider, read by simTick()
+
+	std::thread simThread;
+	std::atomic<bool> simThreadRunning;
+	SpscQueue<SimInput, 256> simInputs;         // keys, main -> sim thread
+	SpscQueue<SimInput, 256> simEffects;        // replayed keys, sim thread -> main
+	TripleBuffer<SimSnapshot> snapshots;
+
+	InputRecorder recorder;
+	InputReplay replay;
+	string lastSession;
+	std::atomic<bool> bReplaying;   // also cleared by the sim thread when a replay ends
+	bool bReplayMaxSpeed;
+
+	// staged startup, nothing is simulated or drawn until bLoaded
+	AssetLoader loader;
+	bool bLoaded;
 
 	//Camera
 	Camera* camera;
 
-    ImpulseForce impulseForce;  // create the impulse force
     
     ofSoundPlayer soundPlayer;
 
@@ -105,10 +210,12 @@ public:
 	//
 	ofTexture  particleTex;
     ofImage background;
+	ofPixels particlePixels, backgroundPixels;   // decoded by the loader
 
 	// shaders
 	//
-	ofVbo vbo;
+	ParticleStream particleStream;
 	ofShader shader;
+	float particlePointSize;
 };
 
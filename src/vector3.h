@@ -2,19 +2,26 @@
 #define _VECTOR3_H_
 
 #include <math.h>
+#include <type_traits>
+#include "ofMain.h"
 
+// Same layout as ofVec3f (three packed floats) and trivially copyable, so
+// converting either way is a plain 12 byte copy and arrays of either can be
+// read by the batch loops in box.cpp.
 class Vector3 {
   public:
-    Vector3() { };
+    Vector3() = default;
     Vector3(float x, float y, float z) { d[0] = x; d[1] = y; d[2] = z; }
-    Vector3(const Vector3 &v)
-      { d[0] = v.d[0]; d[1] = v.d[1]; d[2] = v.d[2]; }
+    Vector3(const ofVec3f &v) { d[0] = v.x; d[1] = v.y; d[2] = v.z; }
+    operator ofVec3f() const { return ofVec3f(d[0], d[1], d[2]); }
 
     float x() const { return d[0]; }
     float y() const { return d[1]; }
     float z() const { return d[2]; }
 
     float operator[](int i) const { return d[i]; }
+    float &operator[](int i) { return d[i]; }
+    const float *data() const { return d; }
     
     float length() const
       { return sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]); }
@@ -73,4 +80,7 @@ class Vector3 {
     float d[3];
 };
 
+static_assert(std::is_trivially_copyable<Vector3>::value, "Vector3 must stay a plain 12 byte value");
+static_assert(sizeof(Vector3) == sizeof(ofVec3f), "Vector3 and ofVec3f must share a layout");
+
 #endif 
\ No newline at end of file